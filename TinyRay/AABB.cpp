@@ -0,0 +1,88 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <float.h>
+#include "AABB.h"
+
+AABB::AABB()
+{
+	SetEmpty();
+}
+
+AABB::AABB(const Vector3& min, const Vector3& max)
+{
+	m_min = min;
+	m_max = max;
+}
+
+AABB::~AABB()
+{
+}
+
+void AABB::SetEmpty()
+{
+	m_min.SetVector(FLT_MAX, FLT_MAX, FLT_MAX);
+	m_max.SetVector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+void AABB::Extend(const Vector3& point)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (point[i] < m_min[i]) m_min[i] = point[i];
+		if (point[i] > m_max[i]) m_max[i] = point[i];
+	}
+}
+
+void AABB::Extend(const AABB& box)
+{
+	//Merge per component so that extending by an empty box has no effect
+	for (int i = 0; i < 3; i++)
+	{
+		if (box.m_min[i] < m_min[i]) m_min[i] = box.m_min[i];
+		if (box.m_max[i] > m_max[i]) m_max[i] = box.m_max[i];
+	}
+}
+
+void AABB::Pad(float amount)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		m_min[i] -= amount;
+		m_max[i] += amount;
+	}
+}
+
+bool AABB::IsEmpty() const
+{
+	return m_min[0] > m_max[0] || m_min[1] > m_max[1] || m_min[2] > m_max[2];
+}
+
+Vector3 AABB::GetCentroid() const
+{
+	return (m_min + m_max) * 0.5f;
+}
+
+float AABB::GetSurfaceArea() const
+{
+	if (IsEmpty()) return 0.0f;
+
+	Vector3 extent = m_max - m_min;
+
+	return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+int AABB::GetLongestAxis() const
+{
+	Vector3 extent = m_max - m_min;
+
+	if (extent[0] >= extent[1] && extent[0] >= extent[2]) return 0;
+
+	return extent[1] >= extent[2] ? 1 : 2;
+}
@@ -0,0 +1,50 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Vector3.h"
+
+//Class representing an axis-aligned bounding box
+class AABB
+{
+	private:
+		Vector3			m_min;			//the minimum corner of the box
+		Vector3			m_max;			//the maximum corner of the box
+
+	public:
+		AABB();
+		AABB(const Vector3& min, const Vector3& max);
+		~AABB();
+
+		//Reset the box so that it contains nothing
+		void			SetEmpty();
+
+		//Grow the box to contain the given point or box
+		void			Extend(const Vector3& point);
+		void			Extend(const AABB& box);
+
+		//Grow the box by a fixed amount along each axis
+		void			Pad(float amount);
+
+		bool			IsEmpty() const;
+		Vector3			GetCentroid() const;
+		int				GetLongestAxis() const;
+		float			GetSurfaceArea() const;
+
+		inline const Vector3& GetMin() const
+		{
+			return m_min;
+		}
+
+		inline const Vector3& GetMax() const
+		{
+			return m_max;
+		}
+};
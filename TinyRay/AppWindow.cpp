@@ -220,6 +220,52 @@ BOOL AppWindow::KeyUp(WPARAM key)
 		m_pRayTracer->m_traceflag = (RayTracer::TraceFlags)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
 			| RayTracer::TRACE_REFRACTION | RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW);
 		break;
+	case 'P':
+		m_pRayTracer->SetPacketTracing(!m_pRayTracer->GetPacketTracing());
+		break;
+	case VK_LEFT:
+	case VK_RIGHT:
+	case VK_UP:
+	case VK_DOWN:
+		{
+			//Slide the camera, keeping the direction it looks in
+			Camera* camera = m_pScene->GetSceneCamera();
+			Vector3 offset = key == VK_LEFT ? camera->GetRightVector() * -0.5 :
+				key == VK_RIGHT ? camera->GetRightVector() * 0.5 :
+				key == VK_UP ? camera->GetUpVector() * 0.5 : camera->GetUpVector() * -0.5;
+			Vector3 position = camera->GetPosition() + offset;
+			camera->SetPositionAndLookAt(position, position + camera->GetViewVector());
+		}
+		break;
+	case 'R':
+		m_pRayTracer->SetReprojection(!m_pRayTracer->GetReprojection());
+		break;
+	case 'A':
+		m_pRayTracer->SetAdaptiveSampling(!m_pRayTracer->GetAdaptiveSampling());
+		break;
+	case 'G':
+		m_pRayTracer->SetProgressive(!m_pRayTracer->GetProgressive());
+		break;
+	case 'W':
+		m_pRayTracer->SetWavefront(!m_pRayTracer->GetWavefront());
+		break;
+	case 'S':
+		m_pRayTracer->SetRaySorting(!m_pRayTracer->GetRaySorting());
+		break;
+	case 'C':
+		m_pRayTracer->SetFrustumCulling(!m_pRayTracer->GetFrustumCulling());
+		break;
+	case 'T':
+		//Cycle rows -> 16x16 Hilbert -> 32x32 Hilbert -> 16x16 Morton -> 32x32 Morton -> rows
+		if (m_pRayTracer->GetTileSize() == 0)
+			m_pRayTracer->SetTileScheduling(16, TILE_ORDER_HILBERT);
+		else if (m_pRayTracer->GetTileSize() == 16)
+			m_pRayTracer->SetTileScheduling(32, m_pRayTracer->GetTileOrder());
+		else if (m_pRayTracer->GetTileOrder() == TILE_ORDER_HILBERT)
+			m_pRayTracer->SetTileScheduling(16, TILE_ORDER_MORTON);
+		else
+			m_pRayTracer->SetTileScheduling(0, TILE_ORDER_HILBERT);
+		break;
 	}
 
 	m_pRayTracer->ResetRenderCount();
@@ -0,0 +1,89 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdint.h>
+#include "Arena.h"
+
+Arena::Arena(size_t blockSize)
+{
+	m_blockSize = blockSize;
+	m_bytesUsed = 0;
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	//Try the end of the current block first
+	if (!m_blocks.empty())
+	{
+		Block& block = m_blocks.back();
+		uintptr_t start = (uintptr_t)block.data + block.used;
+		size_t padding = (alignment - start % alignment) % alignment;
+
+		if (block.used + padding + size <= block.size)
+		{
+			block.used += padding + size;
+			m_bytesUsed += size;
+			return (void*)(start + padding);
+		}
+	}
+
+	//Start a new block, malloc already aligns it for any fundamental type
+	Block block;
+	block.size = size + alignment > m_blockSize ? size + alignment : m_blockSize;
+	block.data = (char*)malloc(block.size);
+
+	if (!block.data) throw std::bad_alloc();
+
+	uintptr_t start = (uintptr_t)block.data;
+	size_t padding = (alignment - start % alignment) % alignment;
+	block.used = padding + size;
+
+	//An oversized block is put before the current one, so that the rest of the current block is still used
+	if (block.size > m_blockSize && !m_blocks.empty())
+		m_blocks.insert(m_blocks.end() - 1, block);
+	else
+		m_blocks.push_back(block);
+
+	m_bytesUsed += size;
+
+	return (void*)(start + padding);
+}
+
+void Arena::Release()
+{
+	for (size_t i = m_finalisers.size(); i > 0; i--)
+	{
+		m_finalisers[i - 1].destroy(m_finalisers[i - 1].object);
+	}
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		free(m_blocks[i].data);
+	}
+
+	m_finalisers.clear();
+	m_blocks.clear();
+	m_bytesUsed = 0;
+}
+
+size_t Arena::GetBytesReserved() const
+{
+	size_t total = 0;
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+		total += m_blocks[i].size;
+
+	return total;
+}
@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <vector>
+
+//A bump allocator for objects that all live as long as their owner.
+//Objects are placed one after another in large blocks, so objects created together sit together in memory.
+//They cannot be freed one at a time: Release destroys every object, in the reverse order of creation,
+//and returns the blocks in one go.
+class Arena
+{
+	private:
+		struct Block
+		{
+			char*			data;
+			size_t			size;
+			size_t			used;
+		};
+
+		//Destructor of an object in the arena
+		struct Finaliser
+		{
+			void*			object;
+			void			(*destroy)(void* object);
+		};
+
+		std::vector<Block>		m_blocks;
+		std::vector<Finaliser>	m_finalisers;
+		size_t					m_blockSize;		//size of a regular block, larger allocations get a block of their own
+		size_t					m_bytesUsed;		//bytes handed out since the last Release
+
+		template<typename T>
+		static void			Destroy(void* object)
+		{
+			static_cast<T*>(object)->~T();
+		}
+
+	public:
+		Arena(size_t blockSize = 64 * 1024);
+		~Arena();
+
+		//Returns uninitialised memory of the given size and alignment, valid until Release
+		void*				Allocate(size_t size, size_t alignment);
+
+		//Construct an object in the arena, it is destroyed by Release
+		template<typename T, typename... Args>
+		T*					Create(Args&&... args)
+		{
+			T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+			Finaliser finaliser = { object, &Destroy<T> };
+			m_finalisers.push_back(finaliser);
+			return object;
+		}
+
+		//Destroy every object and free every block
+		void				Release();
+
+		inline size_t		GetBytesUsed() const
+		{
+			return m_bytesUsed;
+		}
+
+		//Returns the number of bytes of the blocks, including the unused ends of the blocks
+		size_t				GetBytesReserved() const;
+
+		inline int			GetObjectCount() const
+		{
+			return (int)m_finalisers.size();
+		}
+};
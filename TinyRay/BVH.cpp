@@ -0,0 +1,407 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+#include <algorithm>
+#include "BVH.h"
+
+const float BVH::s_traversalCost = 1.0f;
+const float BVH::s_intersectCost = 2.0f;
+
+//Bin of a centroid coordinate, clamped so that a bad centroid can never index outside the bins
+static inline int SAHBin(float centroid, float cmin, float scale, int bin_count)
+{
+	float b = (centroid - cmin) * scale;
+
+	if (!(b > 0.0f)) return 0;
+	if (b >= (float)(bin_count - 1)) return bin_count - 1;
+
+	return (int)b;
+}
+
+BVH::BVH()
+{
+	m_nodeData = nullptr;
+	m_primData = nullptr;
+	m_nodeCount = 0;
+	m_primCount = 0;
+	m_buildMethod = BUILD_SAH;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::Clear()
+{
+	m_nodes.clear();
+	m_primIndices.clear();
+	m_nodeData = nullptr;
+	m_primData = nullptr;
+	m_nodeCount = 0;
+	m_primCount = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void BVH::SetExternal(const Node* nodes, int nodeCount, const int* primIndices, int primCount)
+{
+	Clear();
+
+	m_nodeData = nodes;
+	m_primData = primIndices;
+	m_nodeCount = nodeCount;
+	m_primCount = primCount;
+	m_stats.primCount = primCount;
+	m_stats.nodeCount = nodeCount;
+}
+
+bool BVH::CheckTree(const Node* nodes, int nodeCount, const int* primIndices, int primCount, int primLimit)
+{
+	if (nodeCount < 0 || primCount < 0) return false;
+
+	for (int i = 0; i < primCount; i++)
+	{
+		if (primIndices[i] < 0 || primIndices[i] >= primLimit) return false;
+	}
+
+	//Children come after their parents, so the depths are known by the time a node is reached
+	std::vector<int> depths(nodeCount, 0);
+
+	for (int i = 0; i < nodeCount; i++)
+	{
+		const Node& node = nodes[i];
+
+		if (node.count < 0) return false;
+
+		if (node.count > 0)
+		{
+			if (node.offset < 0 || node.offset > primCount - node.count) return false;
+			continue;
+		}
+
+		//The left child follows its parent, the right child is further on
+		int left = i + 1;
+		int right = node.offset;
+		int depth = depths[i] + 1;
+
+		if (right <= left || right >= nodeCount || depth > s_maxDepth - 2) return false;
+
+		if (depths[left] < depth) depths[left] = depth;
+		if (depths[right] < depth) depths[right] = depth;
+	}
+
+	return true;
+}
+
+AABB BVH::GetBounds() const
+{
+	if (m_nodeCount == 0) return AABB();
+
+	const Node& root = m_nodeData[0];
+	return AABB(Vector3(root.bmin[0], root.bmin[1], root.bmin[2]), Vector3(root.bmax[0], root.bmax[1], root.bmax[2]));
+}
+
+int BVH::CullFrustum(const Frustum& frustum, std::vector<int>& roots) const
+{
+	roots.clear();
+
+	if (m_nodeCount == 0) return 0;
+
+	const Node* nodes = m_nodeData;
+	int stack[s_maxDepth];
+	int stack_size = 0;
+	int prim_count = 0;
+
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		int node_index = stack[--stack_size];
+		const Node& node = nodes[node_index];
+		Frustum::Overlap overlap = frustum.TestBox(node.bmin, node.bmax);
+
+		if (overlap == Frustum::OVERLAP_OUTSIDE)
+			continue;
+
+		if (overlap == Frustum::OVERLAP_INSIDE || node.count > 0)
+		{
+			roots.push_back(node_index);
+
+			//The primitives of a subtree are contiguous in m_primIndices, from its leftmost to its rightmost leaf
+			int first = node_index;
+			while (nodes[first].count == 0) first++;
+			int last = node_index;
+			while (nodes[last].count == 0) last = nodes[last].offset;
+
+			prim_count += nodes[last].offset + nodes[last].count - nodes[first].offset;
+			continue;
+		}
+
+		stack[stack_size++] = node.offset;
+		stack[stack_size++] = node_index + 1;
+	}
+
+	return prim_count;
+}
+
+void BVH::Build(const std::vector<AABB>& bounds, BuildMethod method)
+{
+	Clear();
+
+	if (bounds.empty()) return;
+
+	double start_time = omp_get_wtime();
+	int prim_count = (int)bounds.size();
+
+	m_buildMethod = method;
+
+	std::vector<Vector3> centroids(prim_count);
+
+	m_primIndices.resize(prim_count);
+
+	for (int i = 0; i < prim_count; i++)
+	{
+		centroids[i] = bounds[i].GetCentroid();
+		m_primIndices[i] = i;
+	}
+
+	//Build the top of the tree serially until the remaining subtrees are small
+	//enough, then build those subtrees in parallel. Each subtree works on its
+	//own range of m_primIndices so the threads never touch the same data.
+	BuildNode* root = new BuildNode();
+	std::vector<BuildTask> tasks;
+
+	BuildRecursive(root, bounds, centroids, 0, prim_count, 0, &tasks);
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)tasks.size(); i++)
+	{
+		BuildRecursive(tasks[i].node, bounds, centroids, tasks[i].first, tasks[i].count, tasks[i].depth, nullptr);
+	}
+
+	//Lay the tree out in depth-first order for traversal
+	m_nodes.reserve(prim_count * 2);
+	Flatten(root, 0, root->bounds.GetSurfaceArea());
+	DeleteBuildNodes(root);
+
+	m_nodeData = &m_nodes[0];
+	m_primData = &m_primIndices[0];
+	m_nodeCount = (int)m_nodes.size();
+	m_primCount = prim_count;
+
+	m_stats.primCount = prim_count;
+	m_stats.nodeCount = (int)m_nodes.size();
+	m_stats.buildTime = (omp_get_wtime() - start_time) * 1000.0;
+}
+
+void BVH::BuildRecursive(BuildNode* node, const std::vector<AABB>& bounds, const std::vector<Vector3>& centroids,
+	int first, int count, int depth, std::vector<BuildTask>* tasks)
+{
+	if (tasks && count <= s_taskSize)
+	{
+		BuildTask task = { node, first, count, depth };
+		tasks->push_back(task);
+		return;
+	}
+
+	AABB centroid_bounds;
+
+	node->bounds.SetEmpty();
+	node->children[0] = node->children[1] = nullptr;
+	node->first = first;
+	node->count = count;
+
+	for (int i = first; i < first + count; i++)
+	{
+		node->bounds.Extend(bounds[m_primIndices[i]]);
+		centroid_bounds.Extend(centroids[m_primIndices[i]]);
+	}
+
+	if (count == 1 || depth >= s_maxDepth - 2) return;
+
+	int mid = m_buildMethod == BUILD_SAH ?
+		PartitionSAH(bounds, centroids, node->bounds, centroid_bounds, first, count) :
+		PartitionMedian(centroids, centroid_bounds, first, count);
+
+	if (mid == first) return;
+
+	node->count = 0;
+	node->children[0] = new BuildNode();
+	node->children[1] = new BuildNode();
+
+	BuildRecursive(node->children[0], bounds, centroids, first, mid - first, depth + 1, tasks);
+	BuildRecursive(node->children[1], bounds, centroids, mid, first + count - mid, depth + 1, tasks);
+}
+
+int BVH::PartitionMedian(const std::vector<Vector3>& centroids, const AABB& centroid_bounds, int first, int count)
+{
+	if (count <= s_maxLeafSize) return first;
+
+	//Split at the median centroid along the longest axis of the centroid bounds
+	int axis = centroid_bounds.GetLongestAxis();
+	int mid = first + count / 2;
+
+	std::nth_element(m_primIndices.begin() + first, m_primIndices.begin() + mid, m_primIndices.begin() + first + count,
+		[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	return mid;
+}
+
+int BVH::PartitionSAH(const std::vector<AABB>& bounds, const std::vector<Vector3>& centroids, const AABB& node_bounds,
+	const AABB& centroid_bounds, int first, int count)
+{
+	struct Bin
+	{
+		AABB	bounds;
+		int		count;
+	};
+
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	int best_bin = -1;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float cmin = centroid_bounds.GetMin()[axis];
+		float extent = centroid_bounds.GetMax()[axis] - cmin;
+
+		//Infinite bounds would make every bin index NaN
+		if (!(extent > 0.0f) || !isfinite(extent)) continue;
+
+		//Drop every primitive into a bin by its centroid
+		Bin bins[s_binCount];
+		float scale = s_binCount / extent;
+
+		for (int b = 0; b < s_binCount; b++) bins[b].count = 0;
+
+		for (int i = first; i < first + count; i++)
+		{
+			int prim = m_primIndices[i];
+			int b = SAHBin(centroids[prim][axis], cmin, scale, s_binCount);
+			bins[b].count++;
+			bins[b].bounds.Extend(bounds[prim]);
+		}
+
+		//Sweep from the right to gather the area and count to the right of every split plane
+		float right_area[s_binCount];
+		int right_count[s_binCount];
+		AABB accum;
+		int accum_count = 0;
+
+		for (int b = s_binCount - 1; b > 0; b--)
+		{
+			accum.Extend(bins[b].bounds);
+			accum_count += bins[b].count;
+			right_area[b] = accum.GetSurfaceArea();
+			right_count[b] = accum_count;
+		}
+
+		//Sweep from the left and evaluate the split after each bin
+		accum.SetEmpty();
+		accum_count = 0;
+
+		for (int b = 0; b < s_binCount - 1; b++)
+		{
+			accum.Extend(bins[b].bounds);
+			accum_count += bins[b].count;
+
+			if (accum_count == 0 || right_count[b + 1] == 0) continue;
+
+			float cost = accum_count * accum.GetSurfaceArea() + right_count[b + 1] * right_area[b + 1];
+
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	if (best_axis < 0)
+	{
+		//All centroids coincide, fall back to splitting the list in half
+		return count <= s_maxLeafSize ? first : first + count / 2;
+	}
+
+	float leaf_cost = s_intersectCost * count;
+	float split_cost = s_traversalCost + s_intersectCost * best_cost / node_bounds.GetSurfaceArea();
+
+	if (count <= s_maxLeafSize && leaf_cost <= split_cost) return first;
+
+	float cmin = centroid_bounds.GetMin()[best_axis];
+	float scale = s_binCount / (centroid_bounds.GetMax()[best_axis] - cmin);
+
+	int* mid = std::partition(&m_primIndices[first], &m_primIndices[first] + count,
+		[&](int prim) { return SAHBin(centroids[prim][best_axis], cmin, scale, s_binCount) <= best_bin; });
+
+	return (int)(mid - &m_primIndices[0]);
+}
+
+void BVH::Flatten(BuildNode* node, int depth, float root_area)
+{
+	int node_index = (int)m_nodes.size();
+	m_nodes.push_back(Node());
+
+	//Pad the node so that hits computed on the surface of a primitive
+	//are never rejected by the single precision slab test
+	AABB padded = node->bounds;
+	Vector3 extent = padded.GetMax() - padded.GetMin();
+	padded.Pad(1e-4f * (fabsf(extent[0]) + fabsf(extent[1]) + fabsf(extent[2])) + 1e-4f);
+
+	for (int i = 0; i < 3; i++)
+	{
+		m_nodes[node_index].bmin[i] = padded.GetMin()[i];
+		m_nodes[node_index].bmax[i] = padded.GetMax()[i];
+	}
+
+	float relative_area = root_area > 0.0f ? node->bounds.GetSurfaceArea() / root_area : 1.0f;
+
+	if (node->count > 0)
+	{
+		m_nodes[node_index].offset = node->first;
+		m_nodes[node_index].count = node->count;
+
+		m_stats.leafCount++;
+		m_stats.maxDepth = std::max(m_stats.maxDepth, depth);
+		m_stats.sahCost += relative_area * s_intersectCost * node->count;
+		return;
+	}
+
+	m_stats.sahCost += relative_area * s_traversalCost;
+
+	//The left child immediately follows its parent
+	Flatten(node->children[0], depth + 1, root_area);
+	m_nodes[node_index].offset = (int)m_nodes.size();
+	m_nodes[node_index].count = 0;
+	Flatten(node->children[1], depth + 1, root_area);
+}
+
+void BVH::DeleteBuildNodes(BuildNode* node)
+{
+	if (node->count == 0)
+	{
+		DeleteBuildNodes(node->children[0]);
+		DeleteBuildNodes(node->children[1]);
+	}
+
+	delete node;
+}
+
+void BVH::PrintBuildStats(const char* name) const
+{
+	fprintf(stdout, "%s: %s build of %d primitives, %d nodes (%d leaves, depth %d), SAH cost %.2f, %.2f ms\n",
+		name, m_buildMethod == BUILD_SAH ? "SAH" : "median", m_stats.primCount, m_stats.nodeCount,
+		m_stats.leafCount, m_stats.maxDepth, m_stats.sahCost, m_stats.buildTime);
+}
@@ -0,0 +1,416 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include "AABB.h"
+#include "Frustum.h"
+#include "Ray.h"
+#include "RayPacket.h"
+
+//A bounding volume hierarchy built over a list of primitive bounds.
+//The tree only stores indices into that list, the owner of the primitives
+//provides the actual ray-primitive intersection when a leaf is reached.
+class BVH
+{
+	public:
+		//Strategies for splitting a node during construction
+		enum BuildMethod
+		{
+			BUILD_MEDIAN = 0,		//split at the median centroid along the longest axis
+			BUILD_SAH				//binned surface area heuristic
+		};
+
+		//A node of the flattened tree. Nodes are stored in depth-first order,
+		//so the left child of an interior node is always the next node in the array.
+		struct Node
+		{
+			float		bmin[3];		//minimum corner of the node bounds
+			int			offset;			//index of the right child for interior nodes, index of the first primitive in m_primIndices for leaves
+			float		bmax[3];		//maximum corner of the node bounds
+			int			count;			//number of primitives in a leaf, 0 for interior nodes
+		};
+
+		//Statistics gathered by the last call to Build
+		struct BuildStats
+		{
+			int			primCount;		//number of primitives in the tree
+			int			nodeCount;		//total number of nodes
+			int			leafCount;		//number of leaf nodes
+			int			maxDepth;		//depth of the deepest leaf
+			double		sahCost;		//SAH cost of the tree relative to the root surface area
+			double		buildTime;		//build time in milliseconds
+		};
+
+	private:
+		//Node of the intermediate tree created during construction
+		struct BuildNode
+		{
+			AABB		bounds;
+			BuildNode*	children[2];
+			int			first;
+			int			count;
+		};
+
+		//A subtree whose construction is deferred to the parallel build phase
+		struct BuildTask
+		{
+			BuildNode*	node;
+			int			first;
+			int			count;
+			int			depth;
+		};
+
+		static const int	s_maxLeafSize = 4;		//largest number of primitives stored in a leaf
+		static const int	s_maxDepth = 64;		//size of the traversal stack
+		static const int	s_binCount = 16;		//number of bins per axis used by the SAH builder
+		static const int	s_taskSize = 1024;		//subtrees with fewer primitives than this are built by a single thread
+		static const float	s_traversalCost;		//SAH cost of visiting an interior node
+		static const float	s_intersectCost;		//SAH cost of intersecting a primitive
+
+		std::vector<Node>	m_nodes;				//the nodes of a tree made by Build, m_nodes[0] is the root
+		std::vector<int>	m_primIndices;			//primitive indices referenced by the leaves of a tree made by Build
+		const Node*			m_nodeData;				//the nodes of the tree in use, either m_nodes or set by SetExternal
+		const int*			m_primData;				//the primitive indices of the tree in use
+		int					m_nodeCount;
+		int					m_primCount;
+		BuildMethod			m_buildMethod;			//strategy used by the last build
+		BuildStats			m_stats;				//statistics of the last build
+
+		//Build the subtree rooted at node over m_primIndices[first, first + count)
+		//If tasks is not null, subtrees small enough to be built by a single thread are
+		//appended to it instead of being built straight away
+		void				BuildRecursive(BuildNode* node, const std::vector<AABB>& bounds, const std::vector<Vector3>& centroids,
+								int first, int count, int depth, std::vector<BuildTask>* tasks);
+
+		//Partition m_primIndices[first, first + count) for an interior node
+		//Returns the index of the first primitive of the right child,
+		//or first if the node should become a leaf
+		int					PartitionMedian(const std::vector<Vector3>& centroids, const AABB& centroid_bounds, int first, int count);
+		int					PartitionSAH(const std::vector<AABB>& bounds, const std::vector<Vector3>& centroids, const AABB& node_bounds,
+								const AABB& centroid_bounds, int first, int count);
+
+		//Write the intermediate tree into m_nodes in depth-first order and free it
+		void				Flatten(BuildNode* node, int depth, float root_area);
+		void				DeleteBuildNodes(BuildNode* node);
+
+		//Slab test of a ray against the bounds of a node
+		//Params:
+		//	const float* origin		the ray origin
+		//	const float* invdir		reciprocal of the ray direction
+		//	Scalar tmax				the furthest distance of interest along the ray
+		//	float& tentry			receives the distance at which the ray enters the node
+		static inline bool	IntersectNode(const Node& node, const float* origin, const float* invdir, Scalar tmax, float& tentry)
+		{
+			float tnear = 0.0f;
+			float tfar = (float)tmax;
+
+			for (int i = 0; i < 3; i++)
+			{
+				float t0 = (node.bmin[i] - origin[i]) * invdir[i];
+				float t1 = (node.bmax[i] - origin[i]) * invdir[i];
+				if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+				tnear = t0 > tnear ? t0 : tnear;
+				tfar = t1 < tfar ? t1 : tfar;
+			}
+
+			tentry = tnear;
+			return tnear <= tfar;
+		}
+
+		//Slab test of a packet of rays against the bounds of a node
+		//Returns true if any active lane enters the node closer than its tmax,
+		//tentry receives the smallest entry distance of those lanes
+		static inline bool	IntersectNodePacket(const Node& node, const RayPacket& packet, const __m128& tmax, float& tentry)
+		{
+			__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmin[0]), packet.ox), packet.invdx);
+			__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmax[0]), packet.ox), packet.invdx);
+			__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmin[1]), packet.oy), packet.invdy);
+			__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmax[1]), packet.oy), packet.invdy);
+			__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmin[2]), packet.oz), packet.invdz);
+			__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmax[2]), packet.oz), packet.invdz);
+
+			__m128 tnear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+				_mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+			__m128 tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+				_mm_min_ps(_mm_max_ps(t0z, t1z), tmax));
+
+			__m128 hit = _mm_and_ps(_mm_cmple_ps(tnear, tfar), packet.active);
+
+			if (_mm_movemask_ps(hit) == 0) return false;
+
+			//Horizontal minimum of the entry distance over the lanes that hit
+			__m128 entry = PacketSelect(hit, tnear, _mm_set1_ps(FARFAR_AWAY));
+			entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+			entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+			tentry = _mm_cvtss_f32(entry);
+
+			return true;
+		}
+
+	public:
+		BVH();
+		~BVH();
+
+		//Build the tree over the given primitive bounds, replacing any previous tree
+		//Subtrees are constructed in parallel using OpenMP
+		void				Build(const std::vector<AABB>& bounds, BuildMethod method = BUILD_SAH);
+		void				Clear();
+
+		//Use a tree made earlier, e.g. stored in a mapped scene cache, instead of building one
+		//The arrays are not copied, they must stay valid until the next call to Build, SetExternal or Clear
+		void				SetExternal(const Node* nodes, int nodeCount, const int* primIndices, int primCount);
+
+		//Returns true if a tree for SetExternal can be traversed safely: its nodes only refer to nodes and primitive
+		//indices within the arrays, every child comes after its parent, no leaf is deeper than the traversal stack
+		//allows and every primitive index is in [0, primLimit)
+		static bool			CheckTree(const Node* nodes, int nodeCount, const int* primIndices, int primCount, int primLimit);
+
+		inline bool			IsEmpty() const
+		{
+			return m_nodeCount == 0;
+		}
+
+		inline int			GetNodeCount() const
+		{
+			return m_nodeCount;
+		}
+
+		inline const Node*	GetNodes() const
+		{
+			return m_nodeData;
+		}
+
+		inline int			GetPrimCount() const
+		{
+			return m_primCount;
+		}
+
+		inline const int*	GetPrimIndices() const
+		{
+			return m_primData;
+		}
+
+		inline const BuildStats& GetBuildStats() const
+		{
+			return m_stats;
+		}
+
+		//Returns the number of bytes used by the nodes and primitive indices of a tree made by Build
+		inline size_t		GetMemoryUsage() const
+		{
+			return m_nodes.capacity() * sizeof(Node) + m_primIndices.capacity() * sizeof(int);
+		}
+
+		//Returns the bounds of the root node, an empty box if the tree is empty
+		AABB				GetBounds() const;
+
+		//Collect the roots of the subtrees whose primitives may lie inside the frustum, whole subtrees are
+		//taken when their bounds are inside it. Traversing these subtrees visits every primitive a ray inside
+		//the frustum can hit.
+		//Returns the number of primitives in the subtrees
+		int					CullFrustum(const Frustum& frustum, std::vector<int>& roots) const;
+
+		//Print the statistics of the last build to stdout
+		void				PrintBuildStats(const char* name) const;
+
+		//Visit every primitive whose leaf is pierced by the ray closer than tmax
+		//Params:
+		//	Ray& ray				the ray being traced
+		//	const Scalar& tmax		distance to the closest hit so far, may be shortened by intersectPrim
+		//	LeafFn intersectPrim	callable taking a primitive index, invoked for each candidate primitive
+		//	int root				node of the subtree to traverse
+		template<typename LeafFn>
+		void				Traverse(Ray& ray, const Scalar& tmax, LeafFn intersectPrim, int root = 0) const
+		{
+			if (m_nodeCount == 0) return;
+
+			float origin[3];
+			float invdir[3];
+
+			for (int i = 0; i < 3; i++)
+			{
+				float d = ray.GetRay()[i];
+				//Avoid a division by zero for axis-parallel rays
+				if (fabsf(d) < 1e-20f) d = d < 0.0f ? -1e-20f : 1e-20f;
+				origin[i] = ray.GetRayStart()[i];
+				invdir[i] = 1.0f / d;
+			}
+
+			const Node* nodes = m_nodeData;
+			int stack[s_maxDepth];
+			int stack_size = 0;
+			float tentry;
+
+			if (!IntersectNode(nodes[root], origin, invdir, tmax, tentry)) return;
+			stack[stack_size++] = root;
+
+			while (stack_size > 0)
+			{
+				int node_index = stack[--stack_size];
+				const Node& node = nodes[node_index];
+
+				if (node.count > 0)
+				{
+					for (int i = node.offset; i < node.offset + node.count; i++)
+						intersectPrim(m_primData[i]);
+					continue;
+				}
+
+				//Visit the nearer child first so that tmax shrinks as early as possible
+				int left = node_index + 1;
+				int right = node.offset;
+				float tleft, tright;
+				bool hitleft = IntersectNode(nodes[left], origin, invdir, tmax, tleft);
+				bool hitright = IntersectNode(nodes[right], origin, invdir, tmax, tright);
+
+				if (hitleft && hitright)
+				{
+					if (tleft <= tright)
+					{
+						stack[stack_size++] = right;
+						stack[stack_size++] = left;
+					}
+					else
+					{
+						stack[stack_size++] = left;
+						stack[stack_size++] = right;
+					}
+				}
+				else if (hitleft)
+				{
+					stack[stack_size++] = left;
+				}
+				else if (hitright)
+				{
+					stack[stack_size++] = right;
+				}
+			}
+		}
+
+		//Visit the primitives whose leaves are pierced by the ray closer than tmax until one of them reports a hit
+		//Used for occlusion queries, where any hit will do, so the children are not sorted by distance
+		//Params:
+		//	Ray& ray				the ray being traced
+		//	Scalar tmax				the furthest distance of interest along the ray
+		//	LeafFn intersectPrim	callable taking a primitive index and returning true if the ray hits it
+		//Returns true as soon as intersectPrim returns true
+		template<typename LeafFn>
+		bool				TraverseAny(Ray& ray, Scalar tmax, LeafFn intersectPrim) const
+		{
+			if (m_nodeCount == 0) return false;
+
+			float origin[3];
+			float invdir[3];
+
+			for (int i = 0; i < 3; i++)
+			{
+				float d = ray.GetRay()[i];
+				//Avoid a division by zero for axis-parallel rays
+				if (fabsf(d) < 1e-20f) d = d < 0.0f ? -1e-20f : 1e-20f;
+				origin[i] = ray.GetRayStart()[i];
+				invdir[i] = 1.0f / d;
+			}
+
+			const Node* nodes = m_nodeData;
+			int stack[s_maxDepth];
+			int stack_size = 0;
+			float tentry;
+
+			if (!IntersectNode(nodes[0], origin, invdir, tmax, tentry)) return false;
+			stack[stack_size++] = 0;
+
+			while (stack_size > 0)
+			{
+				int node_index = stack[--stack_size];
+				const Node& node = nodes[node_index];
+
+				if (node.count > 0)
+				{
+					for (int i = node.offset; i < node.offset + node.count; i++)
+						if (intersectPrim(m_primData[i])) return true;
+					continue;
+				}
+
+				int left = node_index + 1;
+				int right = node.offset;
+
+				if (IntersectNode(nodes[right], origin, invdir, tmax, tentry))
+					stack[stack_size++] = right;
+				if (IntersectNode(nodes[left], origin, invdir, tmax, tentry))
+					stack[stack_size++] = left;
+			}
+
+			return false;
+		}
+
+		//Visit every primitive whose leaf is pierced by at least one active ray of the packet
+		//Params:
+		//	const RayPacket& packet		the rays being traced
+		//	const __m128& tmax			per lane distance to the closest hit so far, may be shortened by intersectPrim
+		//	LeafFn intersectPrim		callable taking a primitive index, invoked for each candidate primitive
+		//	int root					node of the subtree to traverse
+		template<typename LeafFn>
+		void				TraversePacket(const RayPacket& packet, const __m128& tmax, LeafFn intersectPrim, int root = 0) const
+		{
+			if (m_nodeCount == 0) return;
+
+			const Node* nodes = m_nodeData;
+			int stack[s_maxDepth];
+			int stack_size = 0;
+			float tentry;
+
+			if (!IntersectNodePacket(nodes[root], packet, tmax, tentry)) return;
+			stack[stack_size++] = root;
+
+			while (stack_size > 0)
+			{
+				int node_index = stack[--stack_size];
+				const Node& node = nodes[node_index];
+
+				if (node.count > 0)
+				{
+					for (int i = node.offset; i < node.offset + node.count; i++)
+						intersectPrim(m_primData[i]);
+					continue;
+				}
+
+				//Visit first the child entered first by any of the rays
+				int left = node_index + 1;
+				int right = node.offset;
+				float tleft, tright;
+				bool hitleft = IntersectNodePacket(nodes[left], packet, tmax, tleft);
+				bool hitright = IntersectNodePacket(nodes[right], packet, tmax, tright);
+
+				if (hitleft && hitright)
+				{
+					if (tleft <= tright)
+					{
+						stack[stack_size++] = right;
+						stack[stack_size++] = left;
+					}
+					else
+					{
+						stack[stack_size++] = left;
+						stack[stack_size++] = right;
+					}
+				}
+				else if (hitleft)
+				{
+					stack[stack_size++] = left;
+				}
+				else if (hitright)
+				{
+					stack[stack_size++] = right;
+				}
+			}
+		}
+};
@@ -1,8 +1,12 @@
+#include <math.h>
 #include "Box.h"
+#include "AABB.h"
+#include "RayPacket.h"
 
 
 Box::Box()
 {
+	m_triangles = nullptr;
 	SetBox(Vector3(0.0, 0.0, 0.0), 1, 1, 1);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
@@ -10,32 +14,40 @@ Box::Box()
 
 Box::~Box()
 {
+	delete[] m_triangles;
 }
 
-Box::Box(Vector3 position, double width, double height, double depth)
+Box::Box(Vector3 position, Scalar width, Scalar height, Scalar depth)
 {
+	m_triangles = nullptr;
 	SetBox(position, width, height, depth);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
 
-void Box::SetBox(Vector3 position, double width, double height, double depth)
+void Box::SetBox(Vector3 position, Scalar width, Scalar height, Scalar depth)
 {
 	//Set up an axis aligned box of volume width*height*depth centred at the location given by position
-	double halfwidth = width*0.5;
-	double halfheight = height*0.5;
-	double halfdepth = depth*0.5;
-	
+	Scalar halfwidth = width/2;
+	Scalar halfheight = height/2;
+	Scalar halfdepth = depth/2;
+
+	m_min.SetVector(-halfwidth + position[0], -halfheight + position[1], -halfdepth + position[2]);
+	m_max.SetVector(halfwidth + position[0], halfheight + position[1], halfdepth + position[2]);
+
+	//An axis-aligned box is intersected with the slab test and needs no triangles
+	delete[] m_triangles;
+	m_triangles = nullptr;
+}
+
+void Box::SetBox(const Vector3 corners[8])
+{
 	Vector3 tempVerts[8];
 
-	tempVerts[0].SetVector(-halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
-	tempVerts[1].SetVector(halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
-	tempVerts[2].SetVector(halfwidth + position[0], halfheight + position[1], halfdepth + position[2]);
-	tempVerts[3].SetVector(-halfwidth + position[0], halfheight + position[1], halfdepth + position[2]);
-	
-	tempVerts[4].SetVector(-halfwidth + position[0], -halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[5].SetVector(halfwidth + position[0], -halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[6].SetVector(halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[7].SetVector(-halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
+	for (int i = 0; i < 8; i++)
+		tempVerts[i] = corners[i];
+
+	if (!m_triangles)
+		m_triangles = new Triangle[12];
 
 	m_triangles[0].SetVertices(tempVerts[0], tempVerts[1], tempVerts[2]);
 	
@@ -63,7 +75,107 @@ void Box::SetBox(Vector3 position, double width, double height, double depth)
 	
 }
 
+bool Box::GetCorners(Vector3 corners[8])
+{
+	if (!m_triangles) return false;
+
+	//Every corner is a vertex of the triangles set up by SetBox
+	corners[0] = m_triangles[0].m_vertices[0].m_position;
+	corners[1] = m_triangles[0].m_vertices[1].m_position;
+	corners[2] = m_triangles[0].m_vertices[2].m_position;
+	corners[3] = m_triangles[1].m_vertices[2].m_position;
+	corners[4] = m_triangles[6].m_vertices[0].m_position;
+	corners[5] = m_triangles[7].m_vertices[2].m_position;
+	corners[6] = m_triangles[6].m_vertices[2].m_position;
+	corners[7] = m_triangles[6].m_vertices[1].m_position;
+
+	return true;
+}
+
 RayHitResult Box::IntersectByRay(Ray& ray)
+{
+	if (m_triangles)
+		return IntersectTriangles(ray);
+
+	RayHitResult result = Ray::s_defaultHitResult;
+
+	Scalar t = IntersectAABox(m_min, m_max, ray, &result.normal);
+
+	if (t >= FARFAR_AWAY) return result;
+
+	result.t = t;
+	result.point = ray.GetRayStart() + ray.GetRay()*t;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
+
+	return result;
+}
+
+Scalar Box::IntersectAABox(const Vector3& bmin, const Vector3& bmax, Ray& ray, Vector3* normal)
+{
+	Scalar tnear = -FARFAR_AWAY;
+	Scalar tfar = FARFAR_AWAY;
+	int near_axis = 0;
+	int far_axis = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Scalar start = ray.GetRayStart()[axis];
+		Scalar dir = ray.GetRay()[axis];
+
+		//The ray is parallel to the slab, it misses unless it starts between the two planes
+		if (fabs(dir) < SCALAR_EPSILON)
+		{
+			if (start < bmin[axis] || start > bmax[axis]) return FARFAR_AWAY;
+			continue;
+		}
+
+		Scalar inv_dir = 1 / dir;
+		Scalar t0 = (bmin[axis] - start) * inv_dir;
+		Scalar t1 = (bmax[axis] - start) * inv_dir;
+
+		if (t0 > t1) { Scalar tmp = t0; t0 = t1; t1 = tmp; }
+
+		if (t0 > tnear) { tnear = t0; near_axis = axis; }
+		if (t1 < tfar) { tfar = t1; far_axis = axis; }
+
+		if (tnear > tfar) return FARFAR_AWAY;
+	}
+
+	//Use the entry point, or the exit point if the ray starts inside the box.
+	//The outward face normal comes from the slab that was hit, the entry face
+	//faces against the ray and the exit face along it.
+	Scalar t;
+	int axis;
+	Scalar sign;
+
+	if (tnear > 0)
+	{
+		t = tnear;
+		axis = near_axis;
+		sign = ray.GetRay()[axis] > 0 ? -1 : 1;
+	}
+	else if (tfar > 0)
+	{
+		t = tfar;
+		axis = far_axis;
+		sign = ray.GetRay()[axis] > 0 ? 1 : -1;
+	}
+	else
+	{
+		return FARFAR_AWAY;
+	}
+
+	if (normal)
+	{
+		normal->SetZero();
+		(*normal)[axis] = sign;
+	}
+
+	return t;
+}
+
+RayHitResult Box::IntersectTriangles(Ray& ray)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
 
@@ -79,7 +191,8 @@ RayHitResult Box::IntersectByRay(Ray& ray)
 			Vector3 v02 = m_triangles[i].m_vertices[2].m_position - m_triangles[i].m_vertices[0].m_position;
 
 			tempresult.normal = v01.CrossProduct(v02).Normalise();
-			tempresult.data = this;
+			tempresult.primtype = m_primtype;
+			tempresult.index = GetIndex();
 			result = tempresult;
 		}
 
@@ -87,3 +200,72 @@ RayHitResult Box::IntersectByRay(Ray& ray)
 
 	return result;
 }
+
+__m128 Box::IntersectByPacket(const RayPacket& packet)
+{
+	__m128 farfar = _mm_set1_ps(FARFAR_AWAY);
+
+	if (m_triangles)
+	{
+		//Keep the closest triangle hit in front of each ray
+		__m128 result = farfar;
+
+		for (int i = 0; i < 12; i++)
+		{
+			__m128 t = m_triangles[i].IntersectByPacket(packet);
+			result = PacketSelect(_mm_cmplt_ps(t, result), t, result);
+		}
+
+		return result;
+	}
+
+	return IntersectAABoxPacket(m_min, m_max, packet);
+}
+
+__m128 Box::IntersectAABoxPacket(const Vector3& bmin, const Vector3& bmax, const RayPacket& packet)
+{
+	__m128 farfar = _mm_set1_ps(FARFAR_AWAY);
+
+	//Slab test on every lane. Axis-parallel rays have a huge reciprocal direction,
+	//which sends the slab distances to +/- infinity in the same way as the scalar test
+	const __m128* start[3] = { &packet.ox, &packet.oy, &packet.oz };
+	const __m128* inv_dir[3] = { &packet.invdx, &packet.invdy, &packet.invdz };
+	__m128 tnear = _mm_sub_ps(_mm_setzero_ps(), farfar);
+	__m128 tfar = farfar;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bmin[axis]), *start[axis]), *inv_dir[axis]);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bmax[axis]), *start[axis]), *inv_dir[axis]);
+
+		tnear = _mm_max_ps(tnear, _mm_min_ps(t0, t1));
+		tfar = _mm_min_ps(tfar, _mm_max_ps(t0, t1));
+	}
+
+	//Use the entry point, or the exit point if the ray starts inside the box
+	__m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_cmple_ps(tnear, tfar);
+	__m128 t = PacketSelect(_mm_cmpgt_ps(tnear, zero), tnear, tfar);
+
+	return PacketSelect(_mm_and_ps(hit, _mm_cmpgt_ps(t, zero)), t, farfar);
+}
+
+bool Box::GetBounds(AABB& bounds)
+{
+	if (!m_triangles)
+	{
+		bounds = AABB(m_min, m_max);
+		return true;
+	}
+
+	bounds.SetEmpty();
+
+	for (int i = 0; i < 12; i++)
+	{
+		AABB triangle_bounds;
+		m_triangles[i].GetBounds(triangle_bounds);
+		bounds.Extend(triangle_bounds);
+	}
+
+	return true;
+}
@@ -17,16 +17,58 @@
 class Box : public Primitive
 {
 	private:
-		Triangle m_triangles[12]; //12 triangles forming the 6 faces of the box
+		Vector3 m_min; //minimum corner of an axis-aligned box
+		Vector3 m_max; //maximum corner of an axis-aligned box
+		Triangle* m_triangles; //12 triangles forming the 6 faces of a transformed box, null for an axis-aligned box
+
+		//Intersect the ray with the triangles of a transformed box
+		RayHitResult IntersectTriangles(Ray& ray);
+
+		//Boxes own their triangles and are not copied
+		Box(const Box&);
+		Box& operator=(const Box&);
 
 	public:
 		Box();
-		Box(Vector3 position, double width, double height, double depth);
+		Box(Vector3 position, Scalar width, Scalar height, Scalar depth);
 		~Box();
 
-		void SetBox(Vector3 position, double width, double height, double depth);
+		//Set up an axis-aligned box of volume width*height*depth centred at position
+		void SetBox(Vector3 position, Scalar width, Scalar height, Scalar depth);
+
+		//Set up a transformed box from its eight corners.
+		//corners[0-3] is the face at +z and corners[4-7] the face at -z in the local frame of the box,
+		//each face ordered (-x,-y), (+x,-y), (+x,+y), (-x,+y)
+		void SetBox(const Vector3 corners[8]);
+
+		//Get the eight corners of a transformed box in the order given to SetBox
+		//Returns false for an axis-aligned box, which is given by GetMin and GetMax
+		bool GetCorners(Vector3 corners[8]);
+
+		inline bool IsAxisAligned()
+		{
+			return m_triangles == nullptr;
+		}
+
+		inline Vector3& GetMin()
+		{
+			return m_min;
+		}
+
+		inline Vector3& GetMax()
+		{
+			return m_max;
+		}
 
 		RayHitResult IntersectByRay(Ray& ray);
+		__m128 IntersectByPacket(const RayPacket& packet);
+		bool GetBounds(AABB& bounds);
+
+		//Slab test kernels shared by Box and the SoA storage of PrimitiveStore
+		//IntersectAABox returns the hit distance, or FARFAR_AWAY if the ray misses,
+		//and writes the outward normal of the face that was hit to normal if it is not null
+		static Scalar IntersectAABox(const Vector3& bmin, const Vector3& bmax, Ray& ray, Vector3* normal = nullptr);
+		static __m128 IntersectAABoxPacket(const Vector3& bmin, const Vector3& bmax, const RayPacket& packet);
 
 };
 
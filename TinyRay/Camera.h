@@ -62,5 +62,10 @@ class Camera
 		{
 			return m_focalLength;
 		}
+
+		inline void			SetFocalLength(double focalLength)
+		{
+			m_focalLength = focalLength;
+		}
 };
 
@@ -8,6 +8,7 @@
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
 #include <stdlib.h>
+#include <string.h>
 #include "Framebuffer.h"
 
 Framebuffer::Framebuffer()
@@ -15,6 +16,8 @@ Framebuffer::Framebuffer()
 	mWidth = 0;
 	mHeight = 0;
 	mColourBuffer = NULL;
+	mAccumBuffer = NULL;
+	mLumaSqBuffer = NULL;
 }
 
 Framebuffer::Framebuffer(int width, int height)
@@ -25,6 +28,8 @@ Framebuffer::Framebuffer(int width, int height)
 Framebuffer::~Framebuffer()
 {
 	delete[] mColourBuffer;
+	delete[] mAccumBuffer;
+	delete[] mLumaSqBuffer;
 }
 
 void Framebuffer::WriteRGBToFramebuffer(const Colour & colour, int x, int y)
@@ -34,6 +39,98 @@ void Framebuffer::WriteRGBToFramebuffer(const Colour & colour, int x, int y)
 	*(mColourBuffer + offset) = colour;
 }
 
+void Framebuffer::ClearAccumulation()
+{
+	int size = mWidth*mHeight;
+
+	if (!mAccumBuffer)
+	{
+		mAccumBuffer = new float[size * 4];
+		mLumaSqBuffer = new float[size];
+	}
+
+	memset(mAccumBuffer, 0, size*4*sizeof(float));
+	memset(mLumaSqBuffer, 0, size*sizeof(float));
+}
+
+//Rec. 709 luminance of a colour
+static inline float Luminance(float r, float g, float b)
+{
+	return 0.2126f*r + 0.7152f*g + 0.0722f*b;
+}
+
+void Framebuffer::AccumulateRGB(const Colour & colour, int x, int y)
+{
+	int offset = y*mWidth + x;
+	float* accum = mAccumBuffer + offset * 4;
+
+	accum[0] += (float)colour[0];
+	accum[1] += (float)colour[1];
+	accum[2] += (float)colour[2];
+	accum[3] += 1.0f;
+
+	float luma = Luminance((float)colour[0], (float)colour[1], (float)colour[2]);
+	mLumaSqBuffer[offset] += luma*luma;
+
+	float scale = 1.0f / accum[3];
+	mColourBuffer[offset].SetVector(accum[0] * scale, accum[1] * scale, accum[2] * scale);
+}
+
+float Framebuffer::GetLuminanceVariance(int x, int y) const
+{
+	int offset = y*mWidth + x;
+	const float* accum = mAccumBuffer + offset * 4;
+	float count = accum[3];
+
+	if (count < 2.0f)
+		return 0.0f;
+
+	float mean = Luminance(accum[0], accum[1], accum[2]) / count;
+	float variance = mLumaSqBuffer[offset] / count - mean*mean;
+
+	//The sums are in float, so the difference can come out slightly negative
+	return variance > 0.0f ? variance : 0.0f;
+}
+
+void Framebuffer::WriteSampleHeatmap(Colour *heatmap, int maxSamples) const
+{
+	for (int y = 0; y < mHeight; y++)
+	{
+		for (int x = 0; x < mWidth; x++)
+		{
+			int samples = GetSampleCount(x, y);
+			Colour& colour = heatmap[y*mWidth + x];
+
+			if (samples == 0)
+			{
+				colour.SetVector(0.0f, 0.0f, 0.0f);
+				continue;
+			}
+
+			//Position on the ramp from 0 (one sample) to 1 (maxSamples)
+			float v = maxSamples > 1 ? (float)(samples - 1) / (float)(maxSamples - 1) : 1.0f;
+			if (v > 1.0f) v = 1.0f;
+
+			if (v < 1.0f / 3.0f)
+				colour.SetVector(0.0f, v * 3.0f, 1.0f - v * 3.0f);
+			else if (v < 2.0f / 3.0f)
+				colour.SetVector(v * 3.0f - 1.0f, 1.0f, 0.0f);
+			else
+				colour.SetVector(1.0f, 3.0f - v * 3.0f, 0.0f);
+		}
+	}
+}
+
+void Framebuffer::FillRGB(const Colour & colour, int x0, int y0, int x1, int y1)
+{
+	if (x1 > mWidth) x1 = mWidth;
+	if (y1 > mHeight) y1 = mHeight;
+
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++)
+			mColourBuffer[y*mWidth + x] = colour;
+}
+
 void Framebuffer::InitFramebuffer(int width, int height)
 {
 	int size = width*height;
@@ -41,6 +138,8 @@ void Framebuffer::InitFramebuffer(int width, int height)
 	mHeight = height;
 
 	mColourBuffer = new Colour[size];
+	mAccumBuffer = NULL;
+	mLumaSqBuffer = NULL;
 
 	//memset(mColourBuffer, 0, size*sizeof(PixelRGBA));
 }
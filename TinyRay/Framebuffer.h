@@ -19,6 +19,8 @@ private:
 	int	mWidth;					//the width of framebuffer
 	int mHeight;				//the height of framebuffer
 	Colour *mColourBuffer;	//Storage for RGBA pixels as a linear array
+	float *mAccumBuffer;	//Running sum of the samples of every pixel, RGB and the number of samples, allocated on first use
+	float *mLumaSqBuffer;	//Running sum of the squared luminance of the samples of every pixel, allocated with mAccumBuffer
 
 	//Method for initialise the framebuffer
 	//input:	int width --- width of the buffer to be created
@@ -40,5 +42,29 @@ public:
 	}
 
 	void WriteRGBToFramebuffer(const Colour &colour, int x, int y);
+
+	//Reset the accumulation buffer, every pixel goes back to having no samples
+	void ClearAccumulation();
+
+	//Add a sample to the accumulation buffer and write the average of the samples of the pixel to the colour buffer
+	void AccumulateRGB(const Colour &colour, int x, int y);
+
+	//Returns the number of samples accumulated in a pixel since the last ClearAccumulation
+	inline int GetSampleCount(int x, int y) const
+	{
+		return mAccumBuffer ? (int)mAccumBuffer[(y*mWidth + x) * 4 + 3] : 0;
+	}
+
+	//Returns the variance of the luminance of the samples accumulated in a pixel, 0 with fewer than two samples
+	float GetLuminanceVariance(int x, int y) const;
+
+	//Write the number of samples of every pixel as a colour ramp from blue (one sample) through green
+	//and yellow to red (maxSamples or more), pixels without samples are black
+	//Params:	Colour* heatmap --- receives mWidth*mHeight colours in the layout of the colour buffer
+	void WriteSampleHeatmap(Colour *heatmap, int maxSamples) const;
+
+	//Write a colour to the pixels of the rectangle [x0, x1) x [y0, y1) that lie inside the framebuffer
+	//Used to show a coarse preview, the accumulation buffer is left untouched
+	void FillRGB(const Colour &colour, int x0, int y0, int x1, int y1);
 };
 
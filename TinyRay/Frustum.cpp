@@ -0,0 +1,75 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 4; i++)
+	{
+		m_normals[i][0] = m_normals[i][1] = m_normals[i][2] = 0.0f;
+		m_offsets[i] = 0.0f;
+	}
+}
+
+Frustum::~Frustum()
+{
+}
+
+void Frustum::Set(const Vector3& apex, const Vector3 corners[4])
+{
+	Vector3 centre = (corners[0] + corners[1] + corners[2] + corners[3]) * (Scalar)0.25 - apex;
+
+	for (int i = 0; i < 4; i++)
+	{
+		Vector3 normal = (corners[i] - apex).CrossProduct(corners[(i + 1) % 4] - apex);
+
+		//Point the normal towards the inside whichever way the corners go around the section
+		if (normal.DotProduct(centre) < 0)
+			normal = normal * (Scalar)-1;
+
+		normal.Normalise();
+
+		for (int a = 0; a < 3; a++)
+			m_normals[i][a] = (float)normal[a];
+
+		//Move the plane out a little so that single precision rounding never culls a box touching it
+		Scalar scale = fabs(apex[0]) + fabs(apex[1]) + fabs(apex[2]) + 1;
+		m_offsets[i] = (float)(normal.DotProduct(apex) - scale * 1e-4f);
+	}
+}
+
+Frustum::Overlap Frustum::TestBox(const float bmin[3], const float bmax[3]) const
+{
+	Overlap overlap = OVERLAP_INSIDE;
+
+	for (int i = 0; i < 4; i++)
+	{
+		const float* n = m_normals[i];
+
+		//The corners of the box furthest along and furthest against the normal
+		float furthest = 0.0f;
+		float nearest = 0.0f;
+
+		for (int a = 0; a < 3; a++)
+		{
+			furthest += n[a] * (n[a] >= 0.0f ? bmax[a] : bmin[a]);
+			nearest += n[a] * (n[a] >= 0.0f ? bmin[a] : bmax[a]);
+		}
+
+		if (furthest < m_offsets[i])
+			return OVERLAP_OUTSIDE;
+
+		if (nearest < m_offsets[i])
+			overlap = OVERLAP_PARTIAL;
+	}
+
+	return overlap;
+}
@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Vector3.h"
+
+//A pyramid with its apex at the eye, bounded by the four planes through the apex and the edges of its cross section.
+//Used to cull the objects that cannot be hit by the primary rays through part of the view plane.
+class Frustum
+{
+	public:
+		//Overlap of a box with the frustum
+		enum Overlap
+		{
+			OVERLAP_OUTSIDE = 0,	//no point of the box is inside the frustum
+			OVERLAP_PARTIAL,		//the box may be partly inside
+			OVERLAP_INSIDE			//the whole box is inside
+		};
+
+	private:
+		float			m_normals[4][3];	//inward facing normal of each side plane
+		float			m_offsets[4];		//a point p is inside side i if dot(m_normals[i], p) >= m_offsets[i]
+
+	public:
+		Frustum();
+		~Frustum();
+
+		//Set up the frustum from its apex and the corners of its cross section, in order around the section
+		void			Set(const Vector3& apex, const Vector3 corners[4]);
+
+		//Classify an axis-aligned box against the frustum
+		//The test is conservative, a box near an edge of the frustum may be reported as partially inside
+		Overlap			TestBox(const float bmin[3], const float bmax[3]) const;
+};
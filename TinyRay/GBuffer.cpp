@@ -0,0 +1,35 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <algorithm>
+#include "GBuffer.h"
+
+GBuffer::GBuffer()
+{
+	m_width = 0;
+	m_height = 0;
+}
+
+GBuffer::~GBuffer()
+{
+}
+
+void GBuffer::Resize(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_samples.resize(width * height);
+}
+
+void GBuffer::Swap(GBuffer& other)
+{
+	std::swap(m_width, other.m_width);
+	std::swap(m_height, other.m_height);
+	m_samples.swap(other.m_samples);
+}
@@ -0,0 +1,61 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include "Ray.h"
+
+//Per pixel record of the primary hits of the last frame, kept next to the framebuffer.
+//The ray tracer uses it to shade a frame again without intersecting the primary rays
+//when only the trace flags or the lights change, and to reproject a frame after a camera move.
+class GBuffer
+{
+	public:
+		struct Sample
+		{
+			RayHitResult	hit;		//closest hit of the primary ray through the pixel centre, primtype is PRIMTYPE_NONE on a miss
+			bool			reusable;	//the shading of the hit does not depend on the viewpoint
+		};
+
+	private:
+		int					m_width;
+		int					m_height;
+		std::vector<Sample>	m_samples;	//width*height samples, bottom up like the framebuffer
+
+	public:
+		GBuffer();
+		~GBuffer();
+
+		//Resize to width*height samples, the contents are undefined afterwards
+		void				Resize(int width, int height);
+
+		//Exchange the samples of two G-buffers
+		void				Swap(GBuffer& other);
+
+		inline int			GetWidth() const
+		{
+			return m_width;
+		}
+
+		inline int			GetHeight() const
+		{
+			return m_height;
+		}
+
+		inline Sample&		GetSample(int x, int y)
+		{
+			return m_samples[y * m_width + x];
+		}
+
+		inline Sample&		GetSample(int pixel)
+		{
+			return m_samples[pixel];
+		}
+};
@@ -32,7 +32,7 @@ EImageIOStatus ImageIO::LoadUncompressedTGA(unsigned char** buffer, int* sizeX,
 		return E_IMAGEIO_ERROR;
 	}
 
-	if(fread(*buffer, 1, dataSize, pf) != dataSize)
+	if(fread(*buffer, 1, dataSize, pf) != (size_t)dataSize)
 	{
 		delete [] (*buffer);
 		*buffer = NULL;
@@ -41,9 +41,55 @@ EImageIOStatus ImageIO::LoadUncompressedTGA(unsigned char** buffer, int* sizeX,
 	
 	for(int cswap = 0; cswap < dataSize; cswap += (*nChannels))
 	{
-		(*buffer)[cswap] ^= (*buffer)[cswap+2]^=(*buffer)[cswap] ^= (*buffer)[cswap+2];
+		unsigned char blue = (*buffer)[cswap];
+		(*buffer)[cswap] = (*buffer)[cswap+2];
+		(*buffer)[cswap+2] = blue;
 	}
 
+	//Rows are stored from the bottom unless bit 5 of the image descriptor is set, return them from the top
+	if(!(header[5] & 0x20))
+	{
+		int rowSize = (*sizeX)*(*nChannels);
+		unsigned char* row = new unsigned char[rowSize];
+
+		for(int y = 0; y < (*sizeY)/2; y++)
+		{
+			unsigned char* top = *buffer + y*rowSize;
+			unsigned char* bottom = *buffer + ((*sizeY) - 1 - y)*rowSize;
+			memcpy(row, top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row, rowSize);
+		}
+
+		delete [] row;
+	}
+
+	return E_IMAGEIO_SUCCESS;
+}
+
+EImageIOStatus ImageIO::ParseTGA(const unsigned char* data, size_t size, const unsigned char** pixels, int* sizeX, int* sizeY, int* nChannels, bool* topFirst)
+{
+	unsigned char UncompressedTGASigniture[12] = {0,0,2,0,0,0,0,0,0,0,0,0};
+
+	//12 bytes of signature and 6 of image specification
+	if(size < 18 || memcmp(UncompressedTGASigniture, data, sizeof(UncompressedTGASigniture)) != 0)
+	{
+		return E_IMAGEIO_ERROR;
+	}
+
+	const unsigned char* header = data + 12;
+	*sizeX = ((int)header[1]<<8) | header[0];
+	*sizeY = ((int)header[3]<<8) | header[2];
+	*nChannels = header[4]>>3;
+	*topFirst = (header[5] & 0x20) != 0;
+
+	if( (*sizeX <= 0) || (*sizeY <= 0) || ((header[4] != 24) && (header[4] != 32)) || (size - 18)/((size_t)(*sizeX)*(*nChannels)) < (size_t)(*sizeY))
+	{
+		return E_IMAGEIO_ERROR;
+	}
+
+	*pixels = data + 18;
+
 	return E_IMAGEIO_SUCCESS;
 }
 
@@ -51,14 +97,19 @@ EImageIOStatus ImageIO::LoadTGA(const char* filename, unsigned char** buffer, in
 {
 	FILE* pfile = NULL;
 	EImageIOStatus result = E_IMAGEIO_SUCCESS;
-	errno_t err = 0;
+	int err = 0;
 	unsigned char header[12];
 	unsigned char UncompressedTGASigniture[12] = {0,0,2,0,0,0,0,0,0,0,0,0}; 
 	unsigned char CompressedTGASigniture[12] = {0,0,10,0,0,0,0,0,0,0,0,0}; 
 
 	*buffer = NULL;
 
+#if defined(_MSC_VER)
 	err = fopen_s(&pfile, filename, "rb");
+#else
+	pfile = fopen(filename, "rb");
+	err = pfile ? 0 : 1;
+#endif
 
 	if (err)
 	{
@@ -81,9 +132,10 @@ EImageIOStatus ImageIO::LoadTGA(const char* filename, unsigned char** buffer, in
 		//TODO: load uncompressed tga
 		result = LoadUncompressedTGA(buffer, sizeX, sizeY, bpp, nChannels, pfile);
 	}
-	else if(memcmp(UncompressedTGASigniture, header, sizeof(header))==0)
+	else if(memcmp(CompressedTGASigniture, header, sizeof(header))==0)
 	{
 		//TODO: load compressed tga
+		result = E_IMAGEIO_ERROR;
 	}
 	else
 	{
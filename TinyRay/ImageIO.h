@@ -15,7 +15,13 @@ class ImageIO
 	private:
 		static EImageIOStatus LoadUncompressedTGA(unsigned char** buffer, int* sizeX, int* sizeY, int* bpp, int* nChannels, FILE* pf); 
 	public:
+		//Load an uncompressed 24 or 32-bit TGA image, buffer receives the RGB(A) rows from the top of the image
+		//and is freed by the caller with delete[]
 		static EImageIOStatus LoadTGA(const char* filename, unsigned char** buffer, int* sizeX, int* sizeY, int* bpp, int* nChannels);
+
+		//Find the pixels of an uncompressed 24 or 32-bit TGA image in the bytes of the whole file, e.g. a memory mapping,
+		//without copying them. pixels receives the BGR(A) rows, stored from the top if topFirst is set and from the bottom otherwise
+		static EImageIOStatus ParseTGA(const unsigned char* data, size_t size, const unsigned char** pixels, int* sizeX, int* sizeY, int* nChannels, bool* topFirst);
 };
 
 #endif
@@ -0,0 +1,137 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include "Instance.h"
+#include "Mesh.h"
+#include "AABB.h"
+#include "RayPacket.h"
+
+Instance::Instance(Primitive* object, const Transform& toWorld)
+{
+	m_object = object;
+	m_primtype = PRIMTYPE_Instance;
+	SetMaterial(object->GetMaterial());
+	SetTransform(toWorld);
+}
+
+Instance::~Instance()
+{
+}
+
+void Instance::SetTransform(const Transform& toWorld)
+{
+	m_toWorld = toWorld;
+	m_toObject = toWorld.Inverse();
+}
+
+Scalar Instance::ToObjectSpace(Ray& ray, Ray& objectRay) const
+{
+	Vector3 direction = m_toObject.TransformVector(ray.GetRay());
+	Scalar length = direction.Norm();
+
+	objectRay.SetRay(m_toObject.TransformPoint(ray.GetRayStart()), direction * (1 / length));
+
+	return 1 / length;
+}
+
+Scalar Instance::Intersect(Ray& ray)
+{
+	Ray object_ray;
+	Scalar scale = ToObjectSpace(ray, object_ray);
+
+	//Meshes can skip computing the point and normal of the hit
+	Scalar t = m_object->m_primtype == PRIMTYPE_Mesh ?
+		static_cast<Mesh*>(m_object)->Intersect(object_ray) : m_object->IntersectByRay(object_ray).t;
+
+	return t > 0 && t < FARFAR_AWAY ? t * scale : FARFAR_AWAY;
+}
+
+RayHitResult Instance::IntersectByRay(Ray& ray)
+{
+	Ray object_ray;
+	Scalar scale = ToObjectSpace(ray, object_ray);
+
+	RayHitResult result = m_object->IntersectByRay(object_ray);
+
+	if (result.primtype == PRIMTYPE_NONE || !(result.t > 0 && result.t < FARFAR_AWAY))
+		return Ray::s_defaultHitResult;
+
+	result.t *= scale;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
+
+	//The point is taken along the world space ray so that it lies exactly where the scene expects it
+	result.point = ray.GetRayStart() + ray.GetRay() * result.t;
+	result.normal = m_toObject.TransformNormal(result.normal);
+	result.normal.Normalise();
+
+	return result;
+}
+
+__m128 Instance::IntersectByPacket(const RayPacket& packet)
+{
+	const Transform& m = m_toObject;
+	RayPacket object_packet;
+
+	//Transform the origins and directions of all lanes into object space
+	__m128 o[3], d[3];
+	for (int row = 0; row < 3; row++)
+	{
+		__m128 r0 = _mm_set1_ps((float)m.Get(row, 0));
+		__m128 r1 = _mm_set1_ps((float)m.Get(row, 1));
+		__m128 r2 = _mm_set1_ps((float)m.Get(row, 2));
+
+		o[row] = _mm_add_ps(PacketDot(r0, r1, r2, packet.ox, packet.oy, packet.oz), _mm_set1_ps((float)m.Get(row, 3)));
+		d[row] = PacketDot(r0, r1, r2, packet.dx, packet.dy, packet.dz);
+	}
+
+	__m128 length = _mm_sqrt_ps(PacketDot(d[0], d[1], d[2], d[0], d[1], d[2]));
+	__m128 inv_length = _mm_div_ps(_mm_set1_ps(1.0f), length);
+
+	object_packet.ox = o[0];
+	object_packet.oy = o[1];
+	object_packet.oz = o[2];
+	object_packet.dx = _mm_mul_ps(d[0], inv_length);
+	object_packet.dy = _mm_mul_ps(d[1], inv_length);
+	object_packet.dz = _mm_mul_ps(d[2], inv_length);
+	object_packet.active = packet.active;
+
+	//Reciprocal directions, avoiding a division by zero for axis-parallel rays as RayPacket::SetRays does
+	__m128 tiny = _mm_set1_ps(1e-20f);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128* dirs[3] = { &object_packet.dx, &object_packet.dy, &object_packet.dz };
+	__m128* invdirs[3] = { &object_packet.invdx, &object_packet.invdy, &object_packet.invdz };
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 dir = *dirs[axis];
+		__m128 small = _mm_cmplt_ps(_mm_andnot_ps(sign, dir), tiny);
+		dir = PacketSelect(small, _mm_or_ps(tiny, _mm_and_ps(sign, dir)), dir);
+		*invdirs[axis] = _mm_div_ps(_mm_set1_ps(1.0f), dir);
+	}
+
+	__m128 t = m_object->IntersectByPacket(object_packet);
+
+	//Lanes that miss keep their distance, which is not positive, NaN or FARFAR_AWAY
+	__m128 hit = _mm_and_ps(_mm_cmpgt_ps(t, _mm_setzero_ps()), _mm_cmplt_ps(t, _mm_set1_ps(FARFAR_AWAY)));
+
+	return PacketSelect(hit, _mm_mul_ps(t, inv_length), _mm_set1_ps(FARFAR_AWAY));
+}
+
+bool Instance::GetBounds(AABB& bounds)
+{
+	AABB object_bounds;
+
+	if (!m_object->GetBounds(object_bounds)) return false;
+
+	bounds = m_toWorld.TransformBounds(object_bounds);
+
+	return true;
+}
@@ -0,0 +1,54 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+#include "Primitive.h"
+#include "Transform.h"
+#include "Ray.h"
+
+//A placement of shared geometry in the scene.
+//The instance refers to an object defined in its own object space, typically a Mesh, and places it with an
+//affine transform. Rays are transformed into object space to be intersected, so any number of instances
+//share one copy of the geometry and of its BVH. Instances are leaves of the scene BVH, which makes the
+//scene BVH the top level and the BVH of each mesh the bottom level of a two-level hierarchy.
+class Instance : public Primitive
+{
+	private:
+		Primitive*			m_object;		//the shared geometry, not owned by the instance
+		Transform			m_toWorld;		//object space to world space
+		Transform			m_toObject;		//world space to object space
+
+		//Transform a world space ray into object space, the object space direction is normalised again
+		//Returns the factor that turns object space distances along the ray into world space distances
+		Scalar				ToObjectSpace(Ray& ray, Ray& objectRay) const;
+
+	public:
+		//The instance takes the material of the object, SetMaterial gives it one of its own
+		Instance(Primitive* object, const Transform& toWorld);
+		~Instance();
+
+		void				SetTransform(const Transform& toWorld);
+
+		inline Primitive*	GetGeometry()
+		{
+			return m_object;
+		}
+
+		inline const Transform& GetTransform() const
+		{
+			return m_toWorld;
+		}
+
+		//Returns the world space distance to the closest hit of the ray, or FARFAR_AWAY if the ray misses
+		Scalar				Intersect(Ray& ray);
+
+		RayHitResult		IntersectByRay(Ray& ray);
+		__m128				IntersectByPacket(const RayPacket& packet);
+		bool				GetBounds(AABB& bounds);
+};
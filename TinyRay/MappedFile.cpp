@@ -0,0 +1,88 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#if defined(WIN32) || defined(_WINDOWS)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+#if defined(WIN32) || defined(_WINDOWS)
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#else
+	m_file = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+#if defined(WIN32) || defined(_WINDOWS)
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) return false;
+	m_size = (size_t)size.QuadPart;
+	if (m_size == 0) return true;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping) return false;
+
+	m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	return m_data != nullptr;
+#else
+	m_file = open(filename, O_RDONLY);
+	if (m_file < 0) return false;
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0) return false;
+	m_size = (size_t)info.st_size;
+	if (m_size == 0) return true;
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED) return false;
+
+	m_data = (const char*)data;
+	return true;
+#endif
+}
+
+void MappedFile::Close()
+{
+#if defined(WIN32) || defined(_WINDOWS)
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#else
+	if (m_data) munmap((void*)m_data, m_size);
+	if (m_file >= 0) close(m_file);
+	m_file = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
@@ -0,0 +1,49 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+#include <stddef.h>
+
+//A read-only memory mapping of a whole file
+//Pages of the file are read on demand as the data is touched, and may be shared between processes mapping the same file.
+class MappedFile
+{
+	private:
+		const char*		m_data;
+		size_t			m_size;
+#if defined(WIN32) || defined(_WINDOWS)
+		void*			m_file;			//HANDLE of the file
+		void*			m_mapping;		//HANDLE of the mapping
+#else
+		int				m_file;
+#endif
+
+		//Mappings are not copied
+		MappedFile(const MappedFile&);
+		MappedFile&		operator=(const MappedFile&);
+
+	public:
+		MappedFile();
+		~MappedFile();
+
+		//Map the file, an empty file maps to no data
+		bool			Open(const char* filename);
+
+		void			Close();
+
+		inline const char* GetData() const
+		{
+			return m_data;
+		}
+
+		inline size_t	GetSize() const
+		{
+			return m_size;
+		}
+};
@@ -9,7 +9,6 @@
 ---------------------------------------------------------------------*/
 #include <stdlib.h>
 #include "Material.h"
-#include "ImageIO.h"
 
 Material::Material()
 {
@@ -19,7 +18,6 @@ Material::Material()
 
 Material::~Material()
 {
-	if (mDiffuse_texture) delete mDiffuse_texture;
 }
 
 void Material::SetDefaultMaterial()
@@ -12,53 +12,7 @@
 #include <stdlib.h>
 
 #include "Vector3.h"
-
-typedef Vector3 Colour;
-
-//class representing a texture in TinyRay
-class Texture
-{
-public:
-	enum TEXUNIT
-	{
-		TEXUNIT_DIFFUSE = 0,
-		TEXUNIT_NORMAL = 1
-	};
-public:
-	unsigned int	mWidth;			//width of the image
-	unsigned int    mHeight;		//height of the image
-	unsigned int    mChannels;		//number of channels in the image either 3 or 4, i.e. RGB or RGBA
-	unsigned char*	mImage;			//image data
-
-	Texture()
-	{
-		mImage = NULL;
-	}
-
-	~Texture()
-	{
-		if (mImage) delete[] mImage;
-	}
-
-	Colour GetTexelColour(double u, double v)
-	{
-		Colour colour;
-
-		int dx = (int)(u*mWidth);
-		int dy = (int)(v*mHeight);
-		int texel_stride = mChannels;
-		int row_stride = mWidth;
-		int texel_loc = (dx*texel_stride) + dy*row_stride*texel_stride;
-
-		unsigned char* comp = mImage + texel_loc;
-
-		colour[0] = *(comp) / 255.0f;
-		colour[1] = *(comp + 1) / 255.0f;
-		colour[2] = *(comp + 2) / 255.0f;
-
-		return colour;
-	}
-};
+#include "Texture.h"
 
 //Class representing a material in TinyRay
 class Material
@@ -68,7 +22,7 @@ class Material
 		Colour mDiffuse;					//Diffuse colour of the material
 		Colour mSpecular;					//Specular colour of the material
 		double mSpecpower;					//Specular power of the material
-		Texture* mDiffuse_texture;			//Colour (diffuse) texture of the material for texture mapped primitives
+		Texture* mDiffuse_texture;			//Colour (diffuse) texture of the material for texture mapped primitives, not owned by the material
 		Texture* mNormal_texture;			//Normal texture of the material for textured mapped privmites with a normal map
 		bool mCastShadow;					//boolean indicating if a material can cast shadow
 
@@ -118,6 +72,17 @@ class Material
 			return mDiffuse_texture != NULL;
 		}
 
+		//The texture is shared, it is owned by whoever created it, e.g. the arena of the scene
+		inline void SetDiffuseTexture(Texture* texture)
+		{
+			mDiffuse_texture = texture;
+		}
+
+		inline Texture* GetDiffuseTexture()
+		{
+			return mDiffuse_texture;
+		}
+
 		inline bool HasNormalTexture()
 		{
 			return mNormal_texture != NULL;
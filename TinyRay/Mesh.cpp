@@ -0,0 +1,224 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "Mesh.h"
+#include "Triangle.h"
+#include "AABB.h"
+#include "RayPacket.h"
+
+//Copy the array into one without spare capacity, arrays that are already full are left alone
+template<typename T>
+static void ShrinkToFit(std::vector<T>& array)
+{
+	if (array.capacity() > array.size())
+		std::vector<T>(array).swap(array);
+}
+
+Mesh::Mesh()
+{
+	m_primtype = PRIMTYPE_Mesh;
+	m_positionData = nullptr;
+	m_normalData = nullptr;
+	m_texcoordData = nullptr;
+	m_indexData = nullptr;
+	m_edgeData = nullptr;
+	m_vertexCount = 0;
+	m_triangleCount = 0;
+}
+
+Mesh::~Mesh()
+{
+}
+
+void Mesh::SetVertices(std::vector<Scalar>& positions, std::vector<Scalar>& normals, std::vector<Scalar>& texcoords)
+{
+	m_positions.swap(positions);
+	m_normals.swap(normals);
+	m_texcoords.swap(texcoords);
+
+	positions.clear();
+	normals.clear();
+	texcoords.clear();
+}
+
+void Mesh::SetTriangles(std::vector<unsigned int>& indices)
+{
+	m_indices.swap(indices);
+	indices.clear();
+}
+
+void Mesh::Build()
+{
+	int triangle_count = (int)m_indices.size() / 3;
+	std::vector<AABB> bounds(triangle_count);
+
+	//Release the spare capacity left by whoever filled the arrays
+	ShrinkToFit(m_positions);
+	ShrinkToFit(m_normals);
+	ShrinkToFit(m_texcoords);
+	ShrinkToFit(m_indices);
+
+	m_edges.resize(triangle_count * 6);
+
+	m_positionData = m_positions.empty() ? nullptr : &m_positions[0];
+	m_normalData = m_normals.empty() ? nullptr : &m_normals[0];
+	m_texcoordData = m_texcoords.empty() ? nullptr : &m_texcoords[0];
+	m_indexData = m_indices.empty() ? nullptr : &m_indices[0];
+	m_edgeData = m_edges.empty() ? nullptr : &m_edges[0];
+	m_vertexCount = (int)m_positions.size() / 3;
+	m_triangleCount = triangle_count;
+
+	for (int i = 0; i < triangle_count; i++)
+	{
+		Vector3 v0 = GetPosition(m_indices[i * 3]);
+		Vector3 v1 = GetPosition(m_indices[i * 3 + 1]);
+		Vector3 v2 = GetPosition(m_indices[i * 3 + 2]);
+		Vector3 e1 = v1 - v0;
+		Vector3 e2 = v2 - v0;
+
+		for (int k = 0; k < 3; k++)
+		{
+			m_edges[i * 6 + k] = e1[k];
+			m_edges[i * 6 + 3 + k] = e2[k];
+		}
+
+		bounds[i].SetEmpty();
+		bounds[i].Extend(v0);
+		bounds[i].Extend(v1);
+		bounds[i].Extend(v2);
+	}
+
+	m_bvh.Build(bounds);
+}
+
+void Mesh::SetExternal(int vertexCount, const Scalar* positions, const Scalar* normals, const Scalar* texcoords,
+	int triangleCount, const unsigned int* indices, const Scalar* edges,
+	const BVH::Node* nodes, int nodeCount, const int* primIndices)
+{
+	//Free any arrays of an earlier build
+	std::vector<Scalar>().swap(m_positions);
+	std::vector<Scalar>().swap(m_normals);
+	std::vector<Scalar>().swap(m_texcoords);
+	std::vector<unsigned int>().swap(m_indices);
+	std::vector<Scalar>().swap(m_edges);
+
+	m_positionData = positions;
+	m_normalData = normals;
+	m_texcoordData = texcoords;
+	m_indexData = indices;
+	m_edgeData = edges;
+	m_vertexCount = vertexCount;
+	m_triangleCount = triangleCount;
+
+	m_bvh.SetExternal(nodes, nodeCount, primIndices, triangleCount);
+}
+
+size_t Mesh::GetMemoryUsage() const
+{
+	return m_positions.capacity() * sizeof(Scalar)
+		+ m_normals.capacity() * sizeof(Scalar)
+		+ m_texcoords.capacity() * sizeof(Scalar)
+		+ m_indices.capacity() * sizeof(unsigned int)
+		+ m_edges.capacity() * sizeof(Scalar)
+		+ m_bvh.GetMemoryUsage();
+}
+
+inline Scalar Mesh::IntersectTriangle(int triangle, Ray& ray) const
+{
+	const Scalar* edges = &m_edgeData[triangle * 6];
+
+	return Triangle::IntersectTriangle(GetPosition(m_indexData[triangle * 3]),
+		Vector3(edges[0], edges[1], edges[2]), Vector3(edges[3], edges[4], edges[5]), ray);
+}
+
+Scalar Mesh::Intersect(Ray& ray, int* triangle) const
+{
+	Scalar tmin = FARFAR_AWAY;
+	int closest = -1;
+
+	m_bvh.Traverse(ray, tmin, [&](int i)
+	{
+		Scalar t = IntersectTriangle(i, ray);
+		if (t < tmin)
+		{
+			tmin = t;
+			closest = i;
+		}
+	});
+
+	if (triangle) *triangle = closest;
+
+	return tmin;
+}
+
+void Mesh::CompleteHit(int triangle, Ray& ray, RayHitResult& result) const
+{
+	Vector3 positions[3], normals[3];
+
+	for (int v = 0; v < 3; v++)
+		positions[v] = GetPosition(m_indexData[triangle * 3 + v]);
+
+	if (!m_normalData)
+	{
+		//Without vertex normals every vertex takes the normal of the face
+		Vector3 face_normal = (positions[1] - positions[0]).CrossProduct(positions[2] - positions[0]);
+		normals[0] = normals[1] = normals[2] = face_normal;
+	}
+	else
+	{
+		for (int v = 0; v < 3; v++)
+		{
+			const Scalar* normal = &m_normalData[m_indexData[triangle * 3 + v] * 3];
+			normals[v] = Vector3(normal[0], normal[1], normal[2]);
+		}
+	}
+
+	Triangle::CompleteTriangleHit(positions, normals, ray, result);
+}
+
+RayHitResult Mesh::IntersectByRay(Ray& ray)
+{
+	RayHitResult result = Ray::s_defaultHitResult;
+	int triangle;
+
+	Scalar t = Intersect(ray, &triangle);
+
+	if (t >= FARFAR_AWAY) return result;
+
+	result.t = t;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
+
+	CompleteHit(triangle, ray, result);
+
+	return result;
+}
+
+__m128 Mesh::IntersectByPacket(const RayPacket& packet)
+{
+	__m128 tmin = _mm_set1_ps(FARFAR_AWAY);
+
+	m_bvh.TraversePacket(packet, tmin, [&](int i)
+	{
+		const Scalar* edges = &m_edgeData[i * 6];
+		__m128 t = Triangle::IntersectTrianglePacket(GetPosition(m_indexData[i * 3]),
+			Vector3(edges[0], edges[1], edges[2]), Vector3(edges[3], edges[4], edges[5]), packet);
+
+		tmin = PacketSelect(packet.active, _mm_min_ps(t, tmin), tmin);
+	});
+
+	return tmin;
+}
+
+bool Mesh::GetBounds(AABB& bounds)
+{
+	bounds = m_bvh.GetBounds();
+
+	return !m_bvh.IsEmpty();
+}
@@ -0,0 +1,122 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+#include "Primitive.h"
+#include "Vector3.h"
+#include "Ray.h"
+#include "BVH.h"
+#include <vector>
+
+//A triangle mesh whose triangles share their vertices.
+//Vertex attributes are kept in flat Scalar arrays and every triangle is three 32-bit indices into them,
+//together with its two edges precomputed for the Moller-Trumbore test. The mesh has its own BVH over its
+//triangles, so the scene holds a single object for the whole mesh.
+//The arrays in use are either owned by the mesh or, after SetExternal, live elsewhere (e.g. in a mapped scene cache).
+class Mesh : public Primitive
+{
+	private:
+		std::vector<Scalar>			m_positions;		//3 values per vertex
+		std::vector<Scalar>			m_normals;			//3 values per vertex, empty if the mesh uses face normals
+		std::vector<Scalar>			m_texcoords;		//2 values per vertex, may be empty
+		std::vector<unsigned int>	m_indices;			//3 vertex indices per triangle
+		std::vector<Scalar>			m_edges;			//6 values per triangle, the edges from the first vertex to the other two
+		BVH							m_bvh;				//acceleration structure over the triangles
+
+		//The arrays in use, pointing into the vectors above or into external storage
+		const Scalar*				m_positionData;
+		const Scalar*				m_normalData;		//null if the mesh uses face normals
+		const Scalar*				m_texcoordData;		//null if the mesh has no texcoords
+		const unsigned int*			m_indexData;
+		const Scalar*				m_edgeData;
+		int							m_vertexCount;
+		int							m_triangleCount;
+
+		inline Vector3				GetPosition(unsigned int vertex) const
+		{
+			return Vector3(m_positionData[vertex * 3], m_positionData[vertex * 3 + 1], m_positionData[vertex * 3 + 2]);
+		}
+
+		inline Scalar				IntersectTriangle(int triangle, Ray& ray) const;
+
+	public:
+		Mesh();
+		~Mesh();
+
+		//Set the vertex attributes of the mesh, normals and texcoords may be empty
+		//The contents of the arrays are swapped into the mesh, leaving the arrays given empty
+		void						SetVertices(std::vector<Scalar>& positions, std::vector<Scalar>& normals, std::vector<Scalar>& texcoords);
+
+		//Set the vertex indices of the triangles, 3 per triangle, swapped in as for SetVertices
+		void						SetTriangles(std::vector<unsigned int>& indices);
+
+		//Precompute the triangle edges and build the BVH of the mesh
+		//This must be called after the vertices or triangles change and before the mesh is traced
+		void						Build();
+
+		//Use arrays laid out as those of a built mesh, together with its BVH, without copying them
+		//normals and texcoords may be null, the arrays must outlive the mesh or the next call to Build
+		void						SetExternal(int vertexCount, const Scalar* positions, const Scalar* normals, const Scalar* texcoords,
+										int triangleCount, const unsigned int* indices, const Scalar* edges,
+										const BVH::Node* nodes, int nodeCount, const int* primIndices);
+
+		inline int					GetVertexCount() const
+		{
+			return m_vertexCount;
+		}
+
+		inline int					GetTriangleCount() const
+		{
+			return m_triangleCount;
+		}
+
+		inline const Scalar*		GetPositions() const
+		{
+			return m_positionData;
+		}
+
+		inline const Scalar*		GetNormals() const
+		{
+			return m_normalData;
+		}
+
+		inline const Scalar*		GetTexcoords() const
+		{
+			return m_texcoordData;
+		}
+
+		inline const unsigned int*	GetIndices() const
+		{
+			return m_indexData;
+		}
+
+		inline const Scalar*		GetEdges() const
+		{
+			return m_edgeData;
+		}
+
+		inline const BVH&			GetBVH() const
+		{
+			return m_bvh;
+		}
+
+		//Returns the number of bytes used by the geometry and the BVH owned by the mesh
+		size_t						GetMemoryUsage() const;
+
+		RayHitResult				IntersectByRay(Ray& ray);
+		__m128						IntersectByPacket(const RayPacket& packet);
+		bool						GetBounds(AABB& bounds);
+
+		//Returns the distance to the closest hit of the ray with the mesh, or FARFAR_AWAY if the ray misses
+		//triangle, if not null, receives the index of the triangle hit
+		Scalar						Intersect(Ray& ray, int* triangle = nullptr) const;
+
+		//Fill in the point and normal of a hit on the given triangle at distance result.t
+		void						CompleteHit(int triangle, Ray& ray, RayHitResult& result) const;
+};
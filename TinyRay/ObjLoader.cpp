@@ -0,0 +1,603 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <omp.h>
+#include <vector>
+
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+//A run of whole lines of the file parsed by one thread
+struct ObjChunk
+{
+	const char*		begin;
+	const char*		end;
+	int				lines;			//number of lines in the chunk
+	int				positions;		//number of v lines, then the index of the first of them in the whole file
+	int				texcoords;		//number of vt lines, then the index of the first of them
+	int				normals;		//number of vn lines, then the index of the first of them
+	int				triangles;		//number of triangles of the f lines, then the index of the first of them
+	bool			attributes;		//true if a face vertex refers to a texture coordinate or a normal
+	int				errorLine;		//line of the first malformed line within the chunk, -1 if there is none
+};
+
+//Kinds of lines the loader reads
+enum ObjLine
+{
+	OBJ_LINE_OTHER = 0,
+	OBJ_LINE_POSITION,
+	OBJ_LINE_TEXCOORD,
+	OBJ_LINE_NORMAL,
+	OBJ_LINE_FACE
+};
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline void SkipSpaces(const char*& p, const char* end)
+{
+	while (p < end && IsSpace(*p)) p++;
+}
+
+//Returns the kind of the line starting at p and moves p past the keyword
+static inline ObjLine ParseKeyword(const char*& p, const char* end)
+{
+	SkipSpaces(p, end);
+
+	if (end - p < 2) return OBJ_LINE_OTHER;
+
+	if (p[0] == 'f' && IsSpace(p[1]))
+	{
+		p += 1;
+		return OBJ_LINE_FACE;
+	}
+
+	if (p[0] != 'v') return OBJ_LINE_OTHER;
+
+	if (IsSpace(p[1]))
+	{
+		p += 1;
+		return OBJ_LINE_POSITION;
+	}
+
+	if (end - p < 3 || !IsSpace(p[2])) return OBJ_LINE_OTHER;
+
+	p += 2;
+
+	if (p[-1] == 't') return OBJ_LINE_TEXCOORD;
+	if (p[-1] == 'n') return OBJ_LINE_NORMAL;
+
+	return OBJ_LINE_OTHER;
+}
+
+//Parse a decimal number with an optional fraction and exponent
+static inline bool ParseFloat(const char*& p, const char* end, Scalar& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	SkipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	double mantissa = 0.0;
+	int exponent = 0;
+	bool digits = false;
+
+	while (p < end && IsDigit(*p))
+	{
+		mantissa = mantissa * 10.0 + (*p++ - '0');
+		digits = true;
+	}
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && IsDigit(*p))
+		{
+			mantissa = mantissa * 10.0 + (*p++ - '0');
+			exponent--;
+			digits = true;
+		}
+	}
+
+	if (!digits) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negative_exponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative_exponent = *p == '-';
+			p++;
+		}
+
+		int e = 0;
+		while (p < end && IsDigit(*p) && e < 10000)
+			e = e * 10 + (*p++ - '0');
+		exponent += negative_exponent ? -e : e;
+	}
+
+	if (exponent < 0)
+		mantissa = exponent >= -22 ? mantissa / powers[-exponent] : mantissa * pow(10.0, exponent);
+	else if (exponent > 0)
+		mantissa = exponent <= 22 ? mantissa * powers[exponent] : mantissa * pow(10.0, exponent);
+
+	value = (Scalar)(negative ? -mantissa : mantissa);
+
+	//Values too large for a Scalar become infinite and would break the bounds of the mesh
+	if (!isfinite(value)) return false;
+
+	return p == end || IsSpace(*p) || *p == '\n';
+}
+
+//Parse a signed integer, returns false if it does not fit in an int
+static inline bool ParseInt(const char*& p, const char* end, int& value)
+{
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+
+	if (p == end || !IsDigit(*p)) return false;
+
+	long long n = 0;
+	while (p < end && IsDigit(*p))
+	{
+		n = n * 10 + (*p++ - '0');
+		if (n > INT_MAX) return false;
+	}
+
+	value = (int)(negative ? -n : n);
+
+	return true;
+}
+
+//Turn a 1-based or negative, relative OBJ index into a 0-based index
+//Returns false if it is 0, which OBJ does not use, or outside [0, total)
+static inline bool ResolveIndex(int& index, int defined, int total)
+{
+	if (index == 0) return false;
+
+	index = index > 0 ? index - 1 : defined + index;
+	return index >= 0 && index < total;
+}
+
+static inline void SkipLine(const char*& p, const char* end)
+{
+	while (p < end && *p != '\n') p++;
+	if (p < end) p++;
+}
+
+//Count the vertices and triangles of a chunk
+static void CountChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+
+	for (; p < end; chunk.lines++)
+	{
+		switch (ParseKeyword(p, end))
+		{
+			case OBJ_LINE_POSITION:
+				chunk.positions++;
+				break;
+			case OBJ_LINE_TEXCOORD:
+				chunk.texcoords++;
+				break;
+			case OBJ_LINE_NORMAL:
+				chunk.normals++;
+				break;
+			case OBJ_LINE_FACE:
+			{
+				int corners = 0;
+
+				while (true)
+				{
+					SkipSpaces(p, end);
+					if (p == end || *p == '\n') break;
+
+					corners++;
+					while (p < end && !IsSpace(*p) && *p != '\n')
+					{
+						if (*p == '/') chunk.attributes = true;
+						p++;
+					}
+				}
+
+				if (corners < 3)
+				{
+					if (chunk.errorLine < 0) chunk.errorLine = chunk.lines;
+				}
+				else
+				{
+					chunk.triangles += corners - 2;
+				}
+				break;
+			}
+			default:
+				break;
+		}
+
+		SkipLine(p, end);
+	}
+}
+
+//Arrays the chunks are parsed into
+struct ObjArrays
+{
+	std::vector<Scalar>			positions;
+	std::vector<Scalar>			texcoords;
+	std::vector<Scalar>			normals;
+	std::vector<unsigned int>	indices;			//position index of every triangle corner
+	std::vector<int>			cornerTexcoords;	//texcoord index of every corner, -1 if it has none, only filled if a face has attributes
+	std::vector<int>			cornerNormals;		//normal index of every corner, as cornerTexcoords
+
+	size_t GetMemoryUsage() const
+	{
+		return (positions.capacity() + texcoords.capacity() + normals.capacity()) * sizeof(Scalar)
+			+ indices.capacity() * sizeof(unsigned int)
+			+ (cornerTexcoords.capacity() + cornerNormals.capacity()) * sizeof(int);
+	}
+};
+
+//Parse a chunk into the arrays at the offsets given by the chunk, the total counts are used to check the indices
+static void ParseChunk(ObjChunk& chunk, ObjArrays& arrays, const ObjChunk& totals, bool attributes)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+
+	int position = chunk.positions;
+	int texcoord = chunk.texcoords;
+	int normal = chunk.normals;
+	int corner = chunk.triangles * 3;
+
+	for (int line = 0; p < end && chunk.errorLine < 0; line++)
+	{
+		bool valid = true;
+
+		switch (ParseKeyword(p, end))
+		{
+			case OBJ_LINE_POSITION:
+			{
+				Scalar* dst = &arrays.positions[position++ * 3];
+				valid = ParseFloat(p, end, dst[0]) && ParseFloat(p, end, dst[1]) && ParseFloat(p, end, dst[2]);
+				break;
+			}
+			case OBJ_LINE_TEXCOORD:
+			{
+				Scalar* dst = &arrays.texcoords[texcoord++ * 2];
+				valid = ParseFloat(p, end, dst[0]);
+				//The second coordinate is optional
+				SkipSpaces(p, end);
+				if (p == end || *p == '\n')
+					dst[1] = 0;
+				else
+					valid = valid && ParseFloat(p, end, dst[1]);
+				break;
+			}
+			case OBJ_LINE_NORMAL:
+			{
+				Scalar* dst = &arrays.normals[normal++ * 3];
+				valid = ParseFloat(p, end, dst[0]) && ParseFloat(p, end, dst[1]) && ParseFloat(p, end, dst[2]);
+				break;
+			}
+			case OBJ_LINE_FACE:
+			{
+				//Split the polygon into a fan of triangles around its first vertex
+				int first[3], previous[3], current[3];
+
+				for (int k = 0; valid; k++)
+				{
+					SkipSpaces(p, end);
+					if (p == end || *p == '\n') break;
+
+					//v, v/vt, v//vn or v/vt/vn
+					current[1] = current[2] = 0;
+					valid = ParseInt(p, end, current[0]) && ResolveIndex(current[0], position, totals.positions);
+					if (valid && p < end && *p == '/')
+					{
+						p++;
+						if (p < end && *p != '/')
+							valid = ParseInt(p, end, current[1]) && ResolveIndex(current[1], texcoord, totals.texcoords);
+						else
+							current[1] = -1;
+						if (valid && p < end && *p == '/')
+						{
+							p++;
+							valid = ParseInt(p, end, current[2]) && ResolveIndex(current[2], normal, totals.normals);
+						}
+						else
+						{
+							current[2] = -1;
+						}
+					}
+					else
+					{
+						current[1] = current[2] = -1;
+					}
+
+					if (!valid || (p < end && !IsSpace(*p) && *p != '\n'))
+					{
+						valid = false;
+						break;
+					}
+
+					if (k >= 2)
+					{
+						const int* triangle[3] = { first, previous, current };
+						for (int v = 0; v < 3; v++, corner++)
+						{
+							arrays.indices[corner] = triangle[v][0];
+							if (attributes)
+							{
+								arrays.cornerTexcoords[corner] = triangle[v][1];
+								arrays.cornerNormals[corner] = triangle[v][2];
+							}
+						}
+					}
+
+					int* keep = k == 0 ? first : previous;
+					keep[0] = current[0];
+					keep[1] = current[1];
+					keep[2] = current[2];
+				}
+				break;
+			}
+			default:
+				break;
+		}
+
+		if (!valid) chunk.errorLine = line;
+
+		SkipLine(p, end);
+	}
+}
+
+//Give every distinct combination of position, texture coordinate and normal used by a corner its own vertex
+//The first combination seen for a position keeps the index of the position, the others are appended
+//Fills in the per vertex texture coordinates and normals of the mesh
+static void SplitVertices(ObjArrays& arrays, std::vector<Scalar>& texcoords, std::vector<Scalar>& normals, size_t& peak)
+{
+	int position_count = (int)arrays.positions.size() / 3;
+	int corner_count = (int)arrays.indices.size();
+
+	std::vector<int> vertex_texcoord(position_count, -2);	//-2 if no corner uses the vertex yet
+	std::vector<int> vertex_normal(position_count, -1);
+	std::vector<int> next(position_count, -1);				//next vertex made from the same position
+	std::vector<int> source;								//position of every appended vertex
+	bool has_texcoords = false;
+	bool has_normals = true;
+
+	for (int c = 0; c < corner_count; c++)
+	{
+		int v = arrays.indices[c];
+		int t = arrays.cornerTexcoords[c];
+		int n = arrays.cornerNormals[c];
+
+		has_texcoords = has_texcoords || t >= 0;
+		has_normals = has_normals && n >= 0;
+
+		if (vertex_texcoord[v] == -2)
+		{
+			vertex_texcoord[v] = t;
+			vertex_normal[v] = n;
+			continue;
+		}
+
+		while (vertex_texcoord[v] != t || vertex_normal[v] != n)
+		{
+			if (next[v] < 0)
+			{
+				next[v] = (int)vertex_texcoord.size();
+				vertex_texcoord.push_back(t);
+				vertex_normal.push_back(n);
+				next.push_back(-1);
+				source.push_back(arrays.indices[c]);
+			}
+			v = next[v];
+		}
+
+		arrays.indices[c] = v;
+	}
+
+	//The split is done, the per corner indices are no longer needed
+	size_t held = arrays.GetMemoryUsage() + (vertex_texcoord.capacity() + vertex_normal.capacity() + next.capacity()
+		+ source.capacity()) * sizeof(int);
+	peak = held > peak ? held : peak;
+
+	std::vector<int>().swap(arrays.cornerTexcoords);
+	std::vector<int>().swap(arrays.cornerNormals);
+	std::vector<int>().swap(next);
+
+	int vertex_count = (int)vertex_texcoord.size();
+
+	arrays.positions.reserve(vertex_count * 3);
+	for (int i = 0; i < (int)source.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+			arrays.positions.push_back(arrays.positions[source[i] * 3 + k]);
+	}
+
+	if (has_texcoords)
+	{
+		texcoords.assign(vertex_count * 2, 0);
+		for (int v = 0; v < vertex_count; v++)
+		{
+			if (vertex_texcoord[v] < 0) continue;
+			texcoords[v * 2] = arrays.texcoords[vertex_texcoord[v] * 2];
+			texcoords[v * 2 + 1] = arrays.texcoords[vertex_texcoord[v] * 2 + 1];
+		}
+	}
+
+	//Normals are only used if every corner has one, the mesh falls back to face normals otherwise
+	if (has_normals && corner_count > 0)
+	{
+		normals.assign(vertex_count * 3, 0);
+		for (int v = 0; v < vertex_count; v++)
+		{
+			if (vertex_normal[v] < 0) continue;
+			for (int k = 0; k < 3; k++)
+				normals[v * 3 + k] = arrays.normals[vertex_normal[v] * 3 + k];
+		}
+	}
+
+	held = arrays.GetMemoryUsage() + (texcoords.capacity() + normals.capacity()) * sizeof(Scalar)
+		+ (vertex_texcoord.capacity() + vertex_normal.capacity() + source.capacity()) * sizeof(int);
+	peak = held > peak ? held : peak;
+}
+
+bool ObjLoader::Load(const char* filename, Mesh& mesh, LoadStats* stats)
+{
+	double start_time = omp_get_wtime();
+
+	MappedFile file;
+
+	if (!file.Open(filename))
+	{
+		printf("Error opening OBJ file: %s\n", filename);
+		return false;
+	}
+
+	const char* data = file.GetData();
+	const char* data_end = data + file.GetSize();
+
+	//Split the file into chunks of whole lines
+	std::vector<ObjChunk> chunks;
+
+	for (const char* p = data; p < data_end; )
+	{
+		ObjChunk chunk = {};
+		chunk.begin = p;
+		p = (size_t)(data_end - p) > s_chunkSize ? p + s_chunkSize : data_end;
+		SkipLine(p, data_end);
+		chunk.end = p;
+		chunk.errorLine = -1;
+		chunks.push_back(chunk);
+	}
+
+	int chunk_count = (int)chunks.size();
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < chunk_count; i++)
+	{
+		CountChunk(chunks[i]);
+	}
+
+	//Turn the counts into the offsets of every chunk
+	ObjChunk totals = {};
+	int first_line = 0;
+
+	for (int i = 0; i < chunk_count; i++)
+	{
+		ObjChunk& chunk = chunks[i];
+		int counts[4] = { chunk.positions, chunk.texcoords, chunk.normals, chunk.triangles };
+
+		if (chunk.errorLine >= 0)
+		{
+			printf("Error in OBJ file %s, line %d: a face needs at least 3 vertices\n", filename, first_line + chunk.errorLine + 1);
+			return false;
+		}
+
+		chunk.positions = totals.positions;
+		chunk.texcoords = totals.texcoords;
+		chunk.normals = totals.normals;
+		chunk.triangles = totals.triangles;
+
+		totals.positions += counts[0];
+		totals.texcoords += counts[1];
+		totals.normals += counts[2];
+		totals.triangles += counts[3];
+		totals.attributes = totals.attributes || chunk.attributes;
+		first_line += chunk.lines;
+	}
+
+	ObjArrays arrays;
+	arrays.positions.resize(totals.positions * 3);
+	arrays.texcoords.resize(totals.texcoords * 2);
+	arrays.normals.resize(totals.normals * 3);
+	arrays.indices.resize(totals.triangles * 3);
+
+	if (totals.attributes)
+	{
+		arrays.cornerTexcoords.resize(totals.triangles * 3);
+		arrays.cornerNormals.resize(totals.triangles * 3);
+	}
+
+	size_t peak = arrays.GetMemoryUsage();
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < chunk_count; i++)
+	{
+		ParseChunk(chunks[i], arrays, totals, totals.attributes);
+	}
+
+	first_line = 0;
+	for (int i = 0; i < chunk_count; i++)
+	{
+		if (chunks[i].errorLine >= 0)
+		{
+			printf("Error in OBJ file %s, line %d: malformed line or index out of range\n", filename, first_line + chunks[i].errorLine + 1);
+			return false;
+		}
+		first_line += chunks[i].lines;
+	}
+
+	std::vector<Scalar> texcoords, normals;
+
+	if (totals.attributes)
+	{
+		SplitVertices(arrays, texcoords, normals, peak);
+	}
+
+	double parse_time = omp_get_wtime() - start_time;
+
+	mesh.SetVertices(arrays.positions, normals, texcoords);
+	mesh.SetTriangles(arrays.indices);
+	mesh.Build();
+
+	if (stats)
+	{
+		stats->fileSize = file.GetSize();
+		stats->chunkCount = chunk_count;
+		stats->vertexCount = mesh.GetVertexCount();
+		stats->triangleCount = mesh.GetTriangleCount();
+		stats->peakMemory = peak > mesh.GetMemoryUsage() ? peak : mesh.GetMemoryUsage();
+		stats->parseTime = parse_time * 1000.0;
+		stats->loadTime = (omp_get_wtime() - start_time) * 1000.0;
+	}
+
+	return true;
+}
+
+void ObjLoader::PrintLoadStats(const char* filename, const LoadStats& stats)
+{
+	fprintf(stdout, "%s: %d vertices, %d triangles, %.2f MB in %d chunks, parsed in %.2f ms, loaded in %.2f ms, peak memory %.2f MB\n",
+		filename, stats.vertexCount, stats.triangleCount, stats.fileSize / 1048576.0, stats.chunkCount,
+		stats.parseTime, stats.loadTime, stats.peakMemory / 1048576.0);
+}
@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stddef.h>
+
+class Mesh;
+
+//Loads triangle meshes from Wavefront OBJ files.
+//The file is memory mapped and split into chunks of whole lines that are parsed in parallel, first to
+//count the vertices and triangles of every chunk and then to write them straight into the arrays of the
+//mesh at the offsets given by those counts. Lines are parsed in place without building strings.
+//Only geometry is read: v, vt, vn and f lines, polygons are split into triangle fans.
+class ObjLoader
+{
+	public:
+		//Statistics gathered by the last call to Load
+		struct LoadStats
+		{
+			size_t			fileSize;		//size of the file in bytes
+			int				chunkCount;		//number of chunks the file was split into
+			int				vertexCount;	//number of vertices of the mesh, positions with several normals or texture coordinates count once for each
+			int				triangleCount;	//number of triangles of the mesh
+			size_t			peakMemory;		//largest number of bytes held by the loader at once, not counting the mapped file
+			double			parseTime;		//time spent parsing the file in milliseconds
+			double			loadTime;		//total load time in milliseconds, including building the BVH of the mesh
+		};
+
+	private:
+		static const size_t	s_chunkSize = 1 << 20;	//target number of bytes per chunk
+
+	public:
+		//Load the given OBJ file into the mesh and build its BVH
+		//Returns false if the file cannot be read or is malformed, the reason is printed to stdout
+		static bool			Load(const char* filename, Mesh& mesh, LoadStats* stats = nullptr);
+
+		//Print the statistics of a load to stdout
+		static void			PrintLoadStats(const char* filename, const LoadStats& stats);
+};
@@ -9,6 +9,8 @@
 ---------------------------------------------------------------------*/
 #include <math.h>
 #include "Plane.h"
+#include "AABB.h"
+#include "RayPacket.h"
 
 
 Plane::Plane()
@@ -28,29 +30,101 @@ Plane::~Plane()
 RayHitResult Plane::IntersectByRay(Ray& ray)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
-	double t = FARFAR_AWAY;
 
-	double d = m_offset;
+	Scalar t = IntersectPlane(m_normal, m_offset, ray);
+
+	if (t >= FARFAR_AWAY) return result;
+
+	result.t = t;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
+
+	CompletePlaneHit(m_normal, ray, result);
+
+	return result;
+}
+
+__m128 Plane::IntersectByPacket(const RayPacket& packet)
+{
+	return IntersectPlanePacket(m_normal, m_offset, packet);
+}
+
+Scalar Plane::IntersectPlane(const Vector3& normal, Scalar offset, Ray& ray)
+{
+	Scalar d = offset;
 
 	Vector3 r = ray.GetRay();
-	double ndotr = m_normal.DotProduct(r);
-	double sdotn = ray.GetRayStart().DotProduct(m_normal);
+	Scalar ndotr = normal.DotProduct(r);
+	Scalar sdotn = ray.GetRayStart().DotProduct(normal);
 	if (fabs(ndotr) < 1e-5)
-		return result;
+		return FARFAR_AWAY;
 
+	return -(sdotn + d) / ndotr;
+}
 
-	t = -(sdotn + d) / ndotr;
-	
-	result.normal = m_normal;
-	result.t = t;
-	result.data = this;
-	Vector3 intersection_point = ray.GetRayStart() + r*result.t;
+void Plane::CompletePlaneHit(const Vector3& normal, Ray& ray, RayHitResult& result)
+{
+	result.normal = normal;
+	Vector3 intersection_point = ray.GetRayStart() + ray.GetRay()*result.t;
 	result.point = intersection_point;
+}
 
-	return result;
+Scalar Plane::ComputePlaneTexCoords(const Vector3& normal, const Vector3& point, Scalar texcoords[2])
+{
+	//World space size of one repeat of a texture
+	const Scalar texture_size = 8.0;
+
+	Scalar nx = fabs(normal[0]);
+	Scalar ny = fabs(normal[1]);
+	Scalar nz = fabs(normal[2]);
+
+	//The top of the texture is up on walls
+	if (ny >= nx && ny >= nz)
+	{
+		texcoords[0] = point[0] / texture_size;
+		texcoords[1] = point[2] / texture_size;
+	}
+	else if (nx >= nz)
+	{
+		texcoords[0] = point[2] / texture_size;
+		texcoords[1] = -point[1] / texture_size;
+	}
+	else
+	{
+		texcoords[0] = point[0] / texture_size;
+		texcoords[1] = -point[1] / texture_size;
+	}
+
+	return texture_size;
+}
+
+__m128 Plane::IntersectPlanePacket(const Vector3& normal, Scalar offset, const RayPacket& packet)
+{
+	__m128 nx = _mm_set1_ps(normal[0]);
+	__m128 ny = _mm_set1_ps(normal[1]);
+	__m128 nz = _mm_set1_ps(normal[2]);
+
+	__m128 ndotr = PacketDot(nx, ny, nz, packet.dx, packet.dy, packet.dz);
+	__m128 sdotn = PacketDot(nx, ny, nz, packet.ox, packet.oy, packet.oz);
+
+	//Rays (nearly) parallel to the plane miss it
+	__m128 abs_ndotr = _mm_andnot_ps(_mm_set1_ps(-0.0f), ndotr);
+	__m128 hit = _mm_cmpge_ps(abs_ndotr, _mm_set1_ps(1e-5f));
+
+	__m128 t = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(sdotn, _mm_set1_ps((float)offset))), ndotr);
+
+	return PacketSelect(hit, t, _mm_set1_ps(FARFAR_AWAY));
+}
+
+bool Plane::GetBounds(AABB& bounds)
+{
+	//A plane extends infinitely and has no finite bounds
+	bounds.SetEmpty();
+
+	return false;
 }
 
-void Plane::SetPlane(const Vector3& normal, double offset)
+void Plane::SetPlane(const Vector3& normal, Scalar offset)
 {
 	m_normal = normal;
 	m_offset = -offset;
@@ -16,14 +16,38 @@ class Plane : public Primitive
 {
 	private:
 		Vector3			m_normal;			//normal to the plane
-		double			m_offset;			//position of the plane along the normal
+		Scalar			m_offset;			//position of the plane along the normal
 
 	public:
 						Plane();
 						~Plane();
 
 		RayHitResult	IntersectByRay(Ray& ray);
+		__m128			IntersectByPacket(const RayPacket& packet);
+		bool			GetBounds(AABB& bounds);
 
-		void SetPlane(const Vector3& normal, double offset);
+		//Intersection kernels shared by Plane and the SoA storage of PrimitiveStore
+		//IntersectPlane returns the hit distance, or FARFAR_AWAY if the ray is parallel to the plane
+		//CompletePlaneHit fills in the point and normal of a hit at distance result.t
+		static Scalar	IntersectPlane(const Vector3& normal, Scalar offset, Ray& ray);
+		static __m128	IntersectPlanePacket(const Vector3& normal, Scalar offset, const RayPacket& packet);
+		static void		CompletePlaneHit(const Vector3& normal, Ray& ray, RayHitResult& result);
+
+		//Texture coordinates of a point on a plane, projected along the axis closest to the normal
+		//so that a texture repeats every 8 units. Returns the world space length of one unit
+		//of texture coordinates.
+		static Scalar	ComputePlaneTexCoords(const Vector3& normal, const Vector3& point, Scalar texcoords[2]);
+
+		void SetPlane(const Vector3& normal, Scalar offset);
+
+		inline Vector3&	GetNormal()
+		{
+			return m_normal;
+		}
+
+		inline Scalar	GetOffset()			//offset as used by the intersection, i.e. the negated offset given to SetPlane
+		{
+			return m_offset;
+		}
 };
 
@@ -12,6 +12,8 @@
 #include "Ray.h"
 
 class Material;
+class AABB;
+struct RayPacket;
 
 
 //An abstract class representing a basic primitive in TinyRay
@@ -19,6 +21,7 @@ class Primitive
 {
 	private:
 		Material				*m_pMaterial;		//pointer to the material associated to the primitive
+		int						m_index;			//index among the scene objects of the same type, see PrimitiveStore
 		
 	public:
 		//enum for primitive types
@@ -27,17 +30,29 @@ class Primitive
 			PRIMTYPE_Plane = 0,	//plane
 			PRIMTYPE_Sphere, //sphere
 			PRIMTYPE_Triangle, //generic triangle
-			PRIMTYPE_Box //box
+			PRIMTYPE_Box, //box
+			PRIMTYPE_Mesh, //triangle mesh
+			PRIMTYPE_Instance, //transformed reference to shared geometry
+			PRIMTYPE_Count //number of primitive types
 		};
 
 		PRIMTYPE				m_primtype; //primitive type
 
-								Primitive(){ m_pMaterial = nullptr; }
+								Primitive(){ m_pMaterial = nullptr; m_index = -1; }
 		virtual					~Primitive(){ ; }
 
 
 		virtual RayHitResult	IntersectByRay(Ray& ray) = 0;  //An interface for computing intersection between a ray and this primitve
 
+		//An interface for intersecting a packet of rays with this primitive
+		//Returns the hit distance of every lane, lanes that miss the primitive receive
+		//a distance that is not positive, NaN or FARFAR_AWAY
+		virtual __m128			IntersectByPacket(const RayPacket& packet) = 0;
+
+		//An interface for computing the axis-aligned bounds of this primitive
+		//Returns false if the primitive is unbounded, e.g. an infinite plane
+		virtual bool			GetBounds(AABB& bounds) = 0;
+
 		inline void				SetMaterial(Material* pMat)
 		{
 			m_pMaterial = pMat;
@@ -47,4 +62,14 @@ class Primitive
 		{
 			return m_pMaterial;
 		}
+
+		inline void				SetIndex(int index)
+		{
+			m_index = index;
+		}
+
+		inline int				GetIndex()
+		{
+			return m_index;
+		}
 };
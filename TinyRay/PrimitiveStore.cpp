@@ -0,0 +1,250 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "PrimitiveStore.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Box.h"
+#include "Mesh.h"
+#include "Instance.h"
+#include "RayPacket.h"
+
+static inline void StoreVector3(std::vector<Scalar>& dst, const Vector3& v)
+{
+	dst.push_back(v[0]);
+	dst.push_back(v[1]);
+	dst.push_back(v[2]);
+}
+
+static inline Vector3 LoadVector3(const Scalar* src)
+{
+	return Vector3(src[0], src[1], src[2]);
+}
+
+PrimitiveStore::PrimitiveStore()
+{
+}
+
+PrimitiveStore::~PrimitiveStore()
+{
+	Clear();
+}
+
+void PrimitiveStore::Build(const std::vector<Primitive*>& objects)
+{
+	Clear();
+
+	for (int i = 0; i < (int)objects.size(); i++)
+	{
+		Primitive* prim = objects[i];
+		int type = prim->m_primtype;
+
+		prim->SetIndex(GetCount(type));
+		m_materials[type].push_back(prim->GetMaterial());
+		m_order[type].push_back(i);
+
+		switch (type)
+		{
+			case Primitive::PRIMTYPE_Sphere:
+			{
+				Sphere* sphere = static_cast<Sphere*>(prim);
+				StoreVector3(m_sphereCentres, sphere->GetCentre());
+				m_sphereRadii.push_back(sphere->GetRadius());
+				break;
+			}
+			case Primitive::PRIMTYPE_Plane:
+			{
+				Plane* plane = static_cast<Plane*>(prim);
+				StoreVector3(m_planeNormals, plane->GetNormal());
+				m_planeOffsets.push_back(plane->GetOffset());
+				break;
+			}
+			case Primitive::PRIMTYPE_Triangle:
+			{
+				Triangle* triangle = static_cast<Triangle*>(prim);
+				for (int v = 0; v < 3; v++)
+				{
+					StoreVector3(m_triangleVertices, triangle->m_vertices[v].m_position);
+					StoreVector3(m_triangleNormals, triangle->m_vertices[v].m_normal);
+					m_triangleTexcoords.push_back(triangle->m_vertices[v].m_texcoords[0]);
+					m_triangleTexcoords.push_back(triangle->m_vertices[v].m_texcoords[1]);
+				}
+				StoreVector3(m_triangleEdges, triangle->m_vertices[1].m_position - triangle->m_vertices[0].m_position);
+				StoreVector3(m_triangleEdges, triangle->m_vertices[2].m_position - triangle->m_vertices[0].m_position);
+				break;
+			}
+			case Primitive::PRIMTYPE_Box:
+			{
+				Box* box = static_cast<Box*>(prim);
+				StoreVector3(m_boxMin, box->GetMin());
+				StoreVector3(m_boxMax, box->GetMax());
+				//Transformed boxes are made of triangles and are intersected through the box itself
+				m_transformedBoxes.push_back(box->IsAxisAligned() ? nullptr : box);
+				break;
+			}
+			case Primitive::PRIMTYPE_Mesh:
+			{
+				m_meshes.push_back(static_cast<Mesh*>(prim));
+				break;
+			}
+			case Primitive::PRIMTYPE_Instance:
+			{
+				m_instances.push_back(static_cast<Instance*>(prim));
+				break;
+			}
+		}
+	}
+}
+
+void PrimitiveStore::Clear()
+{
+	m_sphereCentres.clear();
+	m_sphereRadii.clear();
+	m_planeNormals.clear();
+	m_planeOffsets.clear();
+	m_triangleVertices.clear();
+	m_triangleEdges.clear();
+	m_triangleNormals.clear();
+	m_triangleTexcoords.clear();
+	m_boxMin.clear();
+	m_boxMax.clear();
+	m_transformedBoxes.clear();
+	m_meshes.clear();
+	m_instances.clear();
+
+	for (int type = 0; type < Primitive::PRIMTYPE_Count; type++)
+	{
+		m_materials[type].clear();
+		m_order[type].clear();
+	}
+}
+
+Scalar PrimitiveStore::Intersect(const PrimRef& ref, Ray& ray)
+{
+	int i = ref.index;
+
+	switch (ref.type)
+	{
+		case Primitive::PRIMTYPE_Sphere:
+			return Sphere::IntersectSphere(LoadVector3(&m_sphereCentres[i * 3]), m_sphereRadii[i], ray);
+		case Primitive::PRIMTYPE_Plane:
+			return Plane::IntersectPlane(LoadVector3(&m_planeNormals[i * 3]), m_planeOffsets[i], ray);
+		case Primitive::PRIMTYPE_Triangle:
+			return Triangle::IntersectTriangle(LoadVector3(&m_triangleVertices[i * 9]),
+				LoadVector3(&m_triangleEdges[i * 6]), LoadVector3(&m_triangleEdges[i * 6 + 3]), ray);
+		case Primitive::PRIMTYPE_Box:
+			if (m_transformedBoxes[i])
+				return m_transformedBoxes[i]->IntersectByRay(ray).t;
+			return Box::IntersectAABox(LoadVector3(&m_boxMin[i * 3]), LoadVector3(&m_boxMax[i * 3]), ray);
+		case Primitive::PRIMTYPE_Mesh:
+			return m_meshes[i]->Intersect(ray);
+		case Primitive::PRIMTYPE_Instance:
+			return m_instances[i]->Intersect(ray);
+	}
+
+	return FARFAR_AWAY;
+}
+
+__m128 PrimitiveStore::IntersectPacket(const PrimRef& ref, const RayPacket& packet)
+{
+	int i = ref.index;
+
+	switch (ref.type)
+	{
+		case Primitive::PRIMTYPE_Sphere:
+			return Sphere::IntersectSpherePacket(LoadVector3(&m_sphereCentres[i * 3]), m_sphereRadii[i], packet);
+		case Primitive::PRIMTYPE_Plane:
+			return Plane::IntersectPlanePacket(LoadVector3(&m_planeNormals[i * 3]), m_planeOffsets[i], packet);
+		case Primitive::PRIMTYPE_Triangle:
+			return Triangle::IntersectTrianglePacket(LoadVector3(&m_triangleVertices[i * 9]),
+				LoadVector3(&m_triangleEdges[i * 6]), LoadVector3(&m_triangleEdges[i * 6 + 3]), packet);
+		case Primitive::PRIMTYPE_Box:
+			if (m_transformedBoxes[i])
+				return m_transformedBoxes[i]->IntersectByPacket(packet);
+			return Box::IntersectAABoxPacket(LoadVector3(&m_boxMin[i * 3]), LoadVector3(&m_boxMax[i * 3]), packet);
+		case Primitive::PRIMTYPE_Mesh:
+			return m_meshes[i]->IntersectByPacket(packet);
+		case Primitive::PRIMTYPE_Instance:
+			return m_instances[i]->IntersectByPacket(packet);
+	}
+
+	return _mm_set1_ps(FARFAR_AWAY);
+}
+
+void PrimitiveStore::CompleteHit(Ray& ray, RayHitResult& result)
+{
+	int i = result.index;
+
+	switch (result.primtype)
+	{
+		case Primitive::PRIMTYPE_Sphere:
+			Sphere::CompleteSphereHit(LoadVector3(&m_sphereCentres[i * 3]), ray, result);
+			break;
+		case Primitive::PRIMTYPE_Plane:
+			Plane::CompletePlaneHit(LoadVector3(&m_planeNormals[i * 3]), ray, result);
+			break;
+		case Primitive::PRIMTYPE_Triangle:
+		{
+			Vector3 positions[3], normals[3];
+			for (int v = 0; v < 3; v++)
+			{
+				positions[v] = LoadVector3(&m_triangleVertices[i * 9 + v * 3]);
+				normals[v] = LoadVector3(&m_triangleNormals[i * 9 + v * 3]);
+			}
+			Triangle::CompleteTriangleHit(positions, normals, ray, result);
+			break;
+		}
+		case Primitive::PRIMTYPE_Box:
+			if (m_transformedBoxes[i])
+			{
+				result = m_transformedBoxes[i]->IntersectByRay(ray);
+			}
+			else
+			{
+				Box::IntersectAABox(LoadVector3(&m_boxMin[i * 3]), LoadVector3(&m_boxMax[i * 3]), ray, &result.normal);
+				result.point = ray.GetRayStart() + ray.GetRay()*result.t;
+			}
+			break;
+		case Primitive::PRIMTYPE_Mesh:
+		{
+			//Only the distance of the closest hit is known, find the triangle again
+			int triangle;
+			m_meshes[i]->Intersect(ray, &triangle);
+			if (triangle >= 0)
+				m_meshes[i]->CompleteHit(triangle, ray, result);
+			break;
+		}
+		case Primitive::PRIMTYPE_Instance:
+			result = m_instances[i]->IntersectByRay(ray);
+			break;
+	}
+}
+
+Scalar PrimitiveStore::GetTexCoords(const RayHitResult& result, Scalar texcoords[2])
+{
+	int i = result.index;
+
+	switch (result.primtype)
+	{
+		case Primitive::PRIMTYPE_Sphere:
+			return Sphere::ComputeSphereTexCoords(LoadVector3(&m_sphereCentres[i * 3]), m_sphereRadii[i], result.point, texcoords);
+		case Primitive::PRIMTYPE_Plane:
+			return Plane::ComputePlaneTexCoords(LoadVector3(&m_planeNormals[i * 3]), result.point, texcoords);
+		case Primitive::PRIMTYPE_Triangle:
+		{
+			Vector3 positions[3];
+			for (int v = 0; v < 3; v++)
+				positions[v] = LoadVector3(&m_triangleVertices[i * 9 + v * 3]);
+			return Triangle::ComputeTriangleTexCoords(positions, &m_triangleTexcoords[i * 6], result.point, texcoords);
+		}
+		default:
+			return 0;
+	}
+}
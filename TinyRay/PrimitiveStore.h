@@ -0,0 +1,110 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Primitive.h"
+#include "Material.h"
+#include <vector>
+
+class Box;
+class Mesh;
+class Instance;
+
+//A compact structure of arrays copy of the scene objects used for intersection.
+//The geometry of each primitive type is kept in its own contiguous Scalar arrays,
+//so that intersection runs over plain data without virtual calls or pointer chasing.
+//Objects are referred to by their type and their index among the objects of that type.
+class PrimitiveStore
+{
+	public:
+		//A reference to a stored primitive
+		struct PrimRef
+		{
+			int type;		//Primitive::PRIMTYPE of the primitive
+			int index;		//index among the primitives of the same type
+		};
+
+	private:
+		//Spheres
+		std::vector<Scalar>		m_sphereCentres;		//3 values per sphere
+		std::vector<Scalar>		m_sphereRadii;			//1 value per sphere
+
+		//Planes
+		std::vector<Scalar>		m_planeNormals;			//3 values per plane
+		std::vector<Scalar>		m_planeOffsets;			//1 value per plane, negated as in Plane
+
+		//Triangles
+		std::vector<Scalar>		m_triangleVertices;		//9 values per triangle
+		std::vector<Scalar>		m_triangleEdges;		//6 values per triangle, the edges from the first vertex to the other two
+		std::vector<Scalar>		m_triangleNormals;		//9 values per triangle, one normal per vertex
+		std::vector<Scalar>		m_triangleTexcoords;	//6 values per triangle, u and v per vertex
+
+		//Boxes
+		std::vector<Scalar>		m_boxMin;				//3 values per box
+		std::vector<Scalar>		m_boxMax;				//3 values per box
+		std::vector<Box*>		m_transformedBoxes;		//the box itself if it is transformed, null if it is axis-aligned
+
+		//Meshes keep their own shared vertex arrays and BVH and are intersected through the mesh itself
+		std::vector<Mesh*>		m_meshes;
+
+		//Instances transform the ray and intersect their shared geometry
+		std::vector<Instance*>	m_instances;
+
+		std::vector<Material*>	m_materials[Primitive::PRIMTYPE_Count];	//material of each primitive by type
+		std::vector<int>		m_order[Primitive::PRIMTYPE_Count];		//position of each primitive in the list of scene objects
+
+	public:
+		PrimitiveStore();
+		~PrimitiveStore();
+
+		//Copy the geometry of the given objects into the store
+		//This assigns every object its index among the objects of the same type
+		void Build(const std::vector<Primitive*>& objects);
+
+		void Clear();
+
+		inline int GetCount(int type)
+		{
+			return (int)m_order[type].size();
+		}
+
+		inline Material* GetMaterial(int type, int index)
+		{
+			return m_materials[type][index];
+		}
+
+		//Returns true if the material of the primitive casts shadows
+		inline bool CastsShadow(int type, int index)
+		{
+			return m_materials[type][index]->CastShadow();
+		}
+
+		inline int GetOrder(int type, int index)
+		{
+			return m_order[type][index];
+		}
+
+		//Returns the hit distance of the ray with the given primitive, or FARFAR_AWAY if the ray misses it
+		//Primitives are intersected one at a time, dispatched on their type by a switch rather than in loops over
+		//each type. The scene BVH visits them nearest leaf first, at most BVH::s_maxLeafSize to a leaf, so there are
+		//no runs of one type long enough to batch without giving up that order. The large homogeneous sets, the
+		//triangles of meshes and instances, are intersected in a loop over the mesh's own arrays and BVH.
+		Scalar Intersect(const PrimRef& ref, Ray& ray);
+
+		//Returns the hit distance of every lane of the packet with the given primitive, FARFAR_AWAY on a miss
+		__m128 IntersectPacket(const PrimRef& ref, const RayPacket& packet);
+
+		//Fill in the point and normal of a hit result whose t, primtype and index are set
+		void CompleteHit(Ray& ray, RayHitResult& result);
+
+		//Compute the texture coordinates of a hit on a plane, sphere or triangle
+		//Returns the world space length of one unit of texture coordinates at the hit, 0 for other primitives
+		Scalar GetTexCoords(const RayHitResult& result, Scalar texcoords[2]);
+};
@@ -13,7 +13,8 @@ RayHitResult Ray::s_defaultHitResult;
 
 Ray::Ray()
 {
-	s_defaultHitResult.data = nullptr;
+	s_defaultHitResult.primtype = PRIMTYPE_NONE;
+	s_defaultHitResult.index = -1;
 	s_defaultHitResult.t = FARFAR_AWAY;
 }
 
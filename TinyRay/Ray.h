@@ -11,15 +11,17 @@
 
 #include "Vector3.h"
 
-#define FARFAR_AWAY  1000000.0			//let's hope this is reasonably large ;)
+#define FARFAR_AWAY  ((Scalar)1000000.0)	//let's hope this is reasonably large ;)
+#define PRIMTYPE_NONE -1				//primitive type of a hit result that did not hit anything
 
 //A basic struct for recording a ray hit result
 struct RayHitResult
 {
 	Vector3	normal;			// the surface normal at the intersection ( e.g. useful for lighting);
 	Vector3 point;			// the exact position of the intersection point
-	double t;				//the parametric value of the resulting intersections
-	void* data;				//a pointer to misc. data, e.g. this could be material data for calculating lighting; or the hit object itself
+	Scalar t;				//the parametric value of the resulting intersections
+	int primtype;			//the Primitive::PRIMTYPE of the hit object, PRIMTYPE_NONE if nothing was hit
+	int index;				//the index of the hit object among the scene objects of the same primitive type
 };
 
 class Ray
@@ -0,0 +1,49 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include "RayPacket.h"
+
+void RayPacket::SetRays(Ray* rays, int count)
+{
+	float o[3][RAYPACKET_SIZE];
+	float d[3][RAYPACKET_SIZE];
+	float inv[3][RAYPACKET_SIZE];
+	int mask[RAYPACKET_SIZE];
+
+	for (int lane = 0; lane < RAYPACKET_SIZE; lane++)
+	{
+		//Inactive lanes repeat the first ray so that they never produce NaNs
+		Ray& ray = rays[lane < count ? lane : 0];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			o[axis][lane] = ray.GetRayStart()[axis];
+			d[axis][lane] = ray.GetRay()[axis];
+
+			//Avoid a division by zero for axis-parallel rays
+			float dir = d[axis][lane];
+			if (fabsf(dir) < 1e-20f) dir = dir < 0.0f ? -1e-20f : 1e-20f;
+			inv[axis][lane] = 1.0f / dir;
+		}
+
+		mask[lane] = lane < count ? -1 : 0;
+	}
+
+	ox = _mm_loadu_ps(o[0]);
+	oy = _mm_loadu_ps(o[1]);
+	oz = _mm_loadu_ps(o[2]);
+	dx = _mm_loadu_ps(d[0]);
+	dy = _mm_loadu_ps(d[1]);
+	dz = _mm_loadu_ps(d[2]);
+	invdx = _mm_loadu_ps(inv[0]);
+	invdy = _mm_loadu_ps(inv[1]);
+	invdz = _mm_loadu_ps(inv[2]);
+	active = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)mask));
+}
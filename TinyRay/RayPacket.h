@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <immintrin.h>
+#include "Ray.h"
+
+#define RAYPACKET_SIZE 4				//number of rays traced together, one per SSE lane
+
+//A packet of rays stored as a structure of arrays, so that one SSE
+//instruction processes the same step of every ray in the packet
+struct RayPacket
+{
+	__m128		ox, oy, oz;				//origins of the rays
+	__m128		dx, dy, dz;				//directions of the rays
+	__m128		invdx, invdy, invdz;	//reciprocal directions used by slab tests
+	__m128		active;					//lane mask, all bits are set for the lanes carrying a ray
+
+	//Load up to RAYPACKET_SIZE rays into the packet, lanes from count onwards are inactive
+	void		SetRays(Ray* rays, int count);
+};
+
+//Per lane select, returns the lanes of a where mask is set and the lanes of b elsewhere
+inline __m128 PacketSelect(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+//Per lane dot product of two vectors stored as structure of arrays
+inline __m128 PacketDot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <omp.h>
 
 
 #if defined(WIN32) || defined(_WINDOWS)
@@ -22,15 +23,39 @@
 #include <OpenGL/gl.h>
 #endif
 
+#include <float.h>
 #include "RayTracer.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "Camera.h"
+#include "Frustum.h"
 
 RayTracer::RayTracer()
 {
 	m_buffHeight = m_buffWidth = 0.0;
 	m_renderCount = 0;
+	m_packetTracing = false;
+	m_tileSize = 0;
+	m_tileOrder = TILE_ORDER_HILBERT;
+	m_renderTime = 0.0;
+	m_shadowCaching = true;
+	m_progressive = false;
+	m_adaptive = false;
+	m_adaptiveThreshold = 0.05f;
+	m_reprojection = false;
+	m_reshadeEnabled = true;
+	m_reshading = false;
+	m_gbufferValid = false;
+	m_gbufferComplete = false;
+	m_gbufferScene = nullptr;
+	m_gbufferSceneVersion = 0;
+	m_reprojectionStats.reused = 0;
+	m_reprojectionStats.retraced = 0;
+	m_wavefront = false;
+	m_raySorting = false;
+	m_frustumCulling = false;
+	m_pixelSpread = 0;
+	m_wavefrontStats = WavefrontStats();
 	SetTraceLevel(5);
 	m_traceflag = (TraceFlags)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC |
 		TRACE_SHADOW | TRACE_REFLECTION | TRACE_REFRACTION);
@@ -42,6 +67,28 @@ RayTracer::RayTracer(int Width, int Height)
 	m_buffWidth = Width;
 	m_buffHeight = Height;
 	m_renderCount = 0;
+	m_packetTracing = false;
+	m_tileSize = 0;
+	m_tileOrder = TILE_ORDER_HILBERT;
+	m_renderTime = 0.0;
+	m_shadowCaching = true;
+	m_progressive = false;
+	m_adaptive = false;
+	m_adaptiveThreshold = 0.05f;
+	m_reprojection = false;
+	m_reshadeEnabled = true;
+	m_reshading = false;
+	m_gbufferValid = false;
+	m_gbufferComplete = false;
+	m_gbufferScene = nullptr;
+	m_gbufferSceneVersion = 0;
+	m_reprojectionStats.reused = 0;
+	m_reprojectionStats.retraced = 0;
+	m_wavefront = false;
+	m_raySorting = false;
+	m_frustumCulling = false;
+	m_pixelSpread = 0;
+	m_wavefrontStats = WavefrontStats();
 	SetTraceLevel(5);
 
 	m_framebuffer = new Framebuffer(Width, Height);
@@ -65,101 +112,1082 @@ void RayTracer::DoRayTrace(Scene* pScene)
 	Vector3 centre = cam->GetViewCentre();
 	Vector3 camPosition = cam->GetPosition();
 
-	double sceneWidth = pScene->GetSceneWidth();
-	double sceneHeight = pScene->GetSceneHeight();
+	Scalar sceneWidth = (Scalar)pScene->GetSceneWidth();
+	Scalar sceneHeight = (Scalar)pScene->GetSceneHeight();
 
-	double pixelDX = sceneWidth / m_buffWidth;
-	double pixelDY = sceneHeight / m_buffHeight;
+	Scalar pixelDX = sceneWidth / m_buffWidth;
+	Scalar pixelDY = sceneHeight / m_buffHeight;
 
-	int total = m_buffHeight * m_buffWidth;
-	int done_count = 0;
+	m_pixelSpread = pixelDY / (Scalar)cam->GetFocalLength();
 
 	Vector3 start;
 
 	start[0] = centre[0] - ((sceneWidth * camRightVector[0])
-		+ (sceneHeight * camUpVector[0])) / 2.0;
+		+ (sceneHeight * camUpVector[0])) / 2;
 	start[1] = centre[1] - ((sceneWidth * camRightVector[1])
-		+ (sceneHeight * camUpVector[1])) / 2.0;
+		+ (sceneHeight * camUpVector[1])) / 2;
 	start[2] = centre[2] - ((sceneWidth * camRightVector[2])
-		+ (sceneHeight * camUpVector[2])) / 2.0;
+		+ (sceneHeight * camUpVector[2])) / 2;
 
 	Colour scenebg = pScene->GetBackgroundColour();
 
+	//Returns the point (x, y) of the view plane in pixel units, (j + 0.5, i + 0.5) is the centre of pixel (j, i)
+	auto view_plane_point = [&](Scalar y, Scalar x)
+	{
+		//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
+		Vector3 pixel;
+
+		pixel[0] = start[0] + y * camUpVector[0] * pixelDY
+			+ x * camRightVector[0] * pixelDX;
+		pixel[1] = start[1] + y * camUpVector[1] * pixelDY
+			+ x * camRightVector[1] * pixelDX;
+		pixel[2] = start[2] + y * camUpVector[2] * pixelDY
+			+ x * camRightVector[2] * pixelDX;
+
+		return pixel;
+	};
+
+	//Set up the first generation view ray through the point (x, y) of the view plane in pixel units
+	auto setup_view_ray = [&](Scalar y, Scalar x, Ray& viewray)
+	{
+		Vector3 pixel = view_plane_point(y, x);
+
+		/*
+		* setup first generation view ray
+		* In perspective projection, each view ray originates from the eye (camera) position
+		* and pierces through a pixel in the view plane
+		*/
+		viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
+	};
+
+	//Tiled rendering can cull the objects outside the frustum of each tile, the primary rays of a tile
+	//are then only intersected with the BVH nodes that remain for the thread tracing it
+	bool culling = m_frustumCulling && m_tileSize > 0;
+
+	auto cull_tile = [&](const Tile& tile)
+	{
+		Vector3 corners[4] = { view_plane_point((Scalar)tile.y0, (Scalar)tile.x0), view_plane_point((Scalar)tile.y0, (Scalar)tile.x1),
+			view_plane_point((Scalar)tile.y1, (Scalar)tile.x1), view_plane_point((Scalar)tile.y1, (Scalar)tile.x0) };
+
+		Frustum frustum;
+		frustum.Set(camPosition, corners);
+
+		ThreadCulling& state = m_culling[omp_get_thread_num()];
+		state.stats.objects += pScene->CullFrustum(frustum, state.nodes);
+		state.stats.tiles++;
+	};
+
+	auto intersect_primary = [&](Ray& viewray)
+	{
+		return culling ? pScene->IntersectByRay(viewray, m_culling[omp_get_thread_num()].nodes) : pScene->IntersectByRay(viewray);
+	};
+
+	//Returns the colour of the primary ray through the point (x, y) of the view plane,
+	//hit receives the closest intersection of the primary ray
+	auto shade_sample = [&](Scalar y, Scalar x, RayHitResult& hit)
+	{
+		Ray viewray;
+		setup_view_ray(y, x, viewray);
+
+		hit = Ray::s_defaultHitResult;
+
+		if (m_traceLevel <= 0)
+			return scenebg;
+
+		GetThreadRayCounts().primary++;
+
+		//trace the scene using the view ray, as TraceScene does
+		//default colour is the background colour, unless something is hit along the way
+		hit = intersect_primary(viewray);
+		return ShadeHit(pScene, viewray, hit, scenebg, m_traceLevel);
+	};
+
+	//Returns the colour of the primary ray through the centre of pixel (j, i)
+	//When reshading, the primary hit comes from the G-buffer and only the secondary rays are traced
+	auto shade_pixel = [&](int i, int j, RayHitResult& hit)
+	{
+		if (!m_reshading)
+			return shade_sample(i + (Scalar)0.5, j + (Scalar)0.5, hit);
+
+		Ray viewray;
+		setup_view_ray(i + (Scalar)0.5, j + (Scalar)0.5, viewray);
+
+		hit = m_gbuffer.GetSample(j, i).hit;
+
+		if (m_traceLevel <= 0)
+			return scenebg;
+
+		return ShadeHit(pScene, viewray, hit, scenebg, m_traceLevel);
+	};
+
+	//Keep the primary hit of every pixel centre in the G-buffer
+	auto record_pixel = [&](const RayHitResult& hit, int x, int y)
+	{
+		RecordGBufferSample(pScene, hit, x, y);
+	};
+
+	//Progressive and adaptive rendering add up the samples of each pixel in the accumulation buffer
+	bool accumulate = m_progressive || m_adaptive;
+
+	auto write_pixel = [&](const Colour& colour, int x, int y)
+	{
+		if (accumulate)
+			m_framebuffer->AccumulateRGB(colour, x, y);
+		else
+			m_framebuffer->WriteRGBToFramebuffer(colour, x, y);
+	};
+
+	//Trace the primary ray of pixel (j, i)
+	auto trace_pixel = [&](int i, int j)
+	{
+		RayHitResult hit;
+
+		/*
+		* Draw the pixel as a coloured rectangle
+		*/
+		write_pixel(shade_pixel(i, j, hit), j, i);
+		record_pixel(hit, j, i);
+	};
+
+	//Trace the primary rays of the 2x2 pixel block at (j, i) together, the coherent rays of a block
+	//share the BVH traversal. Secondary rays are traced one at a time from each hit.
+	auto trace_block = [&](int i, int j)
+	{
+		Ray viewrays[RAYPACKET_SIZE];
+		RayHitResult results[RAYPACKET_SIZE];
+		int pixel_x[RAYPACKET_SIZE];
+		int pixel_y[RAYPACKET_SIZE];
+		int count = 0;
+
+		for (int k = 0; k < RAYPACKET_SIZE; k++)
+		{
+			int y = i + k / 2;
+			int x = j + k % 2;
+
+			if (y >= m_buffHeight || x >= m_buffWidth) continue;
+
+			setup_view_ray(y + (Scalar)0.5, x + (Scalar)0.5, viewrays[count]);
+			pixel_x[count] = x;
+			pixel_y[count] = y;
+			count++;
+		}
+
+		RayPacket packet;
+		packet.SetRays(viewrays, count);
+
+		if (m_traceLevel > 0)
+		{
+			if (culling)
+				pScene->IntersectByPacket(packet, viewrays, results, m_culling[omp_get_thread_num()].nodes);
+			else
+				pScene->IntersectByPacket(packet, viewrays, results);
+
+			GetThreadRayCounts().primary += count;
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			Colour colour = m_traceLevel > 0 ?
+				ShadeHit(pScene, viewrays[k], results[k], scenebg, m_traceLevel) : scenebg;
+
+			write_pixel(colour, pixel_x[k], pixel_y[k]);
+			record_pixel(m_traceLevel > 0 ? results[k] : Ray::s_defaultHitResult, pixel_x[k], pixel_y[k]);
+		}
+	};
+
+	//The passes that trace every pixel once come first, the adaptive sampling passes follow them
+	int base_passes = m_progressive ? s_progressivePasses : 1;
+	bool adaptive_pass = m_renderCount >= base_passes;
+	int adaptive_round = m_renderCount - base_passes;
+
+	//Side of the cells of the current progressive pass, the pass traces one pixel per cell
+	int cell = m_progressive && !adaptive_pass ? s_progressiveCell >> m_renderCount : 1;
+
+	//Trace pixel (j, i) of the current pass, the pixel is a corner of a cell.
+	//Corners shared with the coarser cells of the previous passes are already done.
+	//The pixel fills its cell so that a complete image can be shown after every pass.
+	auto trace_progressive = [&](int i, int j)
+	{
+		if (m_renderCount > 0 && i % (2 * cell) == 0 && j % (2 * cell) == 0)
+			return;
+
+		RayHitResult hit;
+		Colour colour = shade_pixel(i, j, hit);
+
+		if (cell > 1)
+			m_framebuffer->FillRGB(colour, j, i, j + cell, i + cell);
+
+		m_framebuffer->AccumulateRGB(colour, j, i);
+		record_pixel(hit, j, i);
+	};
+
+	//Add the subpixel samples of the current adaptive round to pixel (j, i) if it was selected for refinement
+	auto trace_refine = [&](int i, int j)
+	{
+		if (!m_refineMask[i * m_buffWidth + j])
+			return;
+
+		for (int k = 0; k < s_adaptiveSamples; k++)
+		{
+			const float* offset = s_subpixelOffsets[adaptive_round][k];
+			RayHitResult hit;
+			m_framebuffer->AccumulateRGB(shade_sample(i + (Scalar)offset[1], j + (Scalar)offset[0], hit), j, i);
+		}
+	};
+
+	//The view of this frame, the G-buffer can be reused if it was recorded from the same view or reprojected otherwise
+	ViewState view;
+	view.position = camPosition;
+	view.up = camUpVector;
+	view.right = camRightVector;
+	view.view = camViewVector;
+	view.centre = centre;
+	view.width = sceneWidth;
+	view.height = sceneHeight;
+
 	if (m_renderCount == 0)
 	{
-		fprintf(stdout, "Trace start.\n");
-
-		Colour colour;
-		//TinyRay on multiprocessors using OpenMP!!!
-#pragma omp parallel for schedule (dynamic, 1) private(colour)
-		for (int i = 0; i < m_buffHeight; i += 1) {
-			for (int j = 0; j < m_buffWidth; j += 1) {
-
-				//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
-				Vector3 pixel;
-
-				pixel[0] = start[0] + (i + 0.5) * camUpVector[0] * pixelDY
-					+ (j + 0.5) * camRightVector[0] * pixelDX;
-				pixel[1] = start[1] + (i + 0.5) * camUpVector[1] * pixelDY
-					+ (j + 0.5) * camRightVector[1] * pixelDX;
-				pixel[2] = start[2] + (i + 0.5) * camUpVector[2] * pixelDY
-					+ (j + 0.5) * camRightVector[2] * pixelDX;
-
-				/*
-				* setup first generation view ray
-				* In perspective projection, each view ray originates from the eye (camera) position
-				* and pierces through a pixel in the view plane
-				*/
-				Ray viewray;
-				viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
-
-				double u = (double)j / (double)m_buffWidth;
-				double v = (double)i / (double)m_buffHeight;
-
-				scenebg = pScene->GetBackgroundColour();
-
-				//trace the scene using the view ray
-				//default colour is the background colour, unless something is hit along the way
-				colour = this->TraceScene(pScene, viewray, scenebg, m_traceLevel);
-
-				/*
-				* Draw the pixel as a coloured rectangle
-				*/
-				m_framebuffer->WriteRGBToFramebuffer(colour, j, i);
+		//Only the trace flags, trace level or lights can have changed since the G-buffer was recorded
+		m_reshading = m_reshadeEnabled && m_gbufferComplete && pScene == m_gbufferScene
+			&& pScene->GetVersion() == m_gbufferSceneVersion && IsSameView(view, m_gbufferView);
+	}
+
+	//The camera moved, but the shading of the last single sample frame can be moved along with it
+	bool reproject = m_renderCount == 0 && !m_reshading && m_reprojection && !m_progressive && !m_adaptive
+		&& m_gbufferValid && pScene == m_gbufferScene && pScene->GetVersion() == m_gbufferSceneVersion
+		&& m_gbufferFlags == m_traceflag && m_gbufferTraceLevel == m_traceLevel;
+
+	//Packets cover 2x2 pixels, tiles always have an even size
+	//Progressive passes visit the corner of every cell
+	//Reprojected frames only trace the pixels that could not be reused, reshaded frames have no primary rays to share
+	int step = adaptive_pass || reproject ? 1 : m_progressive ? cell : m_packetTracing && !m_reshading ? 2 : 1;
+
+	//The passes that trace every pixel centre once can run breadth first, reprojection only retraces scattered pixels
+	bool wavefront = m_wavefront && !m_progressive && !adaptive_pass && !reproject;
+
+	auto trace = [&](int i, int j)
+	{
+		if (reproject)
+		{
+			if (m_retraceMask[i * m_buffWidth + j])
+				trace_pixel(i, j);
+		}
+		else if (adaptive_pass)
+			trace_refine(i, j);
+		else if (m_progressive)
+			trace_progressive(i, j);
+		else if (m_packetTracing && !m_reshading)
+			trace_block(i, j);
+		else
+			trace_pixel(i, j);
+	};
+
+	if (m_renderCount < GetPassCount())
+	{
+		double start_time = omp_get_wtime();
+
+		if (m_renderCount == 0)
+		{
+			fprintf(stdout, "Trace start%s%s%s.\n", m_progressive ? " (progressive)" : wavefront ? " (wavefront)" : m_packetTracing ? " (packets)" : "",
+				m_adaptive ? " (adaptive)" : "", m_reshading ? " (reshading cached primary hits)" : "");
+
+			m_renderTime = 0.0;
+			m_wavefrontStats = WavefrontStats();
+
+			ThreadRayCounts zero_counts = {};
+			m_rayCounts.assign(omp_get_max_threads(), zero_counts);
+
+			//Start every render with empty shadow caches, the scene may have changed since the last one
+			PrimitiveStore::PrimRef no_occluder = { PRIMTYPE_NONE, -1 };
+			m_shadowCaches.resize(omp_get_max_threads());
+			for (size_t i = 0; i < m_shadowCaches.size(); i++)
+			{
+				m_shadowCaches[i].occluders.assign(pScene->GetLightList()->size(), no_occluder);
+				m_shadowCaches[i].stats = ShadowCacheStats();
+			}
+
+			if (accumulate)
+				m_framebuffer->ClearAccumulation();
+
+			m_culling.resize(omp_get_max_threads());
+			for (size_t i = 0; i < m_culling.size(); i++)
+			{
+				m_culling[i].stats = CullingStats();
+				m_culling[i].stats.sceneObjects = pScene->GetBoundedObjectCount();
+			}
+		}
+
+		int refined = adaptive_pass ? BuildRefineMask(adaptive_round) : 0;
+
+		if (reproject)
+		{
+			m_reprojectionStats.reused = ReprojectPreviousFrame(view);
+			m_reprojectionStats.retraced = m_buffWidth * m_buffHeight - m_reprojectionStats.reused;
+		}
+		else if (m_renderCount == 0)
+		{
+			m_reprojectionStats.reused = 0;
+			m_reprojectionStats.retraced = m_buffWidth * m_buffHeight;
+
+			if (!m_reshading)
+				m_gbuffer.Resize(m_buffWidth, m_buffHeight);
+		}
+
+		//The G-buffer is rewritten from here on, it is only usable again once every pixel centre has been traced
+		if (m_renderCount == 0 && !m_reshading)
+		{
+			m_gbufferComplete = false;
+			m_gbufferValid = false;
+		}
+
+		if (wavefront)
+		{
+			TraceWavefront(pScene, scenebg,
+				[&](int i, int j, Ray& viewray) { setup_view_ray(i + (Scalar)0.5, j + (Scalar)0.5, viewray); },
+				write_pixel);
+		}
+		else if (m_tileSize > 0)
+		{
+			m_tileScheduler.Setup(m_buffWidth, m_buffHeight, m_tileSize, m_tileOrder);
+			m_tileScheduler.Run([&](const Tile& tile)
+			{
+				if (culling)
+					cull_tile(tile);
+
+				//Start at the first multiple of step inside the tile
+				for (int i = (tile.y0 + step - 1) / step * step; i < tile.y1; i += step) {
+					for (int j = (tile.x0 + step - 1) / step * step; j < tile.x1; j += step) {
+						trace(i, j);
+					}
+				}
+			});
+		}
+		else
+		{
+			//TinyRay on multiprocessors using OpenMP!!!
+#pragma omp parallel for schedule (dynamic, 1)
+			for (int i = 0; i < m_buffHeight; i += step) {
+				for (int j = 0; j < m_buffWidth; j += step) {
+					trace(i, j);
+				}
 			}
 		}
 
-		fprintf(stdout, "Done!!!\n");
+		double pass_time = (omp_get_wtime() - start_time) * 1000.0;
+		m_renderTime += pass_time;
 		m_renderCount++;
+
+		//Every pixel centre has been shaded once the passes before adaptive sampling are done
+		if (m_renderCount == base_passes)
+		{
+			//Reprojected pixels hold the hits of other rays, and nothing is intersected at trace level 0
+			m_gbufferComplete = m_reshading || (!reproject && m_traceLevel > 0);
+			m_gbufferValid = !m_adaptive;
+			m_gbufferFlags = m_traceflag;
+			m_gbufferTraceLevel = m_traceLevel;
+			m_gbufferView = view;
+			m_gbufferScene = pScene;
+			m_gbufferSceneVersion = pScene->GetVersion();
+		}
+
+		if (reproject)
+			fprintf(stdout, "Reprojected the previous frame, %d pixels reused, %d retraced\n",
+				m_reprojectionStats.reused, m_reprojectionStats.retraced);
+
+		if (adaptive_pass)
+			fprintf(stdout, "Adaptive pass %d of %d done, %.2f ms (%d pixels refined)\n", adaptive_round + 1, s_adaptiveRounds, pass_time, refined);
+		else if (m_renderCount < GetPassCount())
+			fprintf(stdout, "Pass %d of %d done, %.2f ms (%dx%d cells)\n", m_renderCount, GetPassCount(), pass_time, cell, cell);
+
+		if (m_renderCount < GetPassCount())
+			return;
+
+		double render_time = m_renderTime;
+		double pixel_rate = m_buffWidth * m_buffHeight / (render_time * 1000.0);
+
+		if (wavefront)
+		{
+			fprintf(stdout, "Done!!! %.2f ms, %.3f Mpixels/s (wavefront: %d generations, %lld rays)\n",
+				render_time, pixel_rate, m_wavefrontStats.generations, m_wavefrontStats.rays);
+		}
+		else if (m_tileSize > 0)
+		{
+			const TileScheduler::Stats& stats = m_tileScheduler.GetStats();
+			fprintf(stdout, "Done!!! %.2f ms, %.3f Mpixels/s (%dx%d %s tiles: %d tiles, %d stolen, %d threads)\n",
+				render_time, pixel_rate, m_tileSize, m_tileSize, TileScheduler::GetOrderName(m_tileOrder),
+				stats.tileCount, stats.stolenCount, stats.threadCount);
+		}
+		else
+		{
+			fprintf(stdout, "Done!!! %.2f ms, %.3f Mpixels/s (rows)\n", render_time, pixel_rate);
+		}
 	}
 }
 
-Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray)
+const float RayTracer::s_reprojectionTolerance = 0.02f;
+
+template<typename ViewRayFn, typename WriteFn>
+void RayTracer::TraceWavefront(Scene* pScene, const Colour& background, ViewRayFn setupViewRay, WriteFn writePixel)
 {
-	RayHitResult result;
+	int pixel_count = m_buffWidth * m_buffHeight;
+	std::vector<Light*>* light_list = pScene->GetLightList();
+	int light_count = (int)light_list->size();
+	bool reflect = (m_traceflag & TRACE_REFLECTION) != 0;
+	bool refract = (m_traceflag & TRACE_REFRACTION) != 0;
+	AABB scene_bounds = pScene->GetBounds();
 
-	Colour outcolour = incolour; //the output colour based on the ray-primitive intersection
+	double stage_start = omp_get_wtime();
 
-	//obtain the list of light sources from the scene
-	std::vector<Light*> *light_list = pScene->GetLightList();
+	//Returns the time of the stage in milliseconds
+	auto end_stage = [&](WavefrontStage stage)
+	{
+		double now = omp_get_wtime();
+		double time = (now - stage_start) * 1000.0;
+		m_wavefrontStats.stageTime[stage] += time;
+		stage_start = now;
+		return time;
+	};
+
+	//Generate the primary ray of every pixel centre, ray k is pixel k of the framebuffer
+	m_wavefrontRays.resize(pixel_count);
+
+#pragma omp parallel for schedule (static)
+	for (int i = 0; i < m_buffHeight; i++)
+	{
+		for (int j = 0; j < m_buffWidth; j++)
+		{
+			WavefrontRay& wray = m_wavefrontRays[i * m_buffWidth + j];
+			setupViewRay(i, j, wray.ray);
+			wray.incolour = background;
+			wray.tracelevel = m_traceLevel;
+		}
+	}
+
+	end_stage(WAVEFRONT_GENERATE);
+
+	int generation = 0;
+
+	for (; !m_wavefrontRays.empty(); generation++)
+	{
+		int ray_count = (int)m_wavefrontRays.size();
+
+		if ((int)m_wavefrontNodes.size() <= generation)
+			m_wavefrontNodes.resize(generation + 1);
+
+		std::vector<WavefrontNode>& nodes = m_wavefrontNodes[generation];
+		nodes.resize(ray_count);
+		m_wavefrontStats.rays += ray_count;
+
+		//Intersect, a reshaded frame takes the primary hits from the G-buffer
+		bool reuse_hits = generation == 0 && m_reshading;
+
+		if (m_packetTracing && !reuse_hits && m_traceLevel > 0)
+		{
+			int packet_count = (ray_count + RAYPACKET_SIZE - 1) / RAYPACKET_SIZE;
+
+#pragma omp parallel for schedule (dynamic, 64)
+			for (int p = 0; p < packet_count; p++)
+			{
+				Ray rays[RAYPACKET_SIZE];
+				RayHitResult results[RAYPACKET_SIZE];
+				int first = p * RAYPACKET_SIZE;
+				int count = ray_count - first < RAYPACKET_SIZE ? ray_count - first : RAYPACKET_SIZE;
+
+				for (int k = 0; k < count; k++)
+					rays[k] = m_wavefrontRays[first + k].ray;
+
+				RayPacket packet;
+				packet.SetRays(rays, count);
+				pScene->IntersectByPacket(packet, rays, results);
+
+				for (int k = 0; k < count; k++)
+					m_wavefrontRays[first + k].hit = results[k];
+
+				if (generation == 0) GetThreadRayCounts().primary += count;
+			}
+		}
+		else
+		{
+#pragma omp parallel for schedule (dynamic, 256)
+			for (int k = 0; k < ray_count; k++)
+			{
+				WavefrontRay& wray = m_wavefrontRays[k];
+
+				if (reuse_hits)
+					wray.hit = m_gbuffer.GetSample(k).hit;
+				else if (wray.tracelevel <= 0)
+					wray.hit = Ray::s_defaultHitResult;
+				else
+				{
+					if (generation == 0) GetThreadRayCounts().primary++;
+					wray.hit = pScene->IntersectByRay(wray.ray);
+				}
+			}
+		}
+
+		double intersect_time = end_stage(WAVEFRONT_INTERSECT);
+
+		if (generation > 0)
+		{
+			m_wavefrontStats.secondaryRays += ray_count;
+			m_wavefrontStats.secondaryIntersectTime += intersect_time;
+		}
+
+		//Shade, as ShadeHit does before tracing any secondary rays
+#pragma omp parallel for schedule (dynamic, 256)
+		for (int k = 0; k < ray_count; k++)
+		{
+			WavefrontRay& wray = m_wavefrontRays[k];
+			WavefrontNode& node = nodes[k];
+
+			node.hit = wray.tracelevel > 0 && wray.hit.primtype != PRIMTYPE_NONE;
+			node.secondary = node.hit && HitSphereOrBox(wray.hit);
+			node.children[0] = node.children[1] = -1;
+			node.shadowCount = 0;
+
+			if (node.hit)
+			{
+				Vector3 start = wray.ray.GetRayStart();
+				node.lighting = CalculateLighting(pScene, light_list, &start, &wray.hit, pScene->GetMaterial(wray.hit));
+			}
+			else
+			{
+				node.lighting = wray.incolour;
+			}
+
+			if (generation == 0)
+				RecordGBufferSample(pScene, wray.hit, k % m_buffWidth, k / m_buffWidth);
+		}
+
+		end_stage(WAVEFRONT_SHADE);
+
+		//Spawn the reflection and refraction rays of the hits on spheres and boxes. Rays at trace level 1
+		//spawn nothing, TraceScene would return their own lighting as the colour of the secondary rays.
+		m_wavefrontOffsets.resize(ray_count + 1);
+		m_wavefrontOffsets[0] = 0;
+
+		for (int k = 0; k < ray_count; k++)
+		{
+			int spawned = nodes[k].secondary && m_wavefrontRays[k].tracelevel > 1 ? reflect + refract : 0;
+			m_wavefrontOffsets[k + 1] = m_wavefrontOffsets[k] + spawned;
+		}
 
+		int spawn_count = m_wavefrontOffsets[ray_count];
+		m_wavefrontSpawned.resize(spawn_count);
+
+		//Counting the rays to spawn is part of spawning them, only the binning below is sorting
+		end_stage(WAVEFRONT_SPAWN);
+
+		//Direction of reflection (c = 0) or refraction (c = 1) ray from the hit of a ray
+		auto secondary_vector = [&](WavefrontRay& wray, int c)
+		{
+			return c == 0 ? wray.ray.GetRay().Reflect(wray.hit.normal) : wray.ray.GetRay().Refract(wray.hit.normal, (Scalar)0.9);
+		};
+
+		//Sort the rays to spawn into bins so that they are written to the next generation bin by bin
+		if (m_raySorting && spawn_count > 0)
+		{
+			m_wavefrontKeys.resize(spawn_count);
+
+#pragma omp parallel for schedule (dynamic, 256)
+			for (int k = 0; k < ray_count; k++)
+			{
+				int next = m_wavefrontOffsets[k];
+
+				for (int c = 0; c < 2 && next < m_wavefrontOffsets[k + 1]; c++)
+				{
+					if (!(c == 0 ? reflect : refract)) continue;
+
+					m_wavefrontKeys[next++] = GetRayBin(m_wavefrontRays[k].hit.point, secondary_vector(m_wavefrontRays[k], c), scene_bounds);
+				}
+			}
+
+			BinWavefrontRays(spawn_count);
+		}
+
+		end_stage(WAVEFRONT_SORT);
+
+#pragma omp parallel for schedule (dynamic, 256)
+		for (int k = 0; k < ray_count; k++)
+		{
+			int next = m_wavefrontOffsets[k];
+			if (next == m_wavefrontOffsets[k + 1]) continue;
+
+			WavefrontRay& wray = m_wavefrontRays[k];
+			WavefrontNode& node = nodes[k];
+
+			for (int c = 0; c < 2; c++)
+			{
+				if (!(c == 0 ? reflect : refract)) continue;
+
+				Vector3 vector = secondary_vector(wray, c);
+
+				if (c == 0)
+					GetThreadRayCounts().reflection++;
+				else
+					GetThreadRayCounts().refraction++;
+
+				int position = m_raySorting ? m_wavefrontMoves[next] : next;
+				next++;
+
+				//As TraceReflectRefract sets up the ray
+				WavefrontRay& child = m_wavefrontSpawned[position];
+				Vector3 start_point = wray.hit.point + (vector * RAY_EPSILON);
+				child.ray.SetRay(start_point, vector);
+				child.incolour = node.lighting;
+				child.tracelevel = wray.tracelevel - 1;
+				node.children[c] = position;
+			}
+		}
+
+		end_stage(WAVEFRONT_SPAWN);
+
+		//Shadow rays from every hit to every light
+		if (m_traceflag & TRACE_SHADOW)
+		{
+#pragma omp parallel for schedule (dynamic, 256)
+			for (int k = 0; k < ray_count; k++)
+			{
+				if (!nodes[k].hit) continue;
+
+				for (int light = 0; light < light_count; light++)
+				{
+					if (TraceShadowRay(pScene, m_wavefrontRays[k].hit, light))
+						nodes[k].shadowCount++;
+				}
+			}
+		}
+
+		end_stage(WAVEFRONT_SHADOW);
+
+		//Coherence of the next generation as it will be intersected, weighted by its number of rays
+		if (spawn_count > 0)
+			m_wavefrontStats.coherence += GetDirectionCoherence(m_wavefrontSpawned) * spawn_count;
+
+		end_stage(WAVEFRONT_COHERENCE);
+
+		m_wavefrontRays.swap(m_wavefrontSpawned);
+	}
+
+	m_wavefrontStats.generations = generation;
+
+	if (m_wavefrontStats.secondaryRays > 0)
+		m_wavefrontStats.coherence /= m_wavefrontStats.secondaryRays;
+
+	//Resolve the colours from the last generation back, combining them in the same order as ShadeHit
+	for (int g = generation - 1; g >= 0; g--)
+	{
+		std::vector<WavefrontNode>& nodes = m_wavefrontNodes[g];
+		int node_count = (int)nodes.size();
+
+#pragma omp parallel for schedule (dynamic, 256)
+		for (int k = 0; k < node_count; k++)
+		{
+			WavefrontNode& node = nodes[k];
+			Colour outcolour = node.lighting;
+
+			if (node.hit)
+			{
+				if (node.secondary)
+				{
+					if (reflect)
+						outcolour = outcolour * (node.children[0] >= 0 ? m_wavefrontNodes[g + 1][node.children[0]].colour : node.lighting);
+
+					if (refract)
+						outcolour = (outcolour + (node.children[1] >= 0 ? m_wavefrontNodes[g + 1][node.children[1]].colour : node.lighting)) * .5;
+				}
+
+				for (int s = 0; s < node.shadowCount; s++)
+					outcolour = outcolour * Colour(0.25, 0.25, 0.25);
+			}
+
+			node.colour = outcolour;
+		}
+	}
+
+#pragma omp parallel for schedule (static)
+	for (int k = 0; k < pixel_count; k++)
+		writePixel(m_wavefrontNodes[0][k].colour, k % m_buffWidth, k / m_buffWidth);
+
+	end_stage(WAVEFRONT_RESOLVE);
+}
+
+const char* RayTracer::GetWavefrontStageName(int stage)
+{
+	static const char* names[WAVEFRONT_STAGE_COUNT] = { "generate", "intersect", "shade", "sort", "spawn", "shadow", "coherence", "resolve" };
+
+	return stage >= 0 && stage < WAVEFRONT_STAGE_COUNT ? names[stage] : "";
+}
+
+//Interleave the low 10 bits of x, y and z, x in the lowest bit
+static unsigned int MortonKey3(unsigned int x, unsigned int y, unsigned int z)
+{
+	unsigned int key = 0;
+
+	for (int bit = 0; bit < 10; bit++)
+	{
+		key |= ((x >> bit) & 1) << (3 * bit);
+		key |= ((y >> bit) & 1) << (3 * bit + 1);
+		key |= ((z >> bit) & 1) << (3 * bit + 2);
+	}
+
+	return key;
+}
+
+unsigned int RayTracer::GetRayBin(const Vector3& origin, const Vector3& direction, const AABB& bounds)
+{
+	int cells = 1 << s_sortOriginBits;
+	unsigned int cell[3];
+
+	for (int a = 0; a < 3; a++)
+	{
+		Scalar extent = bounds.GetMax()[a] - bounds.GetMin()[a];
+		int c = extent > 0 ? (int)((origin[a] - bounds.GetMin()[a]) * (cells / extent)) : 0;
+		cell[a] = c < 0 ? 0 : c < cells ? c : cells - 1;
+	}
+
+	unsigned int octant = (direction[0] < 0) | (direction[1] < 0) << 1 | (direction[2] < 0) << 2;
+	return octant << (3 * s_sortOriginBits) | MortonKey3(cell[0], cell[1], cell[2]);
+}
+
+void RayTracer::BinWavefrontRays(int rayCount)
+{
+	int bin_count = 8 << (3 * s_sortOriginBits);
+
+	//Counting sort
+	m_wavefrontBins.assign(bin_count + 1, 0);
+
+	for (int k = 0; k < rayCount; k++)
+		m_wavefrontBins[m_wavefrontKeys[k] + 1]++;
+
+	for (int b = 0; b < bin_count; b++)
+		m_wavefrontBins[b + 1] += m_wavefrontBins[b];
+
+	m_wavefrontMoves.resize(rayCount);
+
+	for (int k = 0; k < rayCount; k++)
+		m_wavefrontMoves[k] = m_wavefrontBins[m_wavefrontKeys[k]]++;
+}
+
+double RayTracer::GetDirectionCoherence(std::vector<WavefrontRay>& rays)
+{
+	int ray_count = (int)rays.size();
+	double sum = 0.0;
+
+	int pair_count = (ray_count - 1 + s_coherenceStride - 1) / s_coherenceStride;
+
+	if (pair_count < 1) return 1.0;
+
+#pragma omp parallel for schedule (static) reduction(+:sum)
+	for (int p = 0; p < pair_count; p++)
+	{
+		int k = 1 + p * s_coherenceStride;
+		sum += rays[k - 1].ray.GetRay().DotProduct(rays[k].ray.GetRay());
+	}
+
+	return sum / pair_count;
+}
+
+//Subpixel positions of the samples added by each adaptive round, three rotated 2x2 grids
+const float RayTracer::s_subpixelOffsets[RayTracer::s_adaptiveRounds][RayTracer::s_adaptiveSamples][2] =
+{
+	{ { 0.25f, 0.25f }, { 0.75f, 0.25f }, { 0.25f, 0.75f }, { 0.75f, 0.75f } },
+	{ { 0.375f, 0.125f }, { 0.875f, 0.375f }, { 0.125f, 0.625f }, { 0.625f, 0.875f } },
+	{ { 0.625f, 0.125f }, { 0.125f, 0.375f }, { 0.875f, 0.625f }, { 0.375f, 0.875f } }
+};
+
+int RayTracer::BuildRefineMask(int round)
+{
+	int refined = 0;
+	Colour* buffer = m_framebuffer->GetBuffer();
+	float threshold = m_adaptiveThreshold;
+
+	m_refineMask.resize(m_buffWidth * m_buffHeight);
+
+#pragma omp parallel for schedule (dynamic, 1) reduction(+:refined)
+	for (int i = 0; i < m_buffHeight; i++)
+	{
+		for (int j = 0; j < m_buffWidth; j++)
+		{
+			bool refine = false;
+
+			if (round == 0)
+			{
+				//Every pixel has one sample, refine where it differs from a neighbour by more than the threshold
+				Colour centre = buffer[i * m_buffWidth + j];
+				static const int neighbours[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+				for (int n = 0; n < 4 && !refine; n++)
+				{
+					int y = i + neighbours[n][0];
+					int x = j + neighbours[n][1];
+					if (y < 0 || y >= m_buffHeight || x < 0 || x >= m_buffWidth) continue;
+
+					Colour diff = buffer[y * m_buffWidth + x] - centre;
+					for (int c = 0; c < 3; c++)
+						refine = refine || fabs(diff[c]) > threshold;
+				}
+			}
+			else
+			{
+				//Keep refining the pixels whose mean is still uncertain, the standard error of the
+				//luminance is above the threshold. Pixels never refined have one sample and no variance.
+				int samples = m_framebuffer->GetSampleCount(j, i);
+				refine = samples > 1 && m_framebuffer->GetLuminanceVariance(j, i) > threshold * threshold * samples;
+			}
+
+			m_refineMask[i * m_buffWidth + j] = refine;
+			refined += refine;
+		}
+	}
+
+	return refined;
+}
+
+void RayTracer::RecordGBufferSample(Scene* pScene, const RayHitResult& hit, int x, int y)
+{
+	GBuffer::Sample& sample = m_gbuffer.GetSample(x, y);
+
+	sample.hit = hit;
+	sample.reusable = false;
+
+	if (hit.primtype == PRIMTYPE_NONE)
+		return;
+
+	//The shading can be reused from another viewpoint unless ShadeHit traces reflections or refractions
+	//from the hit, or the material has a specular highlight
+	bool secondary = HitSphereOrBox(hit) && (m_traceflag & (TRACE_REFLECTION | TRACE_REFRACTION)) && m_traceLevel > 1;
+	bool specular = false;
+
+	if (m_traceflag & TRACE_DIFFUSE_AND_SPEC)
+	{
+		Colour spec = pScene->GetMaterial(hit)->GetSpecularColour();
+		specular = spec[0] > 0 || spec[1] > 0 || spec[2] > 0;
+	}
+
+	sample.reusable = !secondary && !specular;
+}
+
+bool RayTracer::IsSameView(const ViewState& a, const ViewState& b)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (a.position[i] != b.position[i] || a.up[i] != b.up[i] || a.right[i] != b.right[i]
+			|| a.view[i] != b.view[i] || a.centre[i] != b.centre[i])
+			return false;
+	}
+
+	return a.width == b.width && a.height == b.height;
+}
+
+int RayTracer::ReprojectPreviousFrame(const ViewState& view)
+{
+	int pixel_count = m_buffWidth * m_buffHeight;
+
+	//Keep the previous frame while the new one is written
+	m_prevGBuffer.Swap(m_gbuffer);
+	m_gbuffer.Resize(m_buffWidth, m_buffHeight);
+	m_prevColours.assign(m_framebuffer->GetBuffer(), m_framebuffer->GetBuffer() + pixel_count);
+
+	//Scatter the hit points of the previous frame into the new view, keeping the closest one in each pixel
+	std::vector<float> depth(pixel_count, FLT_MAX);
+	std::vector<int> source(pixel_count, -1);
+
+	Vector3 start = view.centre - (view.right * view.width + view.up * view.height) * (Scalar)0.5;
+	Scalar pixel_dx = view.width / m_buffWidth;
+	Scalar pixel_dy = view.height / m_buffHeight;
+	Scalar focal = (view.centre - view.position).DotProduct(view.view);
+	Scalar right_scale = 1 / (view.right.Norm_Sqr() * pixel_dx);
+	Scalar up_scale = 1 / (view.up.Norm_Sqr() * pixel_dy);
+
+	for (int s = 0; s < pixel_count; s++)
+	{
+		const GBuffer::Sample& sample = m_prevGBuffer.GetSample(s);
+		if (sample.hit.primtype == PRIMTYPE_NONE) continue;
+
+		Vector3 d = sample.hit.point - view.position;
+		Scalar distance = d.DotProduct(view.view);
+		if (distance <= RAY_EPSILON) continue;
+
+		//Where the ray from the eye to the hit point pierces the view plane, in pixels
+		Vector3 plane_point = d * (focal / distance) + view.position - start;
+		Scalar x = plane_point.DotProduct(view.right) * right_scale;
+		Scalar y = plane_point.DotProduct(view.up) * up_scale;
+		if (x < 0 || y < 0 || x >= m_buffWidth || y >= m_buffHeight) continue;
+
+		int pixel = (int)y * m_buffWidth + (int)x;
+		if (distance < depth[pixel])
+		{
+			depth[pixel] = (float)distance;
+			source[pixel] = s;
+		}
+	}
+
+	//A pixel keeps the shading of the point that landed in it if that shading does not depend on the viewpoint
+	//and its neighbours received points of the same object with a similar colour. Holes left by disocclusion
+	//and the pixels around object boundaries, where the points landed off the new pixel centres, are traced again.
+	int reused = 0;
+	m_retraceMask.resize(pixel_count);
+
+#pragma omp parallel for schedule (dynamic, 1) reduction(+:reused)
+	for (int i = 0; i < m_buffHeight; i++)
+	{
+		for (int j = 0; j < m_buffWidth; j++)
+		{
+			int pixel = i * m_buffWidth + j;
+			int s = source[pixel];
+			bool reuse = s >= 0 && m_prevGBuffer.GetSample(s).reusable;
+
+			static const int neighbours[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+			for (int n = 0; n < 4 && reuse; n++)
+			{
+				int y = i + neighbours[n][0];
+				int x = j + neighbours[n][1];
+				if (y < 0 || y >= m_buffHeight || x < 0 || x >= m_buffWidth) continue;
+
+				int ns = source[y * m_buffWidth + x];
+				reuse = ns >= 0 && m_prevGBuffer.GetSample(ns).hit.primtype == m_prevGBuffer.GetSample(s).hit.primtype
+					&& m_prevGBuffer.GetSample(ns).hit.index == m_prevGBuffer.GetSample(s).hit.index;
+
+				if (!reuse) break;
+
+				//Edges in the shading, such as the plane's grid and shadow boundaries, would move by the
+				//distance between the point and the new pixel centre, so they are traced again too
+				Colour diff = m_prevColours[ns] - m_prevColours[s];
+				for (int c = 0; c < 3; c++)
+					reuse = reuse && fabs(diff[c]) <= s_reprojectionTolerance;
+			}
+
+			m_retraceMask[pixel] = !reuse;
+
+			if (reuse)
+			{
+				m_framebuffer->WriteRGBToFramebuffer(m_prevColours[s], j, i);
+				m_gbuffer.GetSample(pixel) = m_prevGBuffer.GetSample(s);
+				reused++;
+			}
+		}
+	}
+
+	return reused;
+}
+
+RayTracer::RayCounts RayTracer::GetRayCounts() const
+{
+	RayCounts total = {};
+
+	for (size_t i = 0; i < m_rayCounts.size(); i++)
+	{
+		total.primary += m_rayCounts[i].counts.primary;
+		total.shadow += m_rayCounts[i].counts.shadow;
+		total.reflection += m_rayCounts[i].counts.reflection;
+		total.refraction += m_rayCounts[i].counts.refraction;
+	}
+
+	return total;
+}
+
+RayTracer::CullingStats RayTracer::GetCullingStats() const
+{
+	CullingStats total = {};
+
+	for (size_t i = 0; i < m_culling.size(); i++)
+	{
+		total.tiles += m_culling[i].stats.tiles;
+		total.objects += m_culling[i].stats.objects;
+		total.sceneObjects = m_culling[i].stats.sceneObjects;
+	}
+
+	return total;
+}
+
+RayTracer::ShadowCacheStats RayTracer::GetShadowCacheStats() const
+{
+	ShadowCacheStats total = {};
+
+	for (size_t i = 0; i < m_shadowCaches.size(); i++)
+	{
+		total.hits += m_shadowCaches[i].stats.hits;
+		total.misses += m_shadowCaches[i].stats.misses;
+		total.fallbacks += m_shadowCaches[i].stats.fallbacks;
+	}
+
+	return total;
+}
+
+bool RayTracer::IsShadowed(Scene* pScene, Ray& shadowRay, Scalar lightDistance, int light, const PrimitiveStore::PrimRef& ignore)
+{
+	Scalar tmax = lightDistance - RAY_EPSILON;
+
+	if (!m_shadowCaching)
+		return pScene->IsOccluded(shadowRay, tmax, ignore);
+
+	ThreadShadowCache& cache = m_shadowCaches[omp_get_thread_num()];
+	PrimitiveStore::PrimRef& occluder = cache.occluders[light];
+
+	if (occluder.type != PRIMTYPE_NONE)
+	{
+		if (pScene->BlocksRay(occluder, shadowRay, tmax, ignore))
+		{
+			cache.stats.hits++;
+			return true;
+		}
+
+		cache.stats.misses++;
+	}
+
+	cache.stats.fallbacks++;
+
+	//Keep the last occluder when the point is lit, the next pixel is likely to be in its shadow again
+	return pScene->IsOccluded(shadowRay, tmax, ignore, &occluder);
+}
+
+bool RayTracer::TraceShadowRay(Scene* pScene, const RayHitResult& hit, int light)
+{
+	PrimitiveStore::PrimRef shaded_object = { hit.primtype, hit.index };
+
+	Vector3 light_pos = (*pScene->GetLightList())[light]->GetLightPosition();
+	Vector3 shadow_vector = hit.point - light_pos;
+	Scalar light_distance = shadow_vector.Norm();
+	shadow_vector.Normalise();
+	Ray shadow_ray = Ray();
+	shadow_ray.SetRay(light_pos, shadow_vector);
+	GetThreadRayCounts().shadow++;
+
+	return IsShadowed(pScene, shadow_ray, light_distance, light, shaded_object);
+}
+
+Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray)
+{
 	if (tracelevel <= 0)
 	{
-		return outcolour;
+		return incolour;
 	}
 
 	//Intersect the ray with the scene
-	result = pScene->IntersectByRay(ray);
+	RayHitResult result = pScene->IntersectByRay(ray);
 
-	if (result.data) //the ray has hit something
+	return ShadeHit(pScene, ray, result, incolour, tracelevel, shadowray);
+}
+
+Colour RayTracer::ShadeHit(Scene* pScene, Ray& ray, RayHitResult& result, Colour incolour, int tracelevel, bool shadowray)
+{
+	Colour outcolour = incolour; //the output colour based on the ray-primitive intersection
+
+	//obtain the list of light sources from the scene
+	std::vector<Light*> *light_list = pScene->GetLightList();
+
+	if (result.primtype != PRIMTYPE_NONE) //the ray has hit something
 	{
 		//The origin of the ray currently being traced
 		Vector3 start = ray.GetRayStart();
 
 		//Determine surface colour from lights
-		outcolour = CalculateLighting(light_list,
+		outcolour = CalculateLighting(pScene, light_list,
 			&start,
-			&result);
+			&result,
+			pScene->GetMaterial(result));
 
 		if (HitSphereOrBox(result))
 		{
@@ -170,30 +1198,25 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 			{
 				//Trace the reflection on Spheres and Boxes
 				Vector3 reflect_vector = ray.GetRay().Reflect(result.normal);
+				if (tracelevel > 1) GetThreadRayCounts().reflection++;
 				outcolour = outcolour * TraceReflectRefract(reflect_vector, trace_params);
 			}
 
 			if (m_traceflag & TRACE_REFRACTION)
 			{
 				//Trace the refraction on Spheres and Boxes
-				Vector3 refract_vector = ray.GetRay().Refract(result.normal, 0.9);
+				Vector3 refract_vector = ray.GetRay().Refract(result.normal, (Scalar)0.9);
+				if (tracelevel > 1) GetThreadRayCounts().refraction++;
 				outcolour = (outcolour + TraceReflectRefract(refract_vector, trace_params)) * .5;
 			}
 		}
 
 		if (m_traceflag & TRACE_SHADOW)
 		{
-			for (auto light_iter = light_list->begin(); light_iter != light_list->end(); ++light_iter)
+			for (int light = 0; light < (int)light_list->size(); light++)
 			{
-				//Trace the shadow ray
-				Vector3 light_pos = (*light_iter)->GetLightPosition();
-				Vector3 shadow_vector = result.point - light_pos;
-				shadow_vector.Normalise();
-				Ray shadow_ray = Ray();
-				shadow_ray.SetRay(light_pos, shadow_vector);
-				RayHitResult shadow_hit_result = pScene->IntersectByRay(shadow_ray);
-				//Darken the pixel if a box or sphere is between it and the light
-				if (HitSphereOrBox(shadow_hit_result) && shadow_hit_result.data != result.data)
+				//Darken the pixel if an object that casts shadows is between it and the light
+				if (TraceShadowRay(pScene, result, light))
 				{
 					outcolour = outcolour * Colour(0.25, 0.25, 0.25);
 				}
@@ -204,24 +1227,48 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 	return outcolour;
 }
 
-Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult)
+Colour RayTracer::SampleDiffuseTexture(Scene* pScene, const Vector3& origin, const RayHitResult& hitresult, Material* mat)
+{
+	Scalar texcoords[2];
+	Scalar texcoord_scale = pScene->GetTexCoords(hitresult, texcoords);
+
+	if (texcoord_scale <= 0) return Colour(1.0, 1.0, 1.0);
+
+	//The pixel covers a cone from the origin, it is stretched along the surface as the ray grazes it
+	Vector3 ray_vector = hitresult.point - origin;
+	Scalar distance = ray_vector.Norm();
+	Scalar cosine = distance > 0 ? (Scalar)fabs(ray_vector.DotProduct(hitresult.normal)) / distance : 1;
+	Scalar footprint = distance * m_pixelSpread / (cosine > (Scalar)0.05 ? cosine : (Scalar)0.05);
+
+	return mat->GetDiffuseTexture()->Sample(texcoords[0], texcoords[1], footprint / texcoord_scale);
+}
+
+Colour RayTracer::CalculateLighting(Scene* pScene, std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult, Material* mat)
 {
 	Colour outcolour;
 	std::vector<Light*>::iterator lit_iter = lights->begin();
 
-	Primitive* prim = (Primitive*)hitresult->data;
-	Material* mat = prim->GetMaterial();
-
 	outcolour = mat->GetAmbientColour();
 
-	//Generate the grid pattern on the plane
-	if (((Primitive*)hitresult->data)->m_primtype == Primitive::PRIMTYPE_Plane)
+	//The texture, if any, modulates the diffuse colour of the material
+	Colour mat_diffuse = mat->GetDiffuseColour();
+	bool textured = mat->HasDiffuseTexture();
+
+	if (textured)
+		mat_diffuse = mat_diffuse * SampleDiffuseTexture(pScene, *campos, *hitresult, mat);
+
+	//Generate the grid pattern on the plane, textured planes show the texture instead
+	if (hitresult->primtype == Primitive::PRIMTYPE_Plane && textured)
+	{
+		outcolour = mat_diffuse;
+	}
+	else if (hitresult->primtype == Primitive::PRIMTYPE_Plane)
 	{
 		Vector3 intersection = hitresult->point;
 
-		int dx = (int)(fabsf(intersection[0] * 0.5f) + 0.5f);
-		int dy = (int)(fabsf(intersection[1] * 0.5f) + 0.5f);
-		int dz = (int)(fabsf(intersection[2] * 0.5f) + 0.5f);
+		int dx = (int)(fabs(intersection[0] * 0.5f) + 0.5f);
+		int dy = (int)(fabs(intersection[1] * 0.5f) + 0.5f);
+		int dz = (int)(fabs(intersection[2] * 0.5f) + 0.5f);
 
 		//If the intersection point is inside an "even" cell
 		//Set the return colour to light grey [0.1,0.1,0.1]
@@ -253,8 +1300,8 @@ Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos
 			Colour light_color = (*lit_iter)->GetLightColour();
 
 			//Lambetian Diffuse Reflection
-			float diffuse_intensity = light_vector.DotProduct(normal);
-			Colour mat_dif_color = prim->m_primtype == Primitive::PRIMTYPE_Plane ? outcolour : mat->GetDiffuseColour();
+			Scalar diffuse_intensity = light_vector.DotProduct(normal);
+			Colour mat_dif_color = hitresult->primtype == Primitive::PRIMTYPE_Plane ? outcolour : mat_diffuse;
 			diffuse_color = mat_dif_color * light_color * diffuse_intensity;
 
 			//Blinn-Phong Specular Reflection
@@ -262,10 +1309,10 @@ Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos
 			cam_vector.Normalise();
 			Vector3 half_vector = light_vector + cam_vector * (1 / half_vector.Norm());
 			half_vector.Normalise();
-			float spec_angle = normal.DotProduct(half_vector);
+			Scalar spec_angle = normal.DotProduct(half_vector);
 			//Only show specular reflections when facing the light source
 			if (spec_angle > 0) {
-				float spec_intensity = std::pow(spec_angle, mat->GetSpecPower() * 5);
+				Scalar spec_intensity = (Scalar)std::pow(spec_angle, mat->GetSpecPower() * 5);
 				specular_color = mat->GetSpecularColour() * light_color * spec_intensity;
 			}
 
@@ -280,13 +1327,13 @@ Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos
 
 bool RayTracer::HitSphereOrBox(const RayHitResult& hitresult)
 {
-	Primitive::PRIMTYPE prim_type = ((Primitive*)hitresult.data)->m_primtype;
+	int prim_type = hitresult.primtype;
 	return prim_type == Primitive::PRIMTYPE_Sphere || prim_type == Primitive::PRIMTYPE_Box;
 }
 
 Colour RayTracer::TraceReflectRefract(const Vector3& vector, TraceParams& params)
 {
-	Vector3 start_point = params.start_point + (vector * 0.01);
+	Vector3 start_point = params.start_point + (vector * RAY_EPSILON);
 	Ray ray = Ray();
 	ray.SetRay(start_point, vector);
 	return TraceScene(params.pScene, ray, params.incolour, params.tracelevel - 1);
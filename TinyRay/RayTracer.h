@@ -1,43 +1,278 @@
-/*---------------------------------------------------------------------
-*
-* Copyright © 2018  Minsi Chen
-* E-mail: m.chen@hud.ac.uk
-*
-* The source is written for the CSwGP related modules. You are free
-* to use and extend the functionality. The code provided here is functional
-* however the author does not guarantee its performance.
----------------------------------------------------------------------*/
-#pragma once
-
-#include "Material.h"
-#include "Ray.h"
-#include "Scene.h"
-#include "Framebuffer.h"
-
-class RayTracer
-{
-	private:
-		Framebuffer		*m_framebuffer;
-		int				m_buffWidth;
-		int				m_buffHeight;
-		int				m_renderCount;
-		int				m_traceLevel;
-
-		//Trace the scene from a given ray and scene
-		//Params:
-		//	Scene* pScene		pointer to the scene being traced
-		//  Ray& ray			reference to an input ray
-		//  Colour incolour		default colour to use when the ray does not intersect with any objects
-		//  int tracelevel		the current recursion level of the TraceScene call
-		//  bool shadowray		true if the input ray is a shadow ray, could be useful when handling shadows
-		Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray = false);
-
-		//Compute lighting for a given ray-primitive intersection result
-		//Params:
-		//			std::vector<Light*>* lights     pointer to a list of active light sources
-		//			Vector3*	pointer to the active camera
-		//			RayHitResult* hitresult		Hit result from ray-primitive intersection
-		Colour CalculateLighting(std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult);
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Material.h"
+#include "Ray.h"
+#include "Scene.h"
+#include "Framebuffer.h"
+#include "TileScheduler.h"
+#include "GBuffer.h"
+
+class RayTracer
+{
+	public:
+		//Number of rays of each type intersected with the scene
+		struct RayCounts
+		{
+			long long		primary;
+			long long		shadow;
+			long long		reflection;
+			long long		refraction;
+		};
+
+		//Pixels of the last frame filled by reprojecting the frame before and pixels traced again
+		struct ReprojectionStats
+		{
+			int				reused;
+			int				retraced;
+		};
+
+		//Bounded objects kept by the frustum culling of the tiles of the last render
+		struct CullingStats
+		{
+			long long		tiles;			//tiles culled, summed over the passes
+			long long		objects;		//objects kept, summed over the tiles
+			int				sceneObjects;	//objects in the BVH of the scene
+		};
+
+		//Outcome of the shadow rays that went through the last occluder cache
+		struct ShadowCacheStats
+		{
+			long long		hits;			//the cached occluder blocked the ray, no scene search needed
+			long long		misses;			//the cached occluder did not block the ray
+			long long		fallbacks;		//full occlusion searches, after a miss or with nothing cached
+		};
+
+		//Stages of the wavefront renderer, every stage runs over all the rays of a generation
+		enum WavefrontStage
+		{
+			WAVEFRONT_GENERATE,		//set up the primary rays
+			WAVEFRONT_INTERSECT,	//find the closest hit of every ray
+			WAVEFRONT_SHADE,		//compute the lighting at every hit
+			WAVEFRONT_SORT,			//bin the rays of the next generation by direction and origin
+			WAVEFRONT_SPAWN,		//queue the reflection and refraction rays of the next generation
+			WAVEFRONT_SHADOW,		//trace the shadow rays of every hit
+			WAVEFRONT_COHERENCE,	//measure the direction coherence of the next generation for the statistics
+			WAVEFRONT_RESOLVE,		//combine the colours from the last generation back to the pixels
+			WAVEFRONT_STAGE_COUNT
+		};
+
+		struct WavefrontStats
+		{
+			int				generations;
+			long long		rays;			//rays intersected or taken from the G-buffer, without shadow rays
+			double			stageTime[WAVEFRONT_STAGE_COUNT];	//milliseconds spent in each stage
+			long long		secondaryRays;				//reflection and refraction rays
+			double			secondaryIntersectTime;		//milliseconds spent intersecting them
+			double			coherence;					//mean cosine of the angle between consecutive secondary rays as intersected
+		};
+
+	private:
+		Framebuffer		*m_framebuffer;
+		int				m_buffWidth;
+		int				m_buffHeight;
+		int				m_renderCount;
+		int				m_traceLevel;
+		bool			m_packetTracing;	//trace primary rays in packets of 2x2 pixels
+		int				m_tileSize;			//size of the square tiles rendered by m_tileScheduler, 0 to render by rows
+		TileOrder		m_tileOrder;		//order of the tiles along the work queues
+		TileScheduler	m_tileScheduler;
+		double			m_renderTime;		//wall clock time of the last render in milliseconds, summed over its passes
+		bool			m_progressive;		//render coarse to fine over several calls of DoRayTrace
+
+		//Progressive rendering first traces one pixel per cell of s_progressiveCell x s_progressiveCell pixels,
+		//then every pass halves the cell size until each pixel has been traced exactly once
+		static const int s_progressiveCell = 8;
+		static const int s_progressivePasses = 4;
+
+		//Adaptive sampling follows the passes that trace every pixel once. The first round adds subpixel samples
+		//to pixels that differ from a neighbour by more than the threshold, the later rounds to those of them whose
+		//samples still vary too much. Every round adds s_adaptiveSamples samples to each selected pixel.
+		static const int	s_adaptiveRounds = 3;
+		static const int	s_adaptiveSamples = 4;
+		static const float	s_subpixelOffsets[s_adaptiveRounds][s_adaptiveSamples][2];	//(x, y) of each sample within the pixel
+
+		bool						m_adaptive;				//add subpixel samples where the image has edges or noise
+		float						m_adaptiveThreshold;	//colour difference and standard error above which pixels are refined
+		std::vector<unsigned char>	m_refineMask;			//pixels selected for the current adaptive round
+
+		//The camera of a frame, as used to set up its primary rays
+		struct ViewState
+		{
+			Vector3			position;
+			Vector3			up;
+			Vector3			right;
+			Vector3			view;
+			Vector3			centre;		//centre of the view plane
+			Scalar			width;		//metric size of the view plane
+			Scalar			height;
+		};
+
+		//Returns true if two views set up the same primary rays
+		static bool IsSameView(const ViewState& a, const ViewState& b);
+
+		static const float			s_reprojectionTolerance;	//largest colour difference to a neighbour of a reused pixel
+
+		bool						m_reprojection;			//reuse the shading of the last frame after a camera move
+		bool						m_reshadeEnabled;		//shade the cached primary hits when the view and the geometry are unchanged
+		bool						m_reshading;			//the current frame shades the cached primary hits
+		GBuffer						m_gbuffer;				//primary hits of the last frame
+		GBuffer						m_prevGBuffer;			//primary hits of the frame before, used while reprojecting
+		bool						m_gbufferComplete;		//m_gbuffer holds the exact primary hit of every pixel centre seen from m_gbufferView
+		bool						m_gbufferValid;			//m_gbuffer and the framebuffer hold a single sample frame that can be reprojected
+		int							m_gbufferFlags;			//trace flags the last frame was shaded with
+		int							m_gbufferTraceLevel;	//trace level the last frame was shaded with
+		ViewState					m_gbufferView;			//camera of the last frame
+		Scene*						m_gbufferScene;			//scene of the last frame
+		unsigned int				m_gbufferSceneVersion;	//Scene::GetVersion of the last frame
+		std::vector<Colour>			m_prevColours;			//colours of the frame before, used while reprojecting
+		std::vector<unsigned char>	m_retraceMask;			//pixels the reprojection could not fill
+		ReprojectionStats			m_reprojectionStats;
+
+		//Store the primary hit of pixel (x, y) and whether its shading could be reused from another viewpoint
+		void RecordGBufferSample(Scene* pScene, const RayHitResult& hit, int x, int y);
+
+		//Move the pixels of the last frame to where their hit points appear from the new view
+		//Pixels that can be reused are written to the framebuffer, the others are flagged in m_retraceMask
+		//Returns the number of pixels reused
+		int ReprojectPreviousFrame(const ViewState& view);
+
+		//Select the pixels that receive more samples in the given adaptive round
+		//Returns the number of pixels selected
+		int BuildRefineMask(int round);
+
+		//Ray counts of each thread
+		struct ThreadRayCounts
+		{
+			RayCounts		counts;
+			char			padding[64];		//keep the threads' counts on separate cache lines
+		};
+
+		std::vector<ThreadRayCounts>	m_rayCounts;
+
+		inline RayCounts& GetThreadRayCounts()
+		{
+			return m_rayCounts[omp_get_thread_num()].counts;
+		}
+
+		//The object that last blocked a shadow ray towards each light, per thread.
+		//Neighbouring pixels are usually shadowed by the same object, so it is tested before searching the scene.
+		struct ThreadShadowCache
+		{
+			std::vector<PrimitiveStore::PrimRef>	occluders;	//one entry per light, type PRIMTYPE_NONE if empty
+			ShadowCacheStats						stats;
+			char									padding[64];	//keep the threads' caches on separate cache lines
+		};
+
+		//The BVH nodes left by culling the current tile of each thread against its frustum
+		struct ThreadCulling
+		{
+			std::vector<int>	nodes;
+			CullingStats		stats;
+			char				padding[64];		//keep the threads' lists on separate cache lines
+		};
+
+		bool							m_frustumCulling;	//only intersect the primary rays of a tile with the objects in its frustum
+		std::vector<ThreadCulling>		m_culling;
+
+		bool							m_shadowCaching;	//test the last occluder before searching the scene for shadow rays
+		std::vector<ThreadShadowCache>	m_shadowCaches;
+
+		Scalar							m_pixelSpread;		//angle covered by a pixel seen from the camera, sets the footprint of texture lookups
+
+		//Returns true if the shadow ray towards the light with the given index is blocked by anything but the ignored object
+		bool IsShadowed(Scene* pScene, Ray& shadowRay, Scalar lightDistance, int light, const PrimitiveStore::PrimRef& ignore);
+
+		//Trace the shadow ray from the light with the given index to a hit point
+		//Returns true if an object that casts shadows is between them
+		bool TraceShadowRay(Scene* pScene, const RayHitResult& hit, int light);
+
+		//A ray queued by the wavefront renderer
+		struct WavefrontRay
+		{
+			Ray				ray;
+			RayHitResult	hit;
+			Colour			incolour;		//colour of the ray if it hits nothing, the lighting at its parent's hit
+			int				tracelevel;
+		};
+
+		//The shading of a wavefront ray, kept until the rays it spawned have their colours
+		struct WavefrontNode
+		{
+			Colour			lighting;		//lighting at the hit, the incoming colour if nothing was hit
+			Colour			colour;			//final colour of the ray, as returned by TraceScene
+			int				children[2];	//reflection and refraction ray in the next generation, -1 if not traced
+			int				shadowCount;	//number of lights blocked from the hit
+			bool			hit;
+			bool			secondary;		//the hit is on a sphere or a box
+		};
+
+		bool										m_wavefront;		//render single sample frames breadth first
+		std::vector<WavefrontRay>					m_wavefrontRays;	//rays of the current generation
+		std::vector<WavefrontRay>					m_wavefrontSpawned;	//rays of the next generation
+		std::vector<int>							m_wavefrontOffsets;	//position of the first ray each ray spawns
+		bool										m_raySorting;		//bin the secondary rays before intersecting them
+		std::vector<unsigned int>					m_wavefrontKeys;	//bin of each ray of the next generation, in spawn order
+		std::vector<int>							m_wavefrontBins;	//position of the first ray of each bin
+		std::vector<int>							m_wavefrontMoves;	//position of each ray of the next generation once binned
+		std::vector<std::vector<WavefrontNode> >	m_wavefrontNodes;	//one list per generation, in the order of its rays
+		WavefrontStats								m_wavefrontStats;
+
+		//Rays are binned by direction octant, then by the Morton code of their origin quantised to 4 steps per axis
+		//of the scene bounds. Few bins keep the rays written to each of them close in memory.
+		static const int s_sortOriginBits = 2;
+
+		//Returns the bin of a ray, origins are quantised within the given bounds
+		static unsigned int GetRayBin(const Vector3& origin, const Vector3& direction, const AABB& bounds);
+
+		//Fill m_wavefrontMoves from the bins in m_wavefrontKeys, rays of the same bin keep their order
+		void BinWavefrontRays(int rayCount);
+
+		//Returns the mean cosine of the angle between the directions of consecutive rays of the list,
+		//estimated from every s_coherenceStride-th pair
+		static const int s_coherenceStride = 16;
+		static double GetDirectionCoherence(std::vector<WavefrontRay>& rays);
+
+		//Trace the centre of every pixel breadth first, one stage of one generation of rays at a time
+		//Params: setupViewRay(i, j, ray)	sets up the primary ray of pixel (j, i)
+		//		  writePixel(colour, x, y)	stores the colour of pixel (x, y)
+		template<typename ViewRayFn, typename WriteFn>
+		void TraceWavefront(Scene* pScene, const Colour& background, ViewRayFn setupViewRay, WriteFn writePixel);
+
+		//Trace the scene from a given ray and scene
+		//Params:
+		//	Scene* pScene		pointer to the scene being traced
+		//  Ray& ray			reference to an input ray
+		//  Colour incolour		default colour to use when the ray does not intersect with any objects
+		//  int tracelevel		the current recursion level of the TraceScene call
+		//  bool shadowray		true if the input ray is a shadow ray, could be useful when handling shadows
+		Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray = false);
+
+		//Shade the result of intersecting a ray with the scene, tracing any secondary rays
+		//Params are the same as TraceScene, plus
+		//	RayHitResult& result	the closest intersection of the ray with the scene
+		Colour ShadeHit(Scene* pScene, Ray& ray, RayHitResult& result, Colour incolour, int tracelevel, bool shadowray = false);
+
+		//Compute lighting for a given ray-primitive intersection result
+		//Params:
+		//			Scene* pScene				the scene, used to find the texture coordinates of the hit
+		//			std::vector<Light*>* lights     pointer to a list of active light sources
+		//			Vector3*	pointer to the active camera
+		//			RayHitResult* hitresult		Hit result from ray-primitive intersection
+		//			Material* mat				material of the hit primitive
+		Colour CalculateLighting(Scene* pScene, std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult, Material* mat);
+
+		//Returns the colour of the diffuse texture of the material at a hit, white if the hit has no texture coordinates
+		//The footprint of the lookup is that of a pixel at the distance of the hit, seen from the origin of the ray
+		Colour SampleDiffuseTexture(Scene* pScene, const Vector3& origin, const RayHitResult& hitresult, Material* mat);
 
 		//Determine if a ray intersected with a box or sphere.
 		//Params:
@@ -64,41 +299,227 @@ class RayTracer
 		//  const Vector3& vector	The normalized reflection/refraction vector
 		//  TraceParams& params		Params to pass to TraceScene
 		Colour TraceReflectRefract(const Vector3 & vector, TraceParams& params);
-
-	public:
-		
-		enum TraceFlags
-		{
-			TRACE_AMBIENT = 0x1,					//trace ambient colour only
-			TRACE_DIFFUSE_AND_SPEC = 0x1 << 1,		//trace and compute diffuse and specular lighting components 
-			TRACE_SHADOW = 0x1 << 2,				//trace shadow rays
-			TRACE_REFLECTION = 0x1 << 3,			//trace reflection rays
-			TRACE_REFRACTION = 0x1 << 4,			//trace refraction rays
-		};
-
-		TraceFlags m_traceflag;						//current trace flags value default is TRACE_AMBIENT
-
-		RayTracer();
-		RayTracer(int width, int height);
-		~RayTracer();
-
-		inline void SetTraceLevel(int level)		//Set the level of recursion, default is 5
-		{
-			m_traceLevel = level;
-		}
-
-		inline void ResetRenderCount()
-		{
-			m_renderCount = 0;
-		}
-
-		inline Framebuffer *GetFramebuffer() const
-		{
-			return m_framebuffer;
-		}
-
-		//Trace a given scene
-		//Params: Scene* pScene   Pointer to the scene to be ray traced
-		void DoRayTrace( Scene* pScene );
-};
-
+
+	public:
+		
+		enum TraceFlags
+		{
+			TRACE_AMBIENT = 0x1,					//trace ambient colour only
+			TRACE_DIFFUSE_AND_SPEC = 0x1 << 1,		//trace and compute diffuse and specular lighting components 
+			TRACE_SHADOW = 0x1 << 2,				//trace shadow rays
+			TRACE_REFLECTION = 0x1 << 3,			//trace reflection rays
+			TRACE_REFRACTION = 0x1 << 4,			//trace refraction rays
+		};
+
+		TraceFlags m_traceflag;						//current trace flags value default is TRACE_AMBIENT
+
+		RayTracer();
+		RayTracer(int width, int height);
+		~RayTracer();
+
+		inline void SetTraceLevel(int level)		//Set the level of recursion, default is 5
+		{
+			m_traceLevel = level;
+		}
+
+		inline void SetPacketTracing(bool enable)	//Trace primary rays in SSE packets, default is off
+		{
+			m_packetTracing = enable;
+		}
+
+		inline bool GetPacketTracing() const
+		{
+			return m_packetTracing;
+		}
+
+		//Render in square tiles of tileSize pixels with work stealing, or by rows if tileSize is 0
+		//The tile size is rounded up to an even number so that tiles hold whole 2x2 packets
+		inline void SetTileScheduling(int tileSize, TileOrder order)
+		{
+			m_tileSize = (tileSize + 1) & ~1;
+			m_tileOrder = order;
+		}
+
+		//Render coarse to fine, each call of DoRayTrace then renders one pass into the accumulation buffer
+		//of the framebuffer and leaves a complete, blocky image. Primary rays are traced one at a time.
+		inline void SetProgressive(bool enable)
+		{
+			m_progressive = enable;
+		}
+
+		inline bool GetProgressive() const
+		{
+			return m_progressive;
+		}
+
+		//Add subpixel samples to the pixels at edges and noisy pixels after every pixel has been traced once
+		//Params: float threshold   colour difference to a neighbouring pixel, and standard error of the
+		//							luminance of a pixel's samples, above which a pixel receives more samples
+		inline void SetAdaptiveSampling(bool enable, float threshold = 0.05f)
+		{
+			m_adaptive = enable;
+			m_adaptiveThreshold = threshold;
+		}
+
+		inline bool GetAdaptiveSampling() const
+		{
+			return m_adaptive;
+		}
+
+		//Reuse the shading of the last frame where the camera moved but the pixel still shows the same surface,
+		//only disoccluded pixels, object boundaries and view dependent shading are traced again.
+		//Applies to frames rendered without progressive or adaptive sampling. Changes to the geometry are
+		//detected through Scene::GetVersion, other changes to the scene need InvalidateReprojection.
+		inline void SetReprojection(bool enable)
+		{
+			m_reprojection = enable;
+			m_gbufferValid = false;
+		}
+
+		inline bool GetReprojection() const
+		{
+			return m_reprojection;
+		}
+
+		//Forget the last frame, the next one is traced in full
+		inline void InvalidateReprojection()
+		{
+			m_gbufferValid = false;
+			m_gbufferComplete = false;
+		}
+
+		//Shade the primary hits cached in the G-buffer instead of intersecting the primary rays again when
+		//the camera and the geometry have not changed since the last frame, e.g. after switching trace flags.
+		//Default is on
+		inline void SetReshading(bool enable)
+		{
+			m_reshadeEnabled = enable;
+		}
+
+		inline bool GetReshading() const
+		{
+			return m_reshadeEnabled;
+		}
+
+		inline const ReprojectionStats& GetReprojectionStats() const
+		{
+			return m_reprojectionStats;
+		}
+
+		//Returns the largest number of samples adaptive sampling puts in a pixel
+		static inline int GetMaxSamples()
+		{
+			return 1 + s_adaptiveRounds * s_adaptiveSamples;
+		}
+
+		//Returns the number of calls of DoRayTrace needed to render a frame
+		inline int GetPassCount() const
+		{
+			return (m_progressive ? s_progressivePasses : 1) + (m_adaptive ? s_adaptiveRounds : 0);
+		}
+
+		//Returns true once every pass of the current frame has been rendered
+		inline bool IsFrameComplete() const
+		{
+			return m_renderCount >= GetPassCount();
+		}
+
+		//Trace the pixels of single sample frames breadth first: the primary rays of the whole frame go through
+		//each stage together, then their reflection and refraction rays as the next generation, and the colours are
+		//combined from the last generation back. The image is the same as the one traced depth first.
+		//Progressive, adaptive and reprojected passes are still traced depth first. Default is off
+		inline void SetWavefront(bool enable)
+		{
+			m_wavefront = enable;
+		}
+
+		inline bool GetWavefront() const
+		{
+			return m_wavefront;
+		}
+
+		//Bin the reflection and refraction rays of each wavefront generation by direction octant and origin before
+		//intersecting them, so that consecutive rays traverse the same BVH nodes. With packet tracing on, wavefront
+		//generations are intersected in packets of 4 consecutive rays, which sorting keeps coherent. Default is off
+		inline void SetRaySorting(bool enable)
+		{
+			m_raySorting = enable;
+		}
+
+		inline bool GetRaySorting() const
+		{
+			return m_raySorting;
+		}
+
+		//Returns the stage timings of the last frame rendered breadth first
+		inline const WavefrontStats& GetWavefrontStats() const
+		{
+			return m_wavefrontStats;
+		}
+
+		static const char* GetWavefrontStageName(int stage);
+
+		//Cull the objects outside the frustum of each tile before tracing its primary rays, which are then only
+		//intersected with the objects that remain. Applies to tiled rendering, see SetTileScheduling. Default is off
+		inline void SetFrustumCulling(bool enable)
+		{
+			m_frustumCulling = enable;
+		}
+
+		inline bool GetFrustumCulling() const
+		{
+			return m_frustumCulling;
+		}
+
+		//Returns the frustum culling statistics of the last render
+		CullingStats GetCullingStats() const;
+
+		inline void SetShadowCaching(bool enable)	//Test the last occluder of each light first for shadow rays, default is on
+		{
+			m_shadowCaching = enable;
+		}
+
+		inline bool GetShadowCaching() const
+		{
+			return m_shadowCaching;
+		}
+
+		inline int GetTileSize() const
+		{
+			return m_tileSize;
+		}
+
+		inline TileOrder GetTileOrder() const
+		{
+			return m_tileOrder;
+		}
+
+		inline void ResetRenderCount()
+		{
+			m_renderCount = 0;
+		}
+
+		//Returns the wall clock time of the last render in milliseconds
+		//In progressive mode this is the time of the passes rendered so far
+		inline double GetRenderTime() const
+		{
+			return m_renderTime;
+		}
+
+		//Returns the number of rays of each type traced by the last render
+		RayCounts GetRayCounts() const;
+
+		//Returns the shadow occluder cache statistics of the last render
+		ShadowCacheStats GetShadowCacheStats() const;
+
+		inline Framebuffer *GetFramebuffer() const
+		{
+			return m_framebuffer;
+		}
+
+		//Trace a given scene, or the next pass of it in progressive mode
+		//Nothing is traced once the frame is complete until ResetRenderCount is called
+		//Params: Scene* pScene   Pointer to the scene to be ray traced
+		void DoRayTrace( Scene* pScene );
+};
+
@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+//The floating point type of the whole ray pipeline: Vector3, Ray, RayHitResult and the primitives.
+//The default is an all-float build that keeps Vector3 in SSE registers.
+//Define TINYRAY_DOUBLE for an all-double reference build, Vector3 then uses its scalar implementation.
+//The viewer uploads the framebuffer as floats, so double builds are meant for the headless renderer.
+
+#ifdef TINYRAY_DOUBLE
+
+typedef double Scalar;
+
+#define SCALAR_NAME			"double"
+
+#ifndef VECTOR3_SCALAR
+#define VECTOR3_SCALAR
+#endif
+
+#else
+
+typedef float Scalar;
+
+#define SCALAR_NAME			"float"
+
+#endif
+
+//Threshold below which a denominator, e.g. a direction component or a determinant, is treated as zero
+#define SCALAR_EPSILON		((Scalar)1e-12)
+
+//Distance secondary rays are moved along their direction so they do not hit the surface they leave
+#define RAY_EPSILON			((Scalar)0.01)
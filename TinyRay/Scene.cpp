@@ -14,6 +14,7 @@
 
 Scene::Scene()
 {
+	m_version = 0;
 	InitDefaultScene();
 }
 
@@ -26,8 +27,8 @@ Scene::~Scene()
 void Scene::InitDefaultScene()
 {
 	//Create a box and its material
-	Primitive* newobj = new Box(Vector3(-4.0, 4.0, -20.0), 10.0, 15.0, 4.0);
-	Material* newmat = new Material();
+	Primitive* newobj = m_arena.Create<Box>(Vector3(-4.0, 4.0, -20.0), 10.0, 15.0, 4.0);
+	Material* newmat = m_arena.Create<Material>();
 	//mat for the box1
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(1.0, 0.0, 0.0);
@@ -35,10 +36,9 @@ void Scene::InitDefaultScene()
 	newmat->SetSpecPower(20);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 
-	newobj = new Box(Vector3(4.0, 4.0, -15.0), 4.0, 20.0, 4.0);
-	newmat = new Material();
+	newobj = m_arena.Create<Box>(Vector3(4.0, 4.0, -15.0), 4.0, 20.0, 4.0);
+	newmat = m_arena.Create<Material>();
 	//mat for the box2
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.8, 0.8, 0.8);
@@ -46,33 +46,30 @@ void Scene::InitDefaultScene()
 	newmat->SetSpecPower(20);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 	
 	//Create sphere 1 and its material
-	newobj = new Sphere(5.0, 2, -4.0, 2.0); //sphere 2
-	newmat = new Material();
+	newobj = m_arena.Create<Sphere>(5.0, 2, -4.0, 2.0); //sphere 2
+	newmat = m_arena.Create<Material>();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.8, 0.0);
 	newmat->SetSpecularColour(1.0, 1.0, 1.0);
 	newmat->SetSpecPower(2);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 	
 	//Create sphere 2 and its material
-	newobj = new Sphere(-4.0, 3.0, -5.0, 3.0); //sphere 3
-	newmat = new Material();
+	newobj = m_arena.Create<Sphere>(-4.0, 3.0, -5.0, 3.0); //sphere 3
+	newmat = m_arena.Create<Material>();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 0.9);
 	newmat->SetSpecularColour(1.0, 1.0, 1.0);
 	newmat->SetSpecPower(20);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 
-	newobj = new Plane(); //an xz plane at the origin, floor
+	newobj = m_arena.Create<Plane>(); //an xz plane at the origin, floor
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 1.0, 0.0), 0.0);
-	newmat = new Material();
+	newmat = m_arena.Create<Material>();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(1.0, 0.0, 0.0);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
@@ -80,15 +77,14 @@ void Scene::InitDefaultScene()
 	newmat->SetCastShadow(false);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 	
-	newobj = new Plane(); //an xz plane 40 units above, ceiling
+	newobj = m_arena.Create<Plane>(); //an xz plane 40 units above, ceiling
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, -1.0, 0.0), -40.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 	
 
-	newmat = new Material();
+	newmat = m_arena.Create<Material>();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 1.0, 0.0);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
@@ -96,20 +92,19 @@ void Scene::InitDefaultScene()
 	newmat->SetCastShadow(false);
 	newobj->SetMaterial(newmat);
 	
-	newobj = new Plane(); //an xy plane 40 units along -z axis, 
+	newobj = m_arena.Create<Plane>(); //an xy plane 40 units along -z axis, 
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 0.0, 1.0), -40.0);
 	m_sceneObjects.push_back(newobj);
 	newobj->SetMaterial(newmat);
-	//m_objectMaterials.push_back(newmat);
 	
-	newobj = new Plane(); //an xy plane 40 units along the z axis
+	newobj = m_arena.Create<Plane>(); //an xy plane 40 units along the z axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 0.0, -1.0), -40.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 	
-	newobj = new Plane(); //an yz plane 20 units along -x axis
+	newobj = m_arena.Create<Plane>(); //an yz plane 20 units along -x axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(1.0, 0.0, 0.0), -20.0);
-	newmat = new Material();
+	newmat = m_arena.Create<Material>();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 1.0);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
@@ -117,15 +112,14 @@ void Scene::InitDefaultScene()
 	newmat->SetCastShadow(false);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
-	m_objectMaterials.push_back(newmat);
 
-	newobj = new Plane(); //an yz plane 20 units along +x axis
+	newobj = m_arena.Create<Plane>(); //an yz plane 20 units along +x axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(-1.0, 0.0, 0.0), -20.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 
 	//Create one light source for the scene
-	Light *newlight = new Light();
+	Light *newlight = m_arena.Create<Light>();
 	newlight->SetLightPosition(-5.0, 15.0, 10.0);
 	m_lights.push_back(newlight);
 	
@@ -138,54 +132,226 @@ void Scene::InitDefaultScene()
 
 	//default camera position and look at
 	m_activeCamera.SetPositionAndLookAt(Vector3(0.0, 10.0, 13.0), Vector3(0.0, 7.0, 0.0));
+
+	BuildAccelerationStructure();
 }
 
-void Scene::CleanupScene()
+void Scene::AddObject(Primitive* object)
+{
+	m_sceneObjects.push_back(object);
+}
+
+void Scene::SortObjects(std::vector<AABB>& bounds)
 {
-	//Cleanup object list
-	std::vector<Primitive*>::iterator prim_iter = m_sceneObjects.begin();
+	m_store.Build(m_sceneObjects);
+	m_boundedObjects.clear();
+	m_unboundedObjects.clear();
 
-	while(prim_iter != m_sceneObjects.end())
+	//Sort the objects into the ones the BVH can hold and the unbounded ones
+	for (int i = 0; i < (int)m_sceneObjects.size(); i++)
 	{
-		delete *prim_iter;
-		prim_iter++;
+		AABB object_bounds;
+		PrimitiveStore::PrimRef ref = { m_sceneObjects[i]->m_primtype, m_sceneObjects[i]->GetIndex() };
+
+		if (m_sceneObjects[i]->GetBounds(object_bounds))
+		{
+			m_boundedObjects.push_back(ref);
+			bounds.push_back(object_bounds);
+		}
+		else
+		{
+			m_unboundedObjects.push_back(ref);
+		}
 	}
+}
 
-	m_sceneObjects.clear();
+void Scene::BuildAccelerationStructure()
+{
+	std::vector<AABB> bounds;
 
-	//Cleanup material list
-	std::vector<Material*>::iterator mat_iter = m_objectMaterials.begin();
+	SortObjects(bounds);
 
-	while (mat_iter != m_objectMaterials.end())
-	{
-		delete *mat_iter;
-		mat_iter++;
-	}
-	m_objectMaterials.clear();
+	m_bvh.Build(bounds);
+	m_bvh.PrintBuildStats("Scene BVH");
 
-	//cleanup light list
-	std::vector<Light*>::iterator lit_iter = m_lights.begin();
+	m_version++;
+}
 
-	while (lit_iter != m_lights.end())
-	{
-		delete *lit_iter;
-		lit_iter++;
-	}
+void Scene::BuildAccelerationStructure(const BVH::Node* nodes, int nodeCount, const int* primIndices, int primCount)
+{
+	std::vector<AABB> bounds;
 
+	SortObjects(bounds);
+
+	m_bvh.SetExternal(nodes, nodeCount, primIndices, primCount);
+
+	m_version++;
+}
+
+void Scene::CleanupScene()
+{
+	m_sceneObjects.clear();
 	m_lights.clear();
+
+	//The objects, materials and lights all live in the arena and go in one release
+	m_arena.Release();
+
+	m_store.Clear();
+	m_bvh.Clear();
+	m_boundedObjects.clear();
+	m_unboundedObjects.clear();
+
+	m_version++;
 }
 
 RayHitResult Scene::IntersectByRay(Ray& ray)
+{
+	static const int root = 0;
+	return IntersectNodes(ray, &root, 1);
+}
+
+RayHitResult Scene::IntersectByRay(Ray& ray, const std::vector<int>& nodes)
+{
+	return IntersectNodes(ray, nodes.empty() ? nullptr : &nodes[0], (int)nodes.size());
+}
+
+RayHitResult Scene::IntersectNodes(Ray& ray, const int* nodes, int nodeCount)
 {
 	//Initialise the default intersection result
 	RayHitResult result = Ray::s_defaultHitResult;
+	int result_order = -1;
+
+	//Check intersection for an object and replace result if closer.
+	//Equal distances are resolved in favour of the object added to the scene first,
+	//which gives the same result as testing the objects in order.
+	auto intersect_object = [&](const PrimitiveStore::PrimRef& ref)
+	{
+		Scalar t = m_store.Intersect(ref, ray);
+		if (t > 0 && (t < result.t || (t == result.t && result_order >= 0 && m_store.GetOrder(ref.type, ref.index) < result_order)))
+		{
+			result.t = t;
+			result.primtype = ref.type;
+			result.index = ref.index;
+			result_order = m_store.GetOrder(ref.type, ref.index);
+		}
+	};
 
-	//Check intersection for each object and replace result if closer.
-	for (const auto& sceneObject : m_sceneObjects)
+	for (const PrimitiveStore::PrimRef& ref : m_unboundedObjects)
 	{
-		RayHitResult current_result = sceneObject->IntersectByRay(ray);
-		if (current_result.t > 0 && current_result.t < result.t) result = current_result;
+		intersect_object(ref);
 	}
 
+	for (int i = 0; i < nodeCount; i++)
+	{
+		m_bvh.Traverse(ray, result.t, [&](int prim) { intersect_object(m_boundedObjects[prim]); }, nodes[i]);
+	}
+
+	//Only the closest hit needs its point and normal
+	if (result.primtype != PRIMTYPE_NONE)
+		m_store.CompleteHit(ray, result);
+
 	return result;
 }
+
+bool Scene::BlocksRay(const PrimitiveStore::PrimRef& ref, Ray& ray, Scalar tmax, const PrimitiveStore::PrimRef& ignore)
+{
+	//Meshes and instances may shadow themselves, the shadow ray stops short of the shaded point so it cannot hit it
+	bool self_shadowing = ref.type == Primitive::PRIMTYPE_Mesh || ref.type == Primitive::PRIMTYPE_Instance;
+	if (ref.type == ignore.type && ref.index == ignore.index && !self_shadowing) return false;
+	if (!m_store.CastsShadow(ref.type, ref.index)) return false;
+
+	Scalar t = m_store.Intersect(ref, ray);
+	return t > 0 && t < tmax;
+}
+
+bool Scene::IsOccluded(Ray& ray, Scalar tmax, const PrimitiveStore::PrimRef& ignore, PrimitiveStore::PrimRef* occluder)
+{
+	auto blocks_ray = [&](const PrimitiveStore::PrimRef& ref)
+	{
+		if (!BlocksRay(ref, ray, tmax, ignore)) return false;
+		if (occluder) *occluder = ref;
+		return true;
+	};
+
+	for (const PrimitiveStore::PrimRef& ref : m_unboundedObjects)
+	{
+		if (blocks_ray(ref)) return true;
+	}
+
+	return m_bvh.TraverseAny(ray, tmax, [&](int prim) { return blocks_ray(m_boundedObjects[prim]); });
+}
+
+void Scene::IntersectByPacket(RayPacket& packet, Ray* rays, RayHitResult* results)
+{
+	static const int root = 0;
+	IntersectNodesByPacket(packet, rays, results, &root, 1);
+}
+
+void Scene::IntersectByPacket(RayPacket& packet, Ray* rays, RayHitResult* results, const std::vector<int>& nodes)
+{
+	IntersectNodesByPacket(packet, rays, results, nodes.empty() ? nullptr : &nodes[0], (int)nodes.size());
+}
+
+void Scene::IntersectNodesByPacket(RayPacket& packet, Ray* rays, RayHitResult* results, const int* nodes, int nodeCount)
+{
+	__m128 result_t = _mm_set1_ps(FARFAR_AWAY);
+	__m128i result_type = _mm_set1_epi32(PRIMTYPE_NONE);
+	__m128i result_index = _mm_set1_epi32(-1);
+	__m128i result_order = _mm_set1_epi32(-1);
+	__m128 zero = _mm_setzero_ps();
+
+	//Same closest hit rule as IntersectByRay, applied to every lane at once
+	auto intersect_object = [&](const PrimitiveStore::PrimRef& ref)
+	{
+		__m128 t = m_store.IntersectPacket(ref, packet);
+		__m128i object_order = _mm_set1_epi32(m_store.GetOrder(ref.type, ref.index));
+
+		__m128 closer = _mm_cmplt_ps(t, result_t);
+		__m128 tie = _mm_and_ps(_mm_cmpeq_ps(t, result_t), _mm_castsi128_ps(_mm_cmpgt_epi32(result_order, object_order)));
+		__m128 update = _mm_and_ps(_mm_and_ps(packet.active, _mm_cmpgt_ps(t, zero)), _mm_or_ps(closer, tie));
+		__m128i update_i = _mm_castps_si128(update);
+
+		result_t = PacketSelect(update, t, result_t);
+		result_type = _mm_or_si128(_mm_and_si128(update_i, _mm_set1_epi32(ref.type)), _mm_andnot_si128(update_i, result_type));
+		result_index = _mm_or_si128(_mm_and_si128(update_i, _mm_set1_epi32(ref.index)), _mm_andnot_si128(update_i, result_index));
+		result_order = _mm_or_si128(_mm_and_si128(update_i, object_order), _mm_andnot_si128(update_i, result_order));
+	};
+
+	for (const PrimitiveStore::PrimRef& ref : m_unboundedObjects)
+	{
+		intersect_object(ref);
+	}
+
+	for (int i = 0; i < nodeCount; i++)
+	{
+		m_bvh.TraversePacket(packet, result_t, [&](int prim) { intersect_object(m_boundedObjects[prim]); }, nodes[i]);
+	}
+
+	//Compute the full hit result of every lane from the object it hit
+	int lane_type[RAYPACKET_SIZE];
+	int lane_index[RAYPACKET_SIZE];
+	int lane_active[RAYPACKET_SIZE];
+	_mm_storeu_si128((__m128i*)lane_type, result_type);
+	_mm_storeu_si128((__m128i*)lane_index, result_index);
+	_mm_storeu_si128((__m128i*)lane_active, _mm_castps_si128(packet.active));
+
+	for (int lane = 0; lane < RAYPACKET_SIZE; lane++)
+	{
+		if (!lane_active[lane]) continue;
+
+		results[lane] = Ray::s_defaultHitResult;
+
+		if (lane_type[lane] == PRIMTYPE_NONE) continue;
+
+		//Recompute the distance in Scalar precision as the scalar path does
+		PrimitiveStore::PrimRef ref = { lane_type[lane], lane_index[lane] };
+		Scalar t = m_store.Intersect(ref, rays[lane]);
+
+		if (t <= 0 || t >= FARFAR_AWAY) continue;
+
+		results[lane].t = t;
+		results[lane].primtype = ref.type;
+		results[lane].index = ref.index;
+		m_store.CompleteHit(rays[lane], results[lane]);
+	}
+}
@@ -13,6 +13,10 @@
 #include "Primitive.h"
 #include "Material.h"
 #include "Light.h"
+#include "BVH.h"
+#include "PrimitiveStore.h"
+#include "Arena.h"
+#include "RayPacket.h"
 #include <vector>
 
 //Class representing a scene
@@ -21,10 +25,26 @@ class Scene
 	private:
 		Camera							m_activeCamera;		//the active camera in the scene
 		
+		Arena							m_arena;			//owns every object, material and light of the scene
+
 		std::vector<Primitive*>			m_sceneObjects;		//A list of primitives (objects) in the scene
-		std::vector<Material*>			m_objectMaterials;	//A list of materials used in the scene
 		std::vector<Light*>				m_lights;			//A list of light source in the scene
 
+		PrimitiveStore					m_store;			//structure of arrays copy of m_sceneObjects used for intersection
+		BVH								m_bvh;				//acceleration structure over the bounded objects
+		std::vector<PrimitiveStore::PrimRef>	m_boundedObjects;	//the primitives stored in m_bvh
+		std::vector<PrimitiveStore::PrimRef>	m_unboundedObjects;	//primitives without finite bounds, e.g. planes
+
+		unsigned int					m_version;			//incremented whenever the geometry of the scene changes
+
+		//Copy the objects into the store and sort them into bounded and unbounded objects
+		//bounds receives the bounds of the bounded objects in the order of m_boundedObjects
+		void SortObjects(std::vector<AABB>& bounds);
+
+		//Closest hit of the ray with the unbounded objects and the bounded objects below the given BVH nodes
+		RayHitResult IntersectNodes(Ray& ray, const int* nodes, int nodeCount);
+		void IntersectNodesByPacket(RayPacket& packet, Ray* rays, RayHitResult* results, const int* nodes, int nodeCount);
+
 		Colour							m_background;		//default background colour of the scene
 		double							m_sceneWidth;		//metric width of the scene in view space
 		double							m_sceneHeight;		//metric height of the scene in view space
@@ -35,11 +55,58 @@ class Scene
 
 		void InitDefaultScene();
 
+		//Create an object, material, light or asset in the arena of the scene
+		//Everything created this way is destroyed together by CleanupScene
+		template<typename T, typename... Args>
+		T* Create(Args&&... args)
+		{
+			return m_arena.Create<T>(std::forward<Args>(args)...);
+		}
+
+		//Add an object created by Create to the objects traced, BuildAccelerationStructure must be called
+		//once all the objects are added. Geometry only placed by instances is created but not added.
+		void AddObject(Primitive* object);
+
+		inline const Arena& GetArena() const
+		{
+			return m_arena;
+		}
+
+		//(Re)build the primitive store and the acceleration structure over the current list of scene objects
+		//This must be called whenever objects are added to or removed from the scene
+		void BuildAccelerationStructure();
+
+		//As BuildAccelerationStructure, using a tree built earlier over the same objects instead of building one
+		//The arrays are not copied and must stay valid until the scene is cleaned up, see SceneCache
+		void BuildAccelerationStructure(const BVH::Node* nodes, int nodeCount, const int* primIndices, int primCount);
+
+		inline const std::vector<Primitive*>& GetObjects() const
+		{
+			return m_sceneObjects;
+		}
+
+		inline const BVH& GetAccelerationStructure() const
+		{
+			return m_bvh;
+		}
+
+		//Returns a number that changes whenever the geometry of the scene changes,
+		//results cached from an earlier version of the scene are out of date
+		inline unsigned int GetVersion() const
+		{
+			return m_version;
+		}
+
 		inline void SetSceneWidth(double width)
 		{
 			m_sceneWidth = width;
 		}
 
+		inline void SetSceneHeight(double height)
+		{
+			m_sceneHeight = height;
+		}
+
 		inline Camera* GetSceneCamera()
 		{
 			return &m_activeCamera;
@@ -60,8 +127,66 @@ class Scene
 			return m_background;
 		}
 		
+		//Returns the bounds of the objects in the BVH, unbounded objects such as planes are left out
+		inline AABB GetBounds() const
+		{
+			return m_bvh.GetBounds();
+		}
+
+		//Returns the number of objects in the BVH
+		inline int GetBoundedObjectCount() const
+		{
+			return (int)m_boundedObjects.size();
+		}
+
+		//Collect the BVH nodes whose objects may be hit by rays inside the frustum, see BVH::CullFrustum
+		//Returns the number of objects below the nodes
+		inline int CullFrustum(const Frustum& frustum, std::vector<int>& nodes) const
+		{
+			return m_bvh.CullFrustum(frustum, nodes);
+		}
+
 		RayHitResult IntersectByRay(Ray& ray);
 
+		//As IntersectByRay, only testing the unbounded objects and the objects below the nodes given by CullFrustum
+		//Gives the same result as IntersectByRay for rays inside the frustum
+		RayHitResult IntersectByRay(Ray& ray, const std::vector<int>& nodes);
+
+		//Intersect a packet of up to RAYPACKET_SIZE rays with the scene
+		//Params:
+		//	RayPacket& packet			the rays in structure of arrays layout
+		//	Ray* rays					the same rays, used to compute the full hit result of each lane
+		//	RayHitResult* results		receives the closest hit of every active lane
+		void IntersectByPacket(RayPacket& packet, Ray* rays, RayHitResult* results);
+
+		//As IntersectByPacket, only testing the unbounded objects and the objects below the nodes given by CullFrustum
+		void IntersectByPacket(RayPacket& packet, Ray* rays, RayHitResult* results, const std::vector<int>& nodes);
+
+		//Any hit query for shadow rays, stops at the first blocking object instead of searching for the closest one
+		//Objects whose material does not cast shadows are skipped
+		//Params:
+		//	Ray& ray							the shadow ray
+		//	Scalar tmax							only hits closer than this distance block the ray
+		//	const PrimitiveStore::PrimRef& ignore	an object that never blocks the ray, e.g. the one being shaded
+		//	PrimitiveStore::PrimRef* occluder	if not null, receives the blocking object
+		//Returns true if the ray is blocked
+		bool IsOccluded(Ray& ray, Scalar tmax, const PrimitiveStore::PrimRef& ignore, PrimitiveStore::PrimRef* occluder = nullptr);
+
+		//Returns true if a single object blocks a shadow ray, with the same rules as IsOccluded
+		bool BlocksRay(const PrimitiveStore::PrimRef& ref, Ray& ray, Scalar tmax, const PrimitiveStore::PrimRef& ignore);
+
+		//Compute the texture coordinates of a hit, see PrimitiveStore::GetTexCoords
+		inline Scalar GetTexCoords(const RayHitResult& result, Scalar texcoords[2])
+		{
+			return m_store.GetTexCoords(result, texcoords);
+		}
+
+		//Returns the material of the object hit by a ray
+		inline Material* GetMaterial(const RayHitResult& result)
+		{
+			return m_store.GetMaterial(result.primtype, result.index);
+		}
+
 		inline std::vector<Light*>* GetLightList()
 		{
 			return &m_lights;
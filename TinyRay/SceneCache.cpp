@@ -0,0 +1,794 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+#include <map>
+#include <vector>
+
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Box.h"
+#include "Mesh.h"
+#include "Instance.h"
+
+//Sections of the file, each one an array of records
+enum CacheSection
+{
+	SECTION_Settings = 0,	//one CacheSettings
+	SECTION_Materials,		//CacheMaterial per material
+	SECTION_Lights,			//CacheLight per light
+	SECTION_Records,		//CacheObject per object, geometry placed by an instance comes before the instance
+	SECTION_Objects,		//int32 record index per scene object, in the order of the scene objects
+	SECTION_Scalars,		//Scalar values of the objects other than meshes
+	SECTION_Meshes,			//CacheMesh per mesh
+	SECTION_SceneNodes,		//BVH::Node per node of the scene BVH
+	SECTION_ScenePrims,		//int32 per primitive index of the scene BVH
+	SECTION_Count
+};
+
+//Position of a section or array in the file
+struct CacheRange
+{
+	uint64_t		offset;
+	uint64_t		size;			//in bytes
+};
+
+struct CacheHeader
+{
+	char			magic[4];		//"TRSC"
+	uint32_t		version;		//SceneCache::s_version
+	uint32_t		scalarSize;		//sizeof(Scalar)
+	uint32_t		nodeSize;		//sizeof(BVH::Node)
+	CacheRange		sections[SECTION_Count];
+};
+
+struct CacheSettings
+{
+	Scalar			cameraPosition[3];
+	Scalar			cameraUp[3];
+	Scalar			cameraView[3];
+	Scalar			cameraRight[3];
+	Scalar			cameraViewCentre[3];
+	double			focalLength;
+	Scalar			background[3];
+	double			sceneWidth;
+	double			sceneHeight;
+};
+
+struct CacheMaterial
+{
+	Scalar			ambient[3];
+	Scalar			diffuse[3];
+	Scalar			specular[3];
+	double			specPower;
+	int32_t			castShadow;
+};
+
+struct CacheLight
+{
+	Scalar			position[3];
+	Scalar			colour[3];
+};
+
+struct CacheObject
+{
+	int32_t			type;			//Primitive::PRIMTYPE
+	int32_t			material;		//index of the material, -1 if the object has none
+	int32_t			geometry;		//record of the geometry placed by an instance, -1 for other objects
+	int32_t			data;			//index of the mesh for meshes, offset into SECTION_Scalars for other objects
+	int32_t			count;			//number of values in SECTION_Scalars
+};
+
+//The arrays of a mesh, an offset of 0 marks an absent array
+struct CacheMesh
+{
+	int32_t			vertexCount;
+	int32_t			triangleCount;
+	int32_t			nodeCount;
+	int32_t			padding;
+	uint64_t		positions;		//3 Scalars per vertex
+	uint64_t		normals;		//3 Scalars per vertex
+	uint64_t		texcoords;		//2 Scalars per vertex
+	uint64_t		indices;		//3 uint32 per triangle
+	uint64_t		edges;			//6 Scalars per triangle
+	uint64_t		nodes;			//BVH::Node per node of the mesh BVH
+	uint64_t		primIndices;	//int32 per triangle
+};
+
+static const char s_magic[4] = { 'T', 'R', 'S', 'C' };
+static const uint64_t s_alignment = 16;		//alignment of every array in the file
+
+//Number of values of each kind of object in SECTION_Scalars
+static const int s_sphereScalars = 4;		//centre, radius
+static const int s_planeScalars = 4;		//normal, offset as stored by Plane
+static const int s_triangleScalars = 27;	//positions, normals, texcoords
+static const int s_boxScalars = 6;			//min, max of an axis-aligned box
+static const int s_boxCornerScalars = 24;	//corners of a transformed box
+static const int s_instanceScalars = 12;	//rows of the transform to world space
+
+//Writes arrays to the file, each one aligned to s_alignment
+class CacheWriter
+{
+	private:
+		FILE*			m_file;
+		uint64_t		m_offset;
+		bool			m_failed;
+
+	public:
+		CacheWriter(FILE* file)
+		{
+			m_file = file;
+			m_offset = 0;
+			m_failed = false;
+		}
+
+		//Returns the offset of the array in the file
+		uint64_t Write(const void* data, size_t size)
+		{
+			static const char padding[s_alignment] = {};
+
+			size_t padding_size = (size_t)((s_alignment - m_offset % s_alignment) % s_alignment);
+
+			if (padding_size && fwrite(padding, 1, padding_size, m_file) != padding_size) m_failed = true;
+			m_offset += padding_size;
+
+			uint64_t offset = m_offset;
+
+			if (size && fwrite(data, 1, size, m_file) != size) m_failed = true;
+			m_offset += size;
+
+			return offset;
+		}
+
+		template<typename T>
+		CacheRange WriteSection(const std::vector<T>& records)
+		{
+			CacheRange range;
+			range.size = records.size() * sizeof(T);
+			range.offset = Write(records.empty() ? nullptr : &records[0], (size_t)range.size);
+			return range;
+		}
+
+		inline uint64_t GetOffset() const
+		{
+			return m_offset;
+		}
+
+		inline bool HasFailed() const
+		{
+			return m_failed;
+		}
+};
+
+static void GetScalars(Vector3& vector, Scalar* values)
+{
+	values[0] = vector[0];
+	values[1] = vector[1];
+	values[2] = vector[2];
+}
+
+static void AddScalars(const Vector3& vector, std::vector<Scalar>& values)
+{
+	values.push_back(vector[0]);
+	values.push_back(vector[1]);
+	values.push_back(vector[2]);
+}
+
+static Vector3 ToVector(const Scalar* values)
+{
+	return Vector3(values[0], values[1], values[2]);
+}
+
+//Give the object a record, after the geometry it places if it is an instance
+static void AddRecord(Primitive* object, std::vector<Primitive*>& records, std::map<Primitive*, int>& recordIndices)
+{
+	if (recordIndices.count(object)) return;
+
+	if (object->m_primtype == Primitive::PRIMTYPE_Instance)
+		AddRecord(((Instance*)object)->GetGeometry(), records, recordIndices);
+
+	recordIndices[object] = (int)records.size();
+	records.push_back(object);
+}
+
+bool SceneCache::Save(Scene& scene, const char* filename, CacheStats* stats)
+{
+	double start_time = omp_get_wtime();
+
+	const std::vector<Primitive*>& objects = scene.GetObjects();
+	const BVH& scene_bvh = scene.GetAccelerationStructure();
+
+	if (scene_bvh.GetPrimCount() != scene.GetBoundedObjectCount())
+	{
+		printf("Error saving scene cache %s: the acceleration structure of the scene is not built\n", filename);
+		return false;
+	}
+
+	FILE* file = fopen(filename, "wb");
+
+	if (!file)
+	{
+		printf("Error opening scene cache file for writing: %s\n", filename);
+		return false;
+	}
+
+	//Number the objects, including the geometry only placed by instances
+	std::vector<Primitive*> records;
+	std::map<Primitive*, int> record_indices;
+	std::vector<int32_t> object_records;
+
+	for (int i = 0; i < (int)objects.size(); i++)
+	{
+		AddRecord(objects[i], records, record_indices);
+		object_records.push_back(record_indices[objects[i]]);
+	}
+
+	std::vector<CacheMaterial> materials;
+	std::map<Material*, int> material_indices;
+	std::vector<CacheObject> cache_objects;
+	std::vector<Scalar> scalars;
+	std::vector<CacheMesh> meshes;
+	CacheStats cache_stats = {};
+
+	CacheHeader header = {};
+	memcpy(header.magic, s_magic, sizeof(s_magic));
+	header.version = s_version;
+	header.scalarSize = sizeof(Scalar);
+	header.nodeSize = sizeof(BVH::Node);
+
+	//The header is written again once the sections are in place
+	CacheWriter writer(file);
+	writer.Write(&header, sizeof(header));
+
+	for (int i = 0; i < (int)records.size(); i++)
+	{
+		Primitive* object = records[i];
+		Material* material = object->GetMaterial();
+		CacheObject record = { object->m_primtype, -1, -1, (int32_t)scalars.size(), 0 };
+
+		if (material)
+		{
+			if (!material_indices.count(material))
+			{
+				CacheMaterial cache_material;
+				memset(&cache_material, 0, sizeof(cache_material));
+				GetScalars(material->GetAmbientColour(), cache_material.ambient);
+				GetScalars(material->GetDiffuseColour(), cache_material.diffuse);
+				GetScalars(material->GetSpecularColour(), cache_material.specular);
+				cache_material.specPower = material->GetSpecPower();
+				cache_material.castShadow = material->CastShadow();
+
+				material_indices[material] = (int)materials.size();
+				materials.push_back(cache_material);
+			}
+
+			record.material = material_indices[material];
+		}
+
+		switch (object->m_primtype)
+		{
+			case Primitive::PRIMTYPE_Sphere:
+			{
+				Sphere* sphere = (Sphere*)object;
+				AddScalars(sphere->GetCentre(), scalars);
+				scalars.push_back(sphere->GetRadius());
+				break;
+			}
+			case Primitive::PRIMTYPE_Plane:
+			{
+				Plane* plane = (Plane*)object;
+				AddScalars(plane->GetNormal(), scalars);
+				scalars.push_back(plane->GetOffset());
+				break;
+			}
+			case Primitive::PRIMTYPE_Triangle:
+			{
+				Triangle* triangle = (Triangle*)object;
+				for (int v = 0; v < 3; v++) AddScalars(triangle->m_vertices[v].m_position, scalars);
+				for (int v = 0; v < 3; v++) AddScalars(triangle->m_vertices[v].m_normal, scalars);
+				for (int v = 0; v < 3; v++) AddScalars(triangle->m_vertices[v].m_texcoords, scalars);
+				break;
+			}
+			case Primitive::PRIMTYPE_Box:
+			{
+				Box* box = (Box*)object;
+				Vector3 corners[8];
+
+				if (box->GetCorners(corners))
+				{
+					for (int c = 0; c < 8; c++) AddScalars(corners[c], scalars);
+				}
+				else
+				{
+					AddScalars(box->GetMin(), scalars);
+					AddScalars(box->GetMax(), scalars);
+				}
+				break;
+			}
+			case Primitive::PRIMTYPE_Mesh:
+			{
+				Mesh* mesh = (Mesh*)object;
+				const BVH& bvh = mesh->GetBVH();
+				int vertex_count = mesh->GetVertexCount();
+				int triangle_count = mesh->GetTriangleCount();
+				CacheMesh cache_mesh = {};
+
+				cache_mesh.vertexCount = vertex_count;
+				cache_mesh.triangleCount = triangle_count;
+				cache_mesh.nodeCount = bvh.GetNodeCount();
+
+				if (vertex_count)
+				{
+					cache_mesh.positions = writer.Write(mesh->GetPositions(), vertex_count * 3 * sizeof(Scalar));
+					if (mesh->GetNormals()) cache_mesh.normals = writer.Write(mesh->GetNormals(), vertex_count * 3 * sizeof(Scalar));
+					if (mesh->GetTexcoords()) cache_mesh.texcoords = writer.Write(mesh->GetTexcoords(), vertex_count * 2 * sizeof(Scalar));
+				}
+
+				if (triangle_count)
+				{
+					cache_mesh.indices = writer.Write(mesh->GetIndices(), triangle_count * 3 * sizeof(unsigned int));
+					cache_mesh.edges = writer.Write(mesh->GetEdges(), triangle_count * 6 * sizeof(Scalar));
+					cache_mesh.nodes = writer.Write(bvh.GetNodes(), bvh.GetNodeCount() * sizeof(BVH::Node));
+					cache_mesh.primIndices = writer.Write(bvh.GetPrimIndices(), triangle_count * sizeof(int));
+				}
+
+				record.data = (int32_t)meshes.size();
+				meshes.push_back(cache_mesh);
+
+				cache_stats.meshCount++;
+				cache_stats.triangleCount += triangle_count;
+				break;
+			}
+			case Primitive::PRIMTYPE_Instance:
+			{
+				Instance* instance = (Instance*)object;
+				const Transform& transform = instance->GetTransform();
+
+				for (int row = 0; row < 3; row++)
+					for (int column = 0; column < 4; column++)
+						scalars.push_back(transform.Get(row, column));
+
+				record.geometry = record_indices[instance->GetGeometry()];
+				break;
+			}
+			default:
+				break;
+		}
+
+		if (object->m_primtype != Primitive::PRIMTYPE_Mesh)
+			record.count = (int32_t)scalars.size() - record.data;
+
+		cache_objects.push_back(record);
+	}
+
+	//Settings
+	std::vector<CacheSettings> settings(1);
+	memset(&settings[0], 0, sizeof(CacheSettings));
+
+	Camera* camera = scene.GetSceneCamera();
+	GetScalars(camera->GetPosition(), settings[0].cameraPosition);
+	GetScalars(camera->GetUpVector(), settings[0].cameraUp);
+	GetScalars(camera->GetViewVector(), settings[0].cameraView);
+	GetScalars(camera->GetRightVector(), settings[0].cameraRight);
+	GetScalars(camera->GetViewCentre(), settings[0].cameraViewCentre);
+	settings[0].focalLength = camera->GetFocalLength();
+	GetScalars(scene.GetBackgroundColour(), settings[0].background);
+	settings[0].sceneWidth = scene.GetSceneWidth();
+	settings[0].sceneHeight = scene.GetSceneHeight();
+
+	//Lights
+	std::vector<Light*>& light_list = *scene.GetLightList();
+	std::vector<CacheLight> lights(light_list.size());
+
+	for (int i = 0; i < (int)light_list.size(); i++)
+	{
+		GetScalars(light_list[i]->GetLightPosition(), lights[i].position);
+		GetScalars(light_list[i]->GetLightColour(), lights[i].colour);
+	}
+
+	//Scene BVH
+	std::vector<BVH::Node> scene_nodes(scene_bvh.GetNodes(), scene_bvh.GetNodes() + scene_bvh.GetNodeCount());
+	std::vector<int32_t> scene_prims(scene_bvh.GetPrimIndices(), scene_bvh.GetPrimIndices() + scene_bvh.GetPrimCount());
+
+	header.sections[SECTION_Settings] = writer.WriteSection(settings);
+	header.sections[SECTION_Materials] = writer.WriteSection(materials);
+	header.sections[SECTION_Lights] = writer.WriteSection(lights);
+	header.sections[SECTION_Records] = writer.WriteSection(cache_objects);
+	header.sections[SECTION_Objects] = writer.WriteSection(object_records);
+	header.sections[SECTION_Scalars] = writer.WriteSection(scalars);
+	header.sections[SECTION_Meshes] = writer.WriteSection(meshes);
+	header.sections[SECTION_SceneNodes] = writer.WriteSection(scene_nodes);
+	header.sections[SECTION_ScenePrims] = writer.WriteSection(scene_prims);
+
+	uint64_t file_size = writer.GetOffset();
+	bool failed = writer.HasFailed();
+
+	if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) failed = true;
+	if (fclose(file) != 0) failed = true;
+
+	if (failed)
+	{
+		printf("Error writing scene cache file: %s\n", filename);
+		remove(filename);
+		return false;
+	}
+
+	if (stats)
+	{
+		*stats = cache_stats;
+		stats->fileSize = (size_t)file_size;
+		stats->objectCount = (int)records.size();
+		stats->time = (omp_get_wtime() - start_time) * 1000.0;
+	}
+
+	return true;
+}
+
+//Returns true if an array of count elements of the given size at offset lies within the file and is aligned
+static bool IsInFile(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+{
+	if (offset % s_alignment) return false;
+	if (offset > fileSize) return false;
+
+	return count <= (fileSize - offset) / size;
+}
+
+//The sections of a mapped file, set up by CheckLayout
+struct CacheView
+{
+	const CacheSettings*	settings;
+	const CacheMaterial*	materials;
+	const CacheLight*		lights;
+	const CacheObject*		records;
+	const int32_t*			objects;
+	const Scalar*			scalars;
+	const CacheMesh*		meshes;
+	const BVH::Node*		sceneNodes;
+	const int32_t*			scenePrims;
+	int						materialCount;
+	int						lightCount;
+	int						recordCount;
+	int						objectCount;
+	int						scalarCount;
+	int						meshCount;
+	int						sceneNodeCount;
+	int						scenePrimCount;
+};
+
+//Set up the view of a mapped file, checking that the header, sections and records refer only to data in the file
+//Returns null if the layout is valid, otherwise a description of the problem
+static const char* CheckLayout(const char* data, size_t size, CacheView& view)
+{
+	if (size < sizeof(CacheHeader)) return "the file is too small";
+
+	const CacheHeader* header = (const CacheHeader*)data;
+
+	if (memcmp(header->magic, s_magic, sizeof(s_magic)) != 0) return "not a scene cache file";
+	if (header->version != SceneCache::s_version) return "the file was written by a different version";
+	if (header->scalarSize != sizeof(Scalar) || header->nodeSize != sizeof(BVH::Node)) return "the file was written by a build with a different Scalar type";
+
+	static const size_t record_sizes[SECTION_Count] = { sizeof(CacheSettings), sizeof(CacheMaterial), sizeof(CacheLight),
+		sizeof(CacheObject), sizeof(int32_t), sizeof(Scalar), sizeof(CacheMesh), sizeof(BVH::Node), sizeof(int32_t) };
+	int counts[SECTION_Count];
+
+	for (int i = 0; i < SECTION_Count; i++)
+	{
+		const CacheRange& range = header->sections[i];
+
+		if (range.size % record_sizes[i] || range.size / record_sizes[i] > 0x7fffffff) return "malformed section";
+		counts[i] = (int)(range.size / record_sizes[i]);
+		if (!IsInFile(range.offset, counts[i], record_sizes[i], size)) return "section out of range";
+	}
+
+	if (counts[SECTION_Settings] != 1) return "malformed settings";
+
+	view.settings = (const CacheSettings*)(data + header->sections[SECTION_Settings].offset);
+	view.materials = (const CacheMaterial*)(data + header->sections[SECTION_Materials].offset);
+	view.lights = (const CacheLight*)(data + header->sections[SECTION_Lights].offset);
+	view.records = (const CacheObject*)(data + header->sections[SECTION_Records].offset);
+	view.objects = (const int32_t*)(data + header->sections[SECTION_Objects].offset);
+	view.scalars = (const Scalar*)(data + header->sections[SECTION_Scalars].offset);
+	view.meshes = (const CacheMesh*)(data + header->sections[SECTION_Meshes].offset);
+	view.sceneNodes = (const BVH::Node*)(data + header->sections[SECTION_SceneNodes].offset);
+	view.scenePrims = (const int32_t*)(data + header->sections[SECTION_ScenePrims].offset);
+	view.materialCount = counts[SECTION_Materials];
+	view.lightCount = counts[SECTION_Lights];
+	view.recordCount = counts[SECTION_Records];
+	view.objectCount = counts[SECTION_Objects];
+	view.scalarCount = counts[SECTION_Scalars];
+	view.meshCount = counts[SECTION_Meshes];
+	view.sceneNodeCount = counts[SECTION_SceneNodes];
+	view.scenePrimCount = counts[SECTION_ScenePrims];
+
+	if ((view.sceneNodeCount == 0) != (view.scenePrimCount == 0)) return "malformed scene BVH";
+
+	//The tree holds every bounded object once, which Load checks when the objects are created, so its
+	//primitive indices are below its primitive count
+	if (!BVH::CheckTree(view.sceneNodes, view.sceneNodeCount, (const int*)view.scenePrims, view.scenePrimCount, view.scenePrimCount))
+		return "malformed scene BVH";
+
+	for (int i = 0; i < view.recordCount; i++)
+	{
+		const CacheObject& record = view.records[i];
+		int scalar_count = 0;
+
+		if (record.material < -1 || record.material >= view.materialCount) return "material out of range";
+
+		switch (record.type)
+		{
+			case Primitive::PRIMTYPE_Sphere: scalar_count = s_sphereScalars; break;
+			case Primitive::PRIMTYPE_Plane: scalar_count = s_planeScalars; break;
+			case Primitive::PRIMTYPE_Triangle: scalar_count = s_triangleScalars; break;
+			case Primitive::PRIMTYPE_Box: scalar_count = record.count == s_boxScalars ? s_boxScalars : s_boxCornerScalars; break;
+			case Primitive::PRIMTYPE_Instance:
+				scalar_count = s_instanceScalars;
+				if (record.geometry < 0 || record.geometry >= i) return "instance geometry out of range";
+				break;
+			case Primitive::PRIMTYPE_Mesh:
+			{
+				if (record.data < 0 || record.data >= view.meshCount) return "mesh out of range";
+
+				const CacheMesh& mesh = view.meshes[record.data];
+				uint64_t vertices = mesh.vertexCount;
+				uint64_t triangles = mesh.triangleCount;
+
+				if (mesh.vertexCount < 0 || mesh.triangleCount < 0 || mesh.nodeCount < 0) return "malformed mesh";
+				if ((triangles == 0) != (mesh.nodeCount == 0)) return "malformed mesh BVH";
+				if (vertices && !IsInFile(mesh.positions, vertices * 3, sizeof(Scalar), size)) return "mesh positions out of range";
+				if (mesh.normals && !IsInFile(mesh.normals, vertices * 3, sizeof(Scalar), size)) return "mesh normals out of range";
+				if (mesh.texcoords && !IsInFile(mesh.texcoords, vertices * 2, sizeof(Scalar), size)) return "mesh texcoords out of range";
+
+				if (triangles)
+				{
+					if (!IsInFile(mesh.indices, triangles * 3, sizeof(unsigned int), size)) return "mesh indices out of range";
+					if (!IsInFile(mesh.edges, triangles * 6, sizeof(Scalar), size)) return "mesh edges out of range";
+					if (!IsInFile(mesh.nodes, mesh.nodeCount, sizeof(BVH::Node), size)) return "mesh BVH out of range";
+					if (!IsInFile(mesh.primIndices, triangles, sizeof(int), size)) return "mesh BVH out of range";
+				}
+				continue;
+			}
+			default:
+				return "unknown object type";
+		}
+
+		if (record.count != scalar_count || record.data < 0 || record.data > view.scalarCount - scalar_count) return "object data out of range";
+	}
+
+	for (int i = 0; i < view.objectCount; i++)
+	{
+		if (view.objects[i] < 0 || view.objects[i] >= view.recordCount) return "object out of range";
+	}
+
+	return nullptr;
+}
+
+//Create the object of a record in the arena of the scene, the geometry of an instance is created before it
+static Primitive* CreateObject(Scene& scene, const CacheView& view, const char* data, const CacheObject& record,
+	const std::vector<Primitive*>& objects, const std::vector<Material*>& materials)
+{
+	const Scalar* values = view.scalars + record.data;
+	Primitive* object = nullptr;
+
+	switch (record.type)
+	{
+		case Primitive::PRIMTYPE_Sphere:
+			object = scene.Create<Sphere>(values[0], values[1], values[2], values[3]);
+			break;
+		case Primitive::PRIMTYPE_Plane:
+		{
+			Plane* plane = scene.Create<Plane>();
+			plane->SetPlane(ToVector(values), -values[3]);
+			object = plane;
+			break;
+		}
+		case Primitive::PRIMTYPE_Triangle:
+		{
+			Triangle* triangle = scene.Create<Triangle>();
+			Vector3 vertices[9];
+
+			for (int v = 0; v < 9; v++) vertices[v] = ToVector(values + v * 3);
+
+			triangle->SetVertices(vertices[0], vertices[1], vertices[2]);
+			triangle->SetNormals(vertices[3], vertices[4], vertices[5]);
+			triangle->SetTexCoords(vertices[6], vertices[7], vertices[8]);
+			object = triangle;
+			break;
+		}
+		case Primitive::PRIMTYPE_Box:
+		{
+			Box* box = scene.Create<Box>();
+
+			if (record.count == s_boxScalars)
+			{
+				box->GetMin() = ToVector(values);
+				box->GetMax() = ToVector(values + 3);
+			}
+			else
+			{
+				Vector3 corners[8];
+				for (int c = 0; c < 8; c++) corners[c] = ToVector(values + c * 3);
+				box->SetBox(corners);
+			}
+			object = box;
+			break;
+		}
+		case Primitive::PRIMTYPE_Mesh:
+		{
+			const CacheMesh& cache_mesh = view.meshes[record.data];
+			Mesh* mesh = scene.Create<Mesh>();
+
+			mesh->SetExternal(cache_mesh.vertexCount,
+				cache_mesh.positions ? (const Scalar*)(data + cache_mesh.positions) : nullptr,
+				cache_mesh.normals ? (const Scalar*)(data + cache_mesh.normals) : nullptr,
+				cache_mesh.texcoords ? (const Scalar*)(data + cache_mesh.texcoords) : nullptr,
+				cache_mesh.triangleCount,
+				cache_mesh.indices ? (const unsigned int*)(data + cache_mesh.indices) : nullptr,
+				cache_mesh.edges ? (const Scalar*)(data + cache_mesh.edges) : nullptr,
+				cache_mesh.nodes ? (const BVH::Node*)(data + cache_mesh.nodes) : nullptr,
+				cache_mesh.nodeCount,
+				cache_mesh.primIndices ? (const int*)(data + cache_mesh.primIndices) : nullptr);
+			object = mesh;
+			break;
+		}
+		case Primitive::PRIMTYPE_Instance:
+		{
+			Transform transform;
+
+			for (int row = 0; row < 3; row++)
+				for (int column = 0; column < 4; column++)
+					transform.Set(row, column, values[row * 4 + column]);
+
+			object = scene.Create<Instance>(objects[record.geometry], transform);
+			break;
+		}
+		default:
+			break;
+	}
+
+	object->SetMaterial(record.material >= 0 ? materials[record.material] : nullptr);
+
+	return object;
+}
+
+bool SceneCache::Load(Scene& scene, const char* filename, CacheStats* stats)
+{
+	double start_time = omp_get_wtime();
+	CacheView view;
+
+	//Check the file before the scene is touched
+	{
+		MappedFile file;
+
+		if (!file.Open(filename))
+		{
+			printf("Error opening scene cache file: %s\n", filename);
+			return false;
+		}
+
+		const char* error = CheckLayout(file.GetData(), file.GetSize(), view);
+
+		if (error)
+		{
+			printf("Error in scene cache file %s: %s\n", filename, error);
+			return false;
+		}
+	}
+
+	scene.CleanupScene();
+
+	//The mapping lives in the arena of the scene and is closed when the scene is cleaned up
+	MappedFile* file = scene.Create<MappedFile>();
+	const char* error = nullptr;
+
+	if (!file->Open(filename))
+		error = "the file can no longer be read";
+	else
+		error = CheckLayout(file->GetData(), file->GetSize(), view);
+
+	if (error)
+	{
+		printf("Error in scene cache file %s: %s\n", filename, error);
+		scene.CleanupScene();
+		return false;
+	}
+
+	const char* data = file->GetData();
+
+	//Settings
+	const CacheSettings& settings = *view.settings;
+	Camera* camera = scene.GetSceneCamera();
+
+	camera->GetPosition() = ToVector(settings.cameraPosition);
+	camera->GetUpVector() = ToVector(settings.cameraUp);
+	camera->GetViewVector() = ToVector(settings.cameraView);
+	camera->GetRightVector() = ToVector(settings.cameraRight);
+	camera->GetViewCentre() = ToVector(settings.cameraViewCentre);
+	camera->SetFocalLength(settings.focalLength);
+	scene.GetBackgroundColour() = ToVector(settings.background);
+	scene.SetSceneWidth(settings.sceneWidth);
+	scene.SetSceneHeight(settings.sceneHeight);
+
+	//Materials
+	std::vector<Material*> materials(view.materialCount);
+
+	for (int i = 0; i < view.materialCount; i++)
+	{
+		const CacheMaterial& cache_material = view.materials[i];
+		Material* material = scene.Create<Material>();
+
+		material->GetAmbientColour() = ToVector(cache_material.ambient);
+		material->GetDiffuseColour() = ToVector(cache_material.diffuse);
+		material->GetSpecularColour() = ToVector(cache_material.specular);
+		material->SetSpecPower(cache_material.specPower);
+		material->SetCastShadow(cache_material.castShadow != 0);
+		materials[i] = material;
+	}
+
+	//Lights
+	for (int i = 0; i < view.lightCount; i++)
+	{
+		Light* light = scene.Create<Light>();
+
+		light->GetLightPosition() = ToVector(view.lights[i].position);
+		light->GetLightColour() = ToVector(view.lights[i].colour);
+		scene.GetLightList()->push_back(light);
+	}
+
+	//Objects
+	std::vector<Primitive*> objects(view.recordCount);
+	CacheStats cache_stats = {};
+
+	for (int i = 0; i < view.recordCount; i++)
+	{
+		objects[i] = CreateObject(scene, view, data, view.records[i], objects, materials);
+
+		if (view.records[i].type == Primitive::PRIMTYPE_Mesh)
+		{
+			cache_stats.meshCount++;
+			cache_stats.triangleCount += view.meshes[view.records[i].data].triangleCount;
+		}
+	}
+
+	for (int i = 0; i < view.objectCount; i++)
+		scene.AddObject(objects[view.objects[i]]);
+
+	scene.BuildAccelerationStructure(view.sceneNodeCount ? view.sceneNodes : nullptr, view.sceneNodeCount,
+		view.scenePrimCount ? view.scenePrims : nullptr, view.scenePrimCount);
+
+	//Which objects are bounded is only known once they are created, so this leaves the scene empty
+	if (scene.GetBoundedObjectCount() != view.scenePrimCount)
+	{
+		printf("Error in scene cache file %s: the scene BVH does not match the objects\n", filename);
+		scene.CleanupScene();
+		return false;
+	}
+
+	if (stats)
+	{
+		*stats = cache_stats;
+		stats->fileSize = file->GetSize();
+		stats->objectCount = view.recordCount;
+		stats->time = (omp_get_wtime() - start_time) * 1000.0;
+	}
+
+	return true;
+}
+
+void SceneCache::PrintStats(const char* filename, const CacheStats& stats)
+{
+	fprintf(stdout, "%s: %d objects, %d meshes, %d triangles, %.2f MB in %.2f ms\n",
+		filename, stats.objectCount, stats.meshCount, stats.triangleCount, stats.fileSize / 1048576.0, stats.time);
+}
@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stddef.h>
+
+class Scene;
+
+//Saves a scene together with its acceleration structures to a binary cache file and loads it back.
+//The file holds flat arrays without pointers: the camera and scene settings, the materials and lights,
+//one record per object, the vertex, index and BVH arrays of every mesh and the nodes of the scene BVH.
+//Loading maps the file and points the meshes and the scene BVH straight at the mapped arrays, so nothing
+//is parsed or built, and pages of the file are only read from disk as the renderer touches them.
+//The file is written in the byte order and Scalar type of the machine that saves it and is rejected
+//by a build with a different Scalar type or file version. Textures are not stored.
+class SceneCache
+{
+	public:
+		//Statistics gathered by the last call to Save or Load
+		struct CacheStats
+		{
+			size_t			fileSize;		//size of the file in bytes
+			int				objectCount;	//number of objects in the file, including geometry only placed by instances
+			int				meshCount;		//number of meshes
+			int				triangleCount;	//number of triangles of all the meshes
+			double			time;			//time to save or load in milliseconds
+		};
+
+		static const unsigned int	s_version = 1;	//incremented whenever the layout of the file changes
+
+	public:
+		//Write the scene to the given file, the acceleration structure of the scene must be built
+		//Returns false if the file cannot be written, the reason is printed to stdout
+		static bool			Save(Scene& scene, const char* filename, CacheStats* stats = nullptr);
+
+		//Replace the contents of the scene by the scene in the given file
+		//The file stays mapped until the scene is cleaned up. The layout of the file and the scene BVH are
+		//checked, the contents of the mesh arrays and mesh BVHs are trusted to be the ones written by Save.
+		//Returns false if the file cannot be read or is not a cache of this build, the reason is printed to
+		//stdout and the scene is left as it was. If the scene BVH turns out not to match the objects once
+		//they are created, Load also returns false but the scene is left empty.
+		static bool			Load(Scene& scene, const char* filename, CacheStats* stats = nullptr);
+
+		//Print the statistics of a save or load to stdout
+		static void			PrintStats(const char* filename, const CacheStats& stats);
+};
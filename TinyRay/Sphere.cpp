@@ -7,8 +7,10 @@
 * to use and extend the functionality. The code provided here is functional
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
-#include <math.h>
+#include <cmath>
 #include "Sphere.h"
+#include "AABB.h"
+#include "RayPacket.h"
 
 Sphere::Sphere()
 {
@@ -20,7 +22,7 @@ Sphere::Sphere()
 	m_primtype = PRIMTYPE_Sphere;
 }
 
-Sphere::Sphere(double x, double y, double z, double r)
+Sphere::Sphere(Scalar x, Scalar y, Scalar z, Scalar r)
 {
 	m_centre.SetVector(x, y, z);
 	m_radius = r;
@@ -35,38 +37,110 @@ RayHitResult Sphere::IntersectByRay(Ray& ray)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
 
+	Scalar t = IntersectSphere(m_centre, m_radius, ray);
+
+	if (t >= FARFAR_AWAY) return result;
+
+	result.t = t;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
+
+	CompleteSphereHit(m_centre, ray, result);
+
+	return result;
+}
+
+__m128 Sphere::IntersectByPacket(const RayPacket& packet)
+{
+	return IntersectSpherePacket(m_centre, m_radius, packet);
+}
+
+Scalar Sphere::IntersectSphere(const Vector3& centre, Scalar radius, Ray& ray)
+{
 	Vector3 negateRay = ray.GetRay();
 	
 	negateRay[0] = -ray.GetRay()[0];
 	negateRay[1] = -ray.GetRay()[1];
 	negateRay[2] = -ray.GetRay()[2];
 
-	Vector3 centreToEye = ray.GetRayStart() - this->GetCentre();
+	Vector3 centreToEye = ray.GetRayStart() - centre;
 	
-	double dotRayCentreToEye = ray.GetRay().DotProduct(centreToEye);
-	double dotRayRay = ray.GetRay().DotProduct(ray.GetRay());
-	double dotCentreToEye = centreToEye.DotProduct(centreToEye);
-	double radiusSqr = m_radius*m_radius;
+	Scalar dotRayCentreToEye = ray.GetRay().DotProduct(centreToEye);
+	Scalar dotRayRay = ray.GetRay().DotProduct(ray.GetRay());
+	Scalar dotCentreToEye = centreToEye.DotProduct(centreToEye);
+	Scalar radiusSqr = radius*radius;
 
-	double discriminant = pow(2.0*dotRayRay*dotRayCentreToEye, 2) - 4.0*dotRayRay*(dotRayCentreToEye - radiusSqr);
+	Scalar q = 2*dotRayRay*dotRayCentreToEye;
+	Scalar discriminant = q*q - 4*dotRayRay*(dotRayCentreToEye - radiusSqr);
 
-	if (discriminant < 0.0) return result;
+	if (discriminant < 0) return FARFAR_AWAY;
 
-	double omega_plus = negateRay.DotProduct(centreToEye) +
-		sqrt(dotRayCentreToEye*dotRayCentreToEye - dotRayRay*(dotCentreToEye - radiusSqr));
+	Scalar omega_plus = negateRay.DotProduct(centreToEye) +
+		std::sqrt(dotRayCentreToEye*dotRayCentreToEye - dotRayRay*(dotCentreToEye - radiusSqr));
 	omega_plus /= dotRayRay;
 
-	double omega_minus = negateRay.DotProduct(centreToEye) -
-		sqrt(dotRayCentreToEye*dotRayCentreToEye - dotRayRay*(dotCentreToEye - radiusSqr));
+	Scalar omega_minus = negateRay.DotProduct(centreToEye) -
+		std::sqrt(dotRayCentreToEye*dotRayCentreToEye - dotRayRay*(dotCentreToEye - radiusSqr));
 	
 	omega_minus /= dotRayRay;
 
-	result.t = omega_plus < omega_minus ? omega_plus : omega_minus;
-	result.data = this;
-	
+	return omega_plus < omega_minus ? omega_plus : omega_minus;
+}
+
+void Sphere::CompleteSphereHit(const Vector3& centre, Ray& ray, RayHitResult& result)
+{
 	Vector3 intersection_point = ray.GetRayStart() + ray.GetRay()*result.t;
 	result.point = intersection_point;
-	result.normal = (intersection_point - m_centre).Normalise();
+	result.normal = (intersection_point - centre).Normalise();
+}
 
-	return result;
+Scalar Sphere::ComputeSphereTexCoords(const Vector3& centre, Scalar radius, const Vector3& point, Scalar texcoords[2])
+{
+	const Scalar pi = (Scalar)3.14159265358979323846;
+
+	Vector3 direction = (point - centre) * (1 / radius);
+	Scalar height = direction[1] < -1 ? -1 : (direction[1] > 1 ? 1 : direction[1]);
+
+	texcoords[0] = (Scalar)0.5 + (Scalar)std::atan2(direction[2], direction[0]) / (2 * pi);
+	texcoords[1] = (Scalar)std::acos(height) / pi;
+
+	return pi * radius;
+}
+
+__m128 Sphere::IntersectSpherePacket(const Vector3& centre, Scalar radius, const RayPacket& packet)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 radius_sqr = _mm_set1_ps((float)(radius*radius));
+
+	__m128 cx = _mm_sub_ps(packet.ox, _mm_set1_ps(centre[0]));
+	__m128 cy = _mm_sub_ps(packet.oy, _mm_set1_ps(centre[1]));
+	__m128 cz = _mm_sub_ps(packet.oz, _mm_set1_ps(centre[2]));
+
+	__m128 dotRayCentreToEye = PacketDot(packet.dx, packet.dy, packet.dz, cx, cy, cz);
+	__m128 dotRayRay = PacketDot(packet.dx, packet.dy, packet.dz, packet.dx, packet.dy, packet.dz);
+	__m128 dotCentreToEye = PacketDot(cx, cy, cz, cx, cy, cz);
+
+	//Same rejection test as IntersectSphere
+	__m128 q = _mm_mul_ps(_mm_set1_ps(2.0f), _mm_mul_ps(dotRayRay, dotRayCentreToEye));
+	__m128 discriminant = _mm_sub_ps(_mm_mul_ps(q, q),
+		_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), dotRayRay), _mm_sub_ps(dotRayCentreToEye, radius_sqr)));
+	__m128 hit = _mm_cmpge_ps(discriminant, zero);
+
+	__m128 root = _mm_sqrt_ps(_mm_sub_ps(_mm_mul_ps(dotRayCentreToEye, dotRayCentreToEye),
+		_mm_mul_ps(dotRayRay, _mm_sub_ps(dotCentreToEye, radius_sqr))));
+	__m128 negDot = _mm_sub_ps(zero, dotRayCentreToEye);
+
+	__m128 omega_plus = _mm_div_ps(_mm_add_ps(negDot, root), dotRayRay);
+	__m128 omega_minus = _mm_div_ps(_mm_sub_ps(negDot, root), dotRayRay);
+
+	return PacketSelect(hit, _mm_min_ps(omega_plus, omega_minus), _mm_set1_ps(FARFAR_AWAY));
+}
+
+bool Sphere::GetBounds(AABB& bounds)
+{
+	Vector3 extent(m_radius, m_radius, m_radius);
+
+	bounds = AABB(m_centre - extent, m_centre + extent);
+
+	return true;
 }
@@ -16,11 +16,11 @@ class Sphere : public Primitive
 {
 	private:
 		Vector3				m_centre;			//location of the centre of the sphere
-		double				m_radius;			//the radius of the sphere
+		Scalar				m_radius;			//the radius of the sphere
 
 	public:
 		Sphere();
-		Sphere(double x, double y, double z, double r);
+		Sphere(Scalar x, Scalar y, Scalar z, Scalar r);
 		~Sphere();
 
 		inline Vector3&		GetCentre()
@@ -28,11 +28,24 @@ class Sphere : public Primitive
 			return m_centre;
 		}
 
-		inline double		GetRadius()
+		inline Scalar		GetRadius()
 		{
 			return m_radius;
 		}
 
 		RayHitResult		IntersectByRay(Ray& ray);
+		__m128				IntersectByPacket(const RayPacket& packet);
+		bool				GetBounds(AABB& bounds);
+
+		//Intersection kernels shared by Sphere and the SoA storage of PrimitiveStore
+		//IntersectSphere returns the hit distance, or FARFAR_AWAY if the ray misses
+		//CompleteSphereHit fills in the point and normal of a hit at distance result.t
+		static Scalar		IntersectSphere(const Vector3& centre, Scalar radius, Ray& ray);
+		static __m128		IntersectSpherePacket(const Vector3& centre, Scalar radius, const RayPacket& packet);
+		static void			CompleteSphereHit(const Vector3& centre, Ray& ray, RayHitResult& result);
+
+		//Texture coordinates of a point on a sphere, longitude and latitude with v = 0 at the top
+		//Returns the world space length of one unit of texture coordinates along a meridian
+		static Scalar		ComputeSphereTexCoords(const Vector3& centre, Scalar radius, const Vector3& point, Scalar texcoords[2]);
 };
 
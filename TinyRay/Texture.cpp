@@ -0,0 +1,266 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "Texture.h"
+#include "Ray.h"
+#include "ImageIO.h"
+#include "TextureCache.h"
+
+const unsigned int Texture::s_mortonSpread[Texture::s_tileSize] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+
+static const Scalar s_texelScale = (Scalar)(1.0 / 255.0);
+
+Texture::Texture()
+{
+	m_filter = FILTER_TRILINEAR;
+	m_layout = LAYOUT_TILED;
+	m_cache = nullptr;
+	m_cacheFile = -1;
+}
+
+Texture::~Texture()
+{
+}
+
+inline size_t Texture::GetTexelIndex(const MipLevel& level, int x, int y) const
+{
+	if (m_layout == LAYOUT_LINEAR)
+		return level.offset + (size_t)y * level.width + x;
+
+	size_t tile = (size_t)(y >> s_tileShift) * level.tilesX + (x >> s_tileShift);
+
+	return level.offset + tile * s_tileTexels + (s_mortonSpread[x & (s_tileSize - 1)] | (s_mortonSpread[y & (s_tileSize - 1)] << 1));
+}
+
+inline unsigned int Texture::GetTexel(int level, int x, int y, int thread) const
+{
+	const MipLevel& mip = m_levels[level];
+
+	if (!m_cache) return m_texels[GetTexelIndex(mip, x, y)];
+
+	int tile = (y >> s_cacheTileShift) * mip.tilesX + (x >> s_cacheTileShift);
+
+	return m_cache->GetTile(thread, m_cacheFile, level, tile)[GetCacheTileTexel(x & (s_cacheTileSize - 1), y & (s_cacheTileSize - 1))];
+}
+
+unsigned int Texture::AverageTexels(const unsigned int quad[4])
+{
+	unsigned int texel = 0;
+
+	for (int c = 0; c < 32; c += 8)
+	{
+		unsigned int sum = ((quad[0] >> c) & 0xff) + ((quad[1] >> c) & 0xff) + ((quad[2] >> c) & 0xff) + ((quad[3] >> c) & 0xff);
+		texel |= ((sum + 2) >> 2) << c;
+	}
+
+	return texel;
+}
+
+size_t Texture::CreateLevels(int width, int height, Layout layout)
+{
+	m_layout = layout;
+	m_levels.clear();
+
+	//Each level is half the size of the one before down to a single texel
+	size_t texel_count = 0;
+	int tile_shift = layout == LAYOUT_CACHED ? s_cacheTileShift : s_tileShift;
+
+	for (int w = width, h = height; ; w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+	{
+		MipLevel level;
+		level.width = w;
+		level.height = h;
+		level.tilesX = (w + (1 << tile_shift) - 1) >> tile_shift;
+		level.offset = texel_count;
+		m_levels.push_back(level);
+
+		if (layout == LAYOUT_LINEAR)
+			texel_count += (size_t)w * h;
+		else if (layout == LAYOUT_TILED)
+			texel_count += (size_t)level.tilesX * ((h + s_tileSize - 1) >> s_tileShift) * s_tileTexels;
+
+		if (w == 1 && h == 1) break;
+	}
+
+	return texel_count;
+}
+
+bool Texture::Create(int width, int height, int channels, const unsigned char* image, Layout layout)
+{
+	if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || !image || layout == LAYOUT_CACHED) return false;
+
+	m_cache = nullptr;
+	m_cacheFile = -1;
+
+	std::vector<unsigned int>(CreateLevels(width, height, layout), 0).swap(m_texels);
+
+	//Each level is a 2x2 box filter of the level before, the last row or column of an odd size is repeated
+	std::vector<unsigned int> current((size_t)width * height);
+	std::vector<unsigned int> next;
+
+	for (size_t i = 0; i < current.size(); i++)
+	{
+		const unsigned char* texel = image + i * channels;
+		current[i] = texel[0] | (texel[1] << 8) | (texel[2] << 16) | ((channels == 4 ? texel[3] : 255u) << 24);
+	}
+
+	for (int l = 0; l < (int)m_levels.size(); l++)
+	{
+		const MipLevel& level = m_levels[l];
+
+		for (int y = 0; y < level.height; y++)
+			for (int x = 0; x < level.width; x++)
+				m_texels[GetTexelIndex(level, x, y)] = current[(size_t)y * level.width + x];
+
+		if (l + 1 == (int)m_levels.size()) break;
+
+		const MipLevel& smaller = m_levels[l + 1];
+		next.resize((size_t)smaller.width * smaller.height);
+
+		for (int y = 0; y < smaller.height; y++)
+		{
+			int y0 = y * 2;
+			int y1 = y0 + 1 < level.height ? y0 + 1 : y0;
+
+			for (int x = 0; x < smaller.width; x++)
+			{
+				int x0 = x * 2;
+				int x1 = x0 + 1 < level.width ? x0 + 1 : x0;
+				unsigned int quad[4] = { current[(size_t)y0 * level.width + x0], current[(size_t)y0 * level.width + x1],
+					current[(size_t)y1 * level.width + x0], current[(size_t)y1 * level.width + x1] };
+
+				next[(size_t)y * smaller.width + x] = AverageTexels(quad);
+			}
+		}
+
+		current.swap(next);
+	}
+
+	return true;
+}
+
+bool Texture::LoadTGA(const char* filename, Layout layout)
+{
+	unsigned char* image = NULL;
+	int width, height, bpp, channels;
+
+	if (ImageIO::LoadTGA(filename, &image, &width, &height, &bpp, &channels) != E_IMAGEIO_SUCCESS)
+	{
+		printf("Error loading texture: %s\n", filename);
+		return false;
+	}
+
+	bool result = Create(width, height, channels, image, layout);
+	delete[] image;
+
+	return result;
+}
+
+void Texture::CreateCached(TextureCache* cache, int file, int width, int height)
+{
+	std::vector<unsigned int>().swap(m_texels);
+	CreateLevels(width, height, LAYOUT_CACHED);
+
+	m_cache = cache;
+	m_cacheFile = file;
+}
+
+void Texture::AddBilinear(int l, Scalar u, Scalar v, Scalar weight, int thread, Scalar rgb[3]) const
+{
+	const MipLevel& level = m_levels[l];
+
+	//Texel centres are at half integer coordinates, x and y are at least -0.5 so truncation finds the texel below
+	Scalar x = u * level.width - (Scalar)0.5;
+	Scalar y = v * level.height - (Scalar)0.5;
+	int x0 = (int)(x + 1) - 1;
+	int y0 = (int)(y + 1) - 1;
+	Scalar fx = x - x0;
+	Scalar fy = y - y0;
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+
+	//The coordinates are within one texel of the level, wrap them around
+	if (x0 < 0) x0 = level.width - 1;
+	if (y0 < 0) y0 = level.height - 1;
+	if (x1 >= level.width) x1 = 0;
+	if (y1 >= level.height) y1 = 0;
+
+	unsigned int texels[4] = { GetTexel(l, x0, y0, thread), GetTexel(l, x1, y0, thread),
+		GetTexel(l, x0, y1, thread), GetTexel(l, x1, y1, thread) };
+	Scalar weights[4] = { (1 - fx) * (1 - fy) * weight, fx * (1 - fy) * weight, (1 - fx) * fy * weight, fx * fy * weight };
+
+	//Plain Scalar arithmetic, the Vector3 operators are not inlined
+	for (int t = 0; t < 4; t++)
+	{
+		rgb[0] += weights[t] * (Scalar)(texels[t] & 0xff);
+		rgb[1] += weights[t] * (Scalar)((texels[t] >> 8) & 0xff);
+		rgb[2] += weights[t] * (Scalar)((texels[t] >> 16) & 0xff);
+	}
+}
+
+Colour Texture::Sample(Scalar u, Scalar v, Scalar footprint) const
+{
+	//Also rejects NaN coordinates
+	if (m_levels.empty() || !(fabs(u) < FARFAR_AWAY && fabs(v) < FARFAR_AWAY)) return Colour(1.0, 1.0, 1.0);
+
+	const MipLevel& base = m_levels[0];
+
+	//Wrap the coordinates into the texture
+	u -= floor(u);
+	v -= floor(v);
+
+	//Tiles of the cached layout stay valid until EndRead
+	int thread = m_cache ? m_cache->BeginRead() : 0;
+	Scalar rgb[3] = { 0, 0, 0 };
+
+	if (m_filter == FILTER_NEAREST)
+	{
+		int x = (int)(u * base.width);
+		int y = (int)(v * base.height);
+		if (x >= base.width) x = base.width - 1;
+		if (y >= base.height) y = base.height - 1;
+
+		unsigned int texel = GetTexel(0, x, y, thread);
+		rgb[0] = (Scalar)(texel & 0xff);
+		rgb[1] = (Scalar)((texel >> 8) & 0xff);
+		rgb[2] = (Scalar)((texel >> 16) & 0xff);
+	}
+	else if (m_filter == FILTER_BILINEAR)
+	{
+		AddBilinear(0, u, v, 1, thread, rgb);
+	}
+	else
+	{
+		//The level whose texels are as wide as the footprint
+		int size = base.width > base.height ? base.width : base.height;
+		Scalar texels = footprint * size;
+		Scalar lod = texels > 1 ? (Scalar)(log(texels) * 1.4426950408889634) : 0;
+		int last = (int)m_levels.size() - 1;
+
+		if (lod >= last)
+		{
+			AddBilinear(last, u, v, 1, thread, rgb);
+		}
+		else
+		{
+			int level = (int)lod;
+			Scalar blend = lod - level;
+
+			AddBilinear(level, u, v, 1 - blend, thread, rgb);
+			if (blend > 0) AddBilinear(level + 1, u, v, blend, thread, rgb);
+		}
+	}
+
+	if (m_cache) m_cache->EndRead(thread);
+
+	return Colour(rgb[0] * s_texelScale, rgb[1] * s_texelScale, rgb[2] * s_texelScale);
+}
@@ -0,0 +1,166 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "Vector3.h"
+
+typedef Vector3 Colour;
+
+class TextureCache;
+
+//class representing a texture in TinyRay
+//The image is kept with a pyramid of mip levels, each half the size of the one before, built when the
+//texture is created. Texels are packed 8-bit RGBA. In the tiled layout every level is split into tiles of
+//8x8 texels, 256 bytes each, with the texels of a tile in Morton (Z) order, so the 2x2 texels of a bilinear
+//lookup and the lookups of neighbouring rays mostly share cache lines whichever way the texture is crossed.
+//The linear layout stores the rows one after another and is kept for comparison.
+//Textures of the cached layout are created by the TextureCache, which loads their texels in larger tiles of 64x64
+//texels, each made of 8x8 tiles in Morton order, on first use and may evict them again.
+//Texture coordinates wrap, (0, 0) is the top left corner of the image.
+class Texture
+{
+	public:
+		enum TEXUNIT
+		{
+			TEXUNIT_DIFFUSE = 0,
+			TEXUNIT_NORMAL = 1
+		};
+
+		enum Filter
+		{
+			FILTER_NEAREST = 0,		//nearest texel of the full resolution image
+			FILTER_BILINEAR,		//bilinear interpolation of the full resolution image
+			FILTER_TRILINEAR		//bilinear interpolation of the two mip levels closest to the footprint, blended
+		};
+
+		enum Layout
+		{
+			LAYOUT_LINEAR = 0,		//rows of texels one after another
+			LAYOUT_TILED,			//8x8 tiles in rows, texels in Morton order within a tile
+			LAYOUT_CACHED			//64x64 tiles loaded on demand by a TextureCache, see GetCacheTileTexel
+		};
+
+		static const int	s_cacheTileShift = 6;
+		static const int	s_cacheTileSize = 1 << s_cacheTileShift;
+
+	private:
+		struct MipLevel
+		{
+			int				width;
+			int				height;
+			int				tilesX;			//number of tiles across the level in the tiled and cached layouts
+			size_t			offset;			//index of the first texel of the level in m_texels
+		};
+
+		static const int	s_tileShift = 3;
+		static const int	s_tileSize = 1 << s_tileShift;
+		static const int	s_tileTexels = s_tileSize * s_tileSize;
+
+		//Bits of a 3-bit coordinate spread apart to be interleaved with those of the other coordinate
+		static const unsigned int s_mortonSpread[s_tileSize];
+
+		std::vector<unsigned int>	m_texels;		//texels of all levels, 8-bit RGBA with red in the lowest byte
+		std::vector<MipLevel>		m_levels;		//m_levels[0] is the full resolution image
+		Filter				m_filter;
+		Layout				m_layout;
+		TextureCache*		m_cache;		//cache holding the texels of the cached layout
+		int					m_cacheFile;	//index of the texture's file in m_cache
+
+		//Lay out a pyramid of levels down to a single texel, returns the number of texels they take in m_texels
+		size_t				CreateLevels(int width, int height, Layout layout);
+
+		inline size_t		GetTexelIndex(const MipLevel& level, int x, int y) const;
+
+		//Returns the texel of a level, thread is the reader of the cached layout returned by TextureCache::BeginRead
+		inline unsigned int	GetTexel(int level, int x, int y, int thread) const;
+
+		//Add weight times the bilinear interpolation of the texels of a level around the texture coordinates to rgb
+		//u and v are in [0, 1], the texture coordinates wrapped into the texture
+		void				AddBilinear(int level, Scalar u, Scalar v, Scalar weight, int thread, Scalar rgb[3]) const;
+
+	public:
+		Texture();
+		~Texture();
+
+		//Create the texture and its mip levels from an image of 8-bit channels stored row by row from the top
+		//channels is 3 for RGB or 4 for RGBA, returns false if the image is empty or has other channels
+		bool				Create(int width, int height, int channels, const unsigned char* image, Layout layout = LAYOUT_TILED);
+
+		//Load an uncompressed 24 or 32-bit TGA image with ImageIO and create the texture from it
+		//Returns false if the file cannot be loaded
+		bool				LoadTGA(const char* filename, Layout layout = LAYOUT_TILED);
+
+		//Lay out a texture of the cached layout whose texels are loaded by the cache, used by TextureCache::Acquire
+		void				CreateCached(TextureCache* cache, int file, int width, int height);
+
+		//Returns the index of texel (x, y) within a 64x64 tile of the cached layout
+		static inline int	GetCacheTileTexel(int x, int y)
+		{
+			int tile = ((y >> s_tileShift) << (s_cacheTileShift - s_tileShift)) | (x >> s_tileShift);
+
+			return (tile << (2 * s_tileShift)) | s_mortonSpread[x & (s_tileSize - 1)] | (s_mortonSpread[y & (s_tileSize - 1)] << 1);
+		}
+
+		//Returns the 2x2 box filter of four texels, as used to build each level from the one before
+		static unsigned int	AverageTexels(const unsigned int quad[4]);
+
+		inline void			SetFilter(Filter filter)
+		{
+			m_filter = filter;
+		}
+
+		inline Filter		GetFilter() const
+		{
+			return m_filter;
+		}
+
+		inline Layout		GetLayout() const
+		{
+			return m_layout;
+		}
+
+		inline int			GetWidth() const
+		{
+			return m_levels.empty() ? 0 : m_levels[0].width;
+		}
+
+		inline int			GetHeight() const
+		{
+			return m_levels.empty() ? 0 : m_levels[0].height;
+		}
+
+		inline int			GetLevelCount() const
+		{
+			return (int)m_levels.size();
+		}
+
+		inline int			GetLevelWidth(int level) const
+		{
+			return m_levels[level].width;
+		}
+
+		inline int			GetLevelHeight(int level) const
+		{
+			return m_levels[level].height;
+		}
+
+		//Returns the number of bytes used by the texels of all levels, 0 for the cached layout whose texels the cache holds
+		inline size_t		GetMemoryUsage() const
+		{
+			return m_texels.capacity() * sizeof(unsigned int);
+		}
+
+		//Returns the colour of the texture at the texture coordinates (u, v)
+		//footprint is the width, in texture coordinates, of the area the sample stands for, e.g. a pixel
+		//projected onto the surface. It selects the mip levels of FILTER_TRILINEAR and is ignored otherwise.
+		Colour				Sample(Scalar u, Scalar v, Scalar footprint) const;
+};
@@ -0,0 +1,422 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+#include "TextureCache.h"
+#include "ImageIO.h"
+
+static const size_t s_defaultBudget = 256 * 1048576;
+
+//Returns the full path of a file, so the same file asked for under different paths is only loaded once
+static std::string GetFullPath(const char* filename)
+{
+#if defined(WIN32) || defined(_WINDOWS)
+	char* path = _fullpath(nullptr, filename, 0);
+#else
+	char* path = realpath(filename, nullptr);
+#endif
+
+	if (!path) return filename;
+
+	std::string result = path;
+	free(path);
+
+	return result;
+}
+
+TextureCache::TextureCache()
+{
+	omp_init_lock(&m_lock);
+	m_clock = 0;
+	m_budget = s_defaultBudget;
+	m_residentBytes = 0;
+	m_retiredBytes = 0;
+	m_peakBytes = 0;
+	m_requests = 0;
+	std::vector<ThreadState>(omp_get_max_threads()).swap(m_threads);
+	ResetStats();
+}
+
+TextureCache::~TextureCache()
+{
+	Clear();
+	omp_destroy_lock(&m_lock);
+}
+
+TextureCache& TextureCache::GetInstance()
+{
+	static TextureCache s_cache;
+
+	return s_cache;
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+	m_budget = bytes;
+}
+
+Texture* TextureCache::Acquire(const char* filename)
+{
+	std::string path = GetFullPath(filename);
+
+	m_requests++;
+
+	for (size_t i = 0; i < m_files.size(); i++)
+	{
+		if (m_files[i]->path == path) return &m_files[i]->texture;
+	}
+
+	File* file = new File;
+	int width, height;
+
+	if (!file->image.Open(filename) || ImageIO::ParseTGA((const unsigned char*)file->image.GetData(), file->image.GetSize(),
+		&file->pixels, &width, &height, &file->channels, &file->topFirst) != E_IMAGEIO_SUCCESS)
+	{
+		printf("Error loading texture: %s\n", filename);
+		delete file;
+		return nullptr;
+	}
+
+	file->path = path;
+	file->texture.CreateCached(this, (int)m_files.size(), width, height);
+
+	//Number the tiles of all levels one after another
+	//A tile filters up to 2x2 tiles of the level before, which may have to be loaded too, down to the file
+	int tile_count = 0;
+
+	for (int l = 0; l < file->texture.GetLevelCount(); l++)
+	{
+		int tiles_x = (file->texture.GetLevelWidth(l) + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+		int tiles_y = (file->texture.GetLevelHeight(l) + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+
+		file->levelTiles.push_back(tile_count);
+		tile_count += tiles_x * tiles_y;
+
+		if (l == 0)
+		{
+			file->levelCost.push_back(1);
+		}
+		else
+		{
+			int larger_x = (file->texture.GetLevelWidth(l - 1) + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+			int larger_y = (file->texture.GetLevelHeight(l - 1) + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+			file->levelCost.push_back(1 + std::min(larger_x, 2) * std::min(larger_y, 2) * file->levelCost[l - 1]);
+		}
+	}
+
+	std::vector<std::atomic<Tile*> >(tile_count).swap(file->tiles);
+
+	for (int i = 0; i < tile_count; i++)
+		file->tiles[i].store(nullptr, std::memory_order_relaxed);
+
+	m_files.push_back(file);
+
+	//The threads may have been changed since the cache was created
+	if ((int)m_threads.size() < omp_get_max_threads())
+	{
+		std::vector<ThreadState>(omp_get_max_threads()).swap(m_threads);
+		ResetStats();
+	}
+
+	return &file->texture;
+}
+
+void TextureCache::Clear()
+{
+	omp_set_lock(&m_lock);
+
+	for (size_t i = 0; i < m_resident.size(); i++)
+		delete m_resident[i];
+
+	FreeRetiredTiles(true);
+
+	for (size_t i = 0; i < m_files.size(); i++)
+		delete m_files[i];
+
+	m_resident.clear();
+	m_files.clear();
+	m_residentBytes = 0;
+
+	omp_unset_lock(&m_lock);
+}
+
+TextureCache::Stats TextureCache::GetStats()
+{
+	Stats stats;
+
+	omp_set_lock(&m_lock);
+
+	stats.requests = m_requests;
+	stats.files = (int)m_files.size();
+	stats.lookups = 0;
+	stats.misses = 0;
+	stats.loads = 0;
+	stats.evictions = m_evictions;
+	stats.stallTime = 0.0;
+	stats.residentBytes = m_residentBytes;
+	stats.peakBytes = m_peakBytes;
+	stats.budget = m_budget;
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		stats.lookups += m_threads[i].lookups;
+		stats.misses += m_threads[i].misses;
+		stats.loads += m_threads[i].loads;
+		stats.stallTime += m_threads[i].stallTime;
+	}
+
+	omp_unset_lock(&m_lock);
+
+	return stats;
+}
+
+void TextureCache::ResetStats()
+{
+	omp_set_lock(&m_lock);
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		m_threads[i].lookups = 0;
+		m_threads[i].misses = 0;
+		m_threads[i].loads = 0;
+		m_threads[i].stallTime = 0.0;
+	}
+
+	m_evictions = 0;
+	m_peakBytes = m_residentBytes + m_retiredBytes;
+
+	omp_unset_lock(&m_lock);
+}
+
+void TextureCache::PrintStats(const Stats& stats)
+{
+	printf("  texture cache: %.2f%% hits of %lld tile lookups, %lld stalls (%.2f ms), %lld tiles loaded, %lld evicted\n",
+		stats.lookups > 0 ? 100.0 * (stats.lookups - stats.misses) / stats.lookups : 100.0, stats.lookups,
+		stats.misses, stats.stallTime, stats.loads, stats.evictions);
+	printf("  texture cache: %.2f MB resident, %.2f MB peak, %.2f MB budget\n",
+		stats.residentBytes / 1048576.0, stats.peakBytes / 1048576.0, stats.budget / 1048576.0);
+}
+
+const unsigned int* TextureCache::LoadTile(int thread, int file, int level, int tile)
+{
+	ThreadState& state = m_threads[thread];
+	File* data = m_files[file];
+	double start_time = omp_get_wtime();
+
+	//Build the tile outside the lock, so threads missing different tiles load them at the same time
+	Tile* loaded = BuildTile(thread, file, level, tile);
+
+	while (!AddTile(loaded, true))
+	{
+		//Another thread loaded the tile first, unless it has been evicted again since
+		Tile* resident = data->tiles[loaded->slot].load();
+
+		if (resident)
+		{
+			delete loaded;
+			loaded = resident;
+			break;
+		}
+	}
+
+	state.misses++;
+	state.stallTime += (omp_get_wtime() - start_time) * 1000.0;
+
+	//The tile may have been evicted already, but it is not freed before this thread's EndRead
+	return loaded->texels;
+}
+
+TextureCache::Tile* TextureCache::BuildTile(int thread, int file, int level, int tile)
+{
+	ThreadState& state = m_threads[thread];
+	File* data = m_files[file];
+	const Texture& texture = data->texture;
+	int width = texture.GetLevelWidth(level);
+	int height = texture.GetLevelHeight(level);
+	int tiles_x = (width + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+	int x0 = (tile % tiles_x) << Texture::s_cacheTileShift;
+	int y0 = (tile / tiles_x) << Texture::s_cacheTileShift;
+	int x1 = std::min(x0 + Texture::s_cacheTileSize, width);
+	int y1 = std::min(y0 + Texture::s_cacheTileSize, height);
+	const int mask = Texture::s_cacheTileSize - 1;
+
+	Tile* built = new Tile;
+	built->file = data;
+	built->level = level;
+	built->slot = data->levelTiles[level] + tile;
+	unsigned int* texels = built->texels;
+
+	state.loads++;
+
+	if (level == 0)
+	{
+		//Convert the BGR(A) pixels of the rows of the tile
+		for (int y = y0; y < y1; y++)
+		{
+			int row = data->topFirst ? y : height - 1 - y;
+			const unsigned char* pixel = data->pixels + ((size_t)row * width + x0) * data->channels;
+
+			for (int x = x0; x < x1; x++, pixel += data->channels)
+			{
+				unsigned int alpha = data->channels == 4 ? pixel[3] : 255u;
+				texels[Texture::GetCacheTileTexel(x & mask, y & mask)] = pixel[2] | (pixel[1] << 8) | (pixel[0] << 16) | (alpha << 24);
+			}
+		}
+
+		return built;
+	}
+
+	//A tile of a smaller level is filtered from up to 2x2 tiles of the level before, with the same 2x2 box filter as
+	//Texture::Create, one quarter of the tile from each. The last row or column of an odd size is repeated, which
+	//stays within the tile of the texel.
+	int larger_width = texture.GetLevelWidth(level - 1);
+	int larger_height = texture.GetLevelHeight(level - 1);
+	int larger_tiles_x = (larger_width + Texture::s_cacheTileSize - 1) >> Texture::s_cacheTileShift;
+	const int half = Texture::s_cacheTileSize / 2;
+
+	for (int qy = y0; qy < y1; qy += half)
+	{
+		for (int qx = x0; qx < x1; qx += half)
+		{
+			int larger_tile = ((qy * 2) >> Texture::s_cacheTileShift) * larger_tiles_x + ((qx * 2) >> Texture::s_cacheTileShift);
+			Tile* source = data->tiles[data->levelTiles[level - 1] + larger_tile].load();
+			Tile* owned = nullptr;
+
+			if (!source)
+				source = owned = BuildTile(thread, file, level - 1, larger_tile);
+
+			for (int y = qy; y < std::min(qy + half, y1); y++)
+			{
+				int ly0 = y * 2;
+				int ly1 = ly0 + 1 < larger_height ? ly0 + 1 : ly0;
+
+				for (int x = qx; x < std::min(qx + half, x1); x++)
+				{
+					int lx0 = x * 2;
+					int lx1 = lx0 + 1 < larger_width ? lx0 + 1 : lx0;
+					unsigned int quad[4] = { source->texels[Texture::GetCacheTileTexel(lx0 & mask, ly0 & mask)],
+						source->texels[Texture::GetCacheTileTexel(lx1 & mask, ly0 & mask)],
+						source->texels[Texture::GetCacheTileTexel(lx0 & mask, ly1 & mask)],
+						source->texels[Texture::GetCacheTileTexel(lx1 & mask, ly1 & mask)] };
+
+					texels[Texture::GetCacheTileTexel(x & mask, y & mask)] = Texture::AverageTexels(quad);
+				}
+			}
+
+			//Keep the tile of the larger level if it fits, without evicting tiles to make room for it
+			if (owned && !AddTile(owned, false))
+				delete owned;
+
+			//This thread holds no tiles of the cache now, let the tiles evicted so far be freed
+			//Loading a tile of a small level can take long, other threads would otherwise keep evicted tiles until it ends
+			state.sequence.store(state.sequence.load(std::memory_order_relaxed) + 2);
+		}
+	}
+
+	return built;
+}
+
+bool TextureCache::AddTile(Tile* tile, bool evict)
+{
+	bool added = false;
+
+	omp_set_lock(&m_lock);
+
+	std::atomic<Tile*>& slot = tile->file->tiles[tile->slot];
+
+	if (!slot.load() && (evict || m_residentBytes + m_retiredBytes + sizeof(Tile) <= m_budget))
+	{
+		tile->lastUse.store(++m_clock + tile->file->levelCost[tile->level], std::memory_order_relaxed);
+		slot.store(tile);
+
+		m_resident.push_back(tile);
+		m_residentBytes += sizeof(Tile);
+		added = true;
+
+		FreeRetiredTiles(false);
+
+		if (m_residentBytes > m_budget)
+			EvictTiles();
+
+		if (m_residentBytes + m_retiredBytes > m_peakBytes)
+			m_peakBytes = m_residentBytes + m_retiredBytes;
+	}
+
+	omp_unset_lock(&m_lock);
+
+	return added;
+}
+
+void TextureCache::EvictTiles()
+{
+	size_t target = m_budget / 8 * 7;
+	size_t count = (m_residentBytes - target + sizeof(Tile) - 1) / sizeof(Tile);
+
+	if (count > m_resident.size()) count = m_resident.size();
+
+	//Lookups keep updating lastUse, so sort a snapshot of it rather than the tiles themselves
+	std::vector<std::pair<unsigned int, Tile*>> uses(m_resident.size());
+
+	for (size_t i = 0; i < m_resident.size(); i++)
+		uses[i] = std::make_pair(m_resident[i]->lastUse.load(std::memory_order_relaxed), m_resident[i]);
+
+	//Move the count least recently used tiles to the front
+	std::nth_element(uses.begin(), uses.begin() + (count - 1), uses.end(),
+		[](const std::pair<unsigned int, Tile*>& a, const std::pair<unsigned int, Tile*>& b) { return a.first < b.first; });
+
+	RetiredTiles retired;
+	retired.tiles.resize(count);
+	m_resident.resize(uses.size() - count);
+
+	for (size_t i = 0; i < count; i++)
+		retired.tiles[i] = uses[i].second;
+
+	for (size_t i = count; i < uses.size(); i++)
+		m_resident[i - count] = uses[i].second;
+
+	for (size_t i = 0; i < retired.tiles.size(); i++)
+		retired.tiles[i]->file->tiles[retired.tiles[i]->slot].store(nullptr);
+
+	//Threads in a sample now may have found the tiles before they were removed, threads starting one later cannot
+	for (size_t i = 0; i < m_threads.size(); i++)
+		retired.sequences.push_back(m_threads[i].sequence.load());
+
+	m_residentBytes -= count * sizeof(Tile);
+	m_retiredBytes += count * sizeof(Tile);
+	m_evictions += count;
+	m_retired.push_back(retired);
+}
+
+void TextureCache::FreeRetiredTiles(bool all)
+{
+	for (size_t i = 0; i < m_retired.size(); )
+	{
+		RetiredTiles& retired = m_retired[i];
+		bool reading = false;
+
+		//A thread is still in the sample it was in when the tiles were evicted if its sequence is odd and unchanged
+		for (size_t t = 0; t < retired.sequences.size() && !all && !reading; t++)
+			reading = (retired.sequences[t] & 1) && m_threads[t].sequence.load() == retired.sequences[t];
+
+		if (reading)
+		{
+			i++;
+			continue;
+		}
+
+		for (size_t t = 0; t < retired.tiles.size(); t++)
+			delete retired.tiles[t];
+
+		m_retiredBytes -= retired.tiles.size() * sizeof(Tile);
+		m_retired.erase(m_retired.begin() + i);
+	}
+}
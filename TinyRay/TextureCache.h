@@ -0,0 +1,192 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <omp.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "Texture.h"
+
+//A process-wide cache of the textures loaded from uncompressed TGA files.
+//Textures are shared, every request for the same file, under whatever path, returns the same Texture.
+//The file is memory mapped instead of read, and texels are loaded a 64x64 tile of one mip level at a time when
+//a sample first touches the tile: tiles of the full resolution image are converted from the rows of the file and
+//tiles of the smaller levels are filtered from the tiles of the level before, which are loaded in turn if they are
+//not resident and kept if the budget allows. A tile of a small level stands for a large part of the image, so the
+//first sample of a distant surface may read the whole file once. When the tiles take more memory than the budget,
+//the least recently used ones are evicted in a batch. Recency is counted in tile loads and a tile counts as used
+//later by the number of loads it would take to load it again, so the tiles of the small levels are kept longer.
+//Samples find resident tiles without locking. Each thread marks its samples with BeginRead and EndRead, and an
+//evicted tile is only freed once every thread that was reading when it was evicted has moved on, either by
+//finishing that sample or by finishing a part of a tile it was loading.
+class TextureCache
+{
+	public:
+		struct Stats
+		{
+			int				requests;		//number of calls of Acquire
+			int				files;			//number of distinct files, the other requests shared a texture
+			long long		lookups;		//tile lookups by samples
+			long long		misses;			//lookups that found their tile missing and stalled the sample to load it
+			long long		loads;			//tiles loaded, including those loaded to filter a smaller level
+			long long		evictions;		//tiles evicted to stay within the budget
+			double			stallTime;		//time samples waited for tiles to load in milliseconds, summed over threads
+			size_t			residentBytes;	//memory of the tiles in the cache
+			size_t			peakBytes;		//most memory held by tiles, including evicted tiles not yet freed
+			size_t			budget;
+		};
+
+	private:
+		struct File;
+
+		struct Tile
+		{
+			unsigned int	texels[Texture::s_cacheTileSize * Texture::s_cacheTileSize];	//see Texture::GetCacheTileTexel
+			std::atomic<unsigned int> lastUse;		//m_clock when the tile was last looked up plus its level's load cost
+			File*			file;
+			int				level;
+			int				slot;					//index of the tile in the file's tile table
+		};
+
+		struct File
+		{
+			std::string		path;					//full path of the file, shared textures are found by it
+			MappedFile		image;
+			const unsigned char* pixels;			//BGR(A) rows in the mapping
+			int				channels;
+			bool			topFirst;				//rows are stored from the top of the image
+			Texture			texture;
+			std::vector<int> levelTiles;			//index in tiles of the first tile of every level
+			std::vector<unsigned int> levelCost;	//most tile loads it takes to load a tile of every level
+			std::vector<std::atomic<Tile*> > tiles;	//resident tiles of all levels, null if not loaded
+		};
+
+		struct ThreadState
+		{
+			std::atomic<unsigned int> sequence;		//odd while the thread is in a sample, changes whenever it holds no tiles
+			long long		lookups;
+			long long		misses;
+			long long		loads;
+			double			stallTime;
+			char			padding[64];			//keep the threads' counters on separate cache lines
+		};
+
+		//Tiles evicted together and the sequence of every thread at the time
+		struct RetiredTiles
+		{
+			std::vector<Tile*>			tiles;
+			std::vector<unsigned int>	sequences;
+		};
+
+		std::vector<File*>			m_files;
+		std::vector<Tile*>			m_resident;
+		std::vector<RetiredTiles>	m_retired;
+		std::vector<ThreadState>	m_threads;		//indexed by OpenMP thread number
+		std::atomic<unsigned int>	m_clock;		//advanced by every tile load
+		omp_lock_t					m_lock;			//guards the tile lists and counters, not the lookups
+		size_t						m_budget;
+		size_t						m_residentBytes;
+		size_t						m_retiredBytes;
+		size_t						m_peakBytes;
+		int							m_requests;
+		long long					m_evictions;
+
+		//The cache is shared, not copied
+		TextureCache(const TextureCache&);
+		TextureCache&				operator=(const TextureCache&);
+
+		//Load a tile a sample found missing, the sample waits for it
+		const unsigned int*			LoadTile(int thread, int file, int level, int tile);
+
+		//Returns a new tile holding the texels of a tile of a level, not yet in the cache
+		Tile*						BuildTile(int thread, int file, int level, int tile);
+
+		//Add a tile built by BuildTile to the cache, if evict is false only if it fits in the budget without evicting others
+		//Returns false if the tile was not added, because it did not fit or another thread added it first
+		bool						AddTile(Tile* tile, bool evict);
+
+		//Evict the least recently used tiles until they take at most 7/8 of the budget, called with m_lock held
+		void						EvictTiles();
+
+		//Free the evicted tiles no thread can still be reading, called with m_lock held
+		void						FreeRetiredTiles(bool all);
+
+	public:
+		TextureCache();
+		~TextureCache();
+
+		//Returns the cache shared by the whole process
+		static TextureCache&		GetInstance();
+
+		//Set the memory the tiles may take, tiles are evicted the next time one is loaded
+		void						SetBudget(size_t bytes);
+
+		inline size_t				GetBudget() const
+		{
+			return m_budget;
+		}
+
+		//Returns the texture of an uncompressed 24 or 32-bit TGA file, loading the file the first time it is asked for
+		//Returns null if the file cannot be loaded. The texture belongs to the cache and lives until Clear.
+		//Must not be called while another thread samples a texture of the cache.
+		Texture*					Acquire(const char* filename);
+
+		//Release every texture and tile, no texture of the cache may be used afterwards or be in use
+		void						Clear();
+
+		Stats						GetStats();
+
+		//Reset the lookup, load and stall counters, not while textures of the cache are sampled
+		void						ResetStats();
+
+		static void					PrintStats(const Stats& stats);
+
+		//Mark the start of a sample of the calling thread, the tiles it looks up stay valid until EndRead
+		//Returns the thread to pass to GetTile and EndRead
+		inline int					BeginRead()
+		{
+			int thread = omp_get_thread_num();
+			ThreadState& state = m_threads[thread];
+
+			//Sequentially consistent, so the tile lookups that follow cannot be seen before it by an evicting thread
+			state.sequence.store(state.sequence.load(std::memory_order_relaxed) + 1);
+
+			return thread;
+		}
+
+		inline void					EndRead(int thread)
+		{
+			ThreadState& state = m_threads[thread];
+
+			state.sequence.store(state.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		//Returns the texels of a tile of a level of a file's texture, loading the tile if it is not resident
+		//tile is the index of the tile among the tiles of the level, in rows
+		inline const unsigned int*	GetTile(int thread, int file, int level, int tile)
+		{
+			File* data = m_files[file];
+			Tile* resident = data->tiles[data->levelTiles[level] + tile].load();
+
+			m_threads[thread].lookups++;
+
+			if (!resident) return LoadTile(thread, file, level, tile);
+
+			//Only write the time of use when it changes, to keep the tiles shared in the threads' caches
+			unsigned int use = m_clock.load(std::memory_order_relaxed) + data->levelCost[level];
+			if (resident->lastUse.load(std::memory_order_relaxed) != use)
+				resident->lastUse.store(use, std::memory_order_relaxed);
+
+			return resident->texels;
+		}
+};
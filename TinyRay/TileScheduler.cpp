@@ -0,0 +1,186 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <algorithm>
+#include "TileScheduler.h"
+
+//Interleave the bits of x and y, x in the even bits
+static unsigned int MortonKey(unsigned int x, unsigned int y)
+{
+	unsigned int key = 0;
+
+	for (int bit = 0; bit < 16; bit++)
+	{
+		key |= ((x >> bit) & 1) << (2 * bit);
+		key |= ((y >> bit) & 1) << (2 * bit + 1);
+	}
+
+	return key;
+}
+
+//Distance of cell (x, y) along the Hilbert curve filling an n*n grid, n a power of two
+static unsigned int HilbertKey(unsigned int n, unsigned int x, unsigned int y)
+{
+	unsigned int key = 0;
+
+	for (unsigned int s = n / 2; s > 0; s /= 2)
+	{
+		unsigned int rx = (x & s) > 0;
+		unsigned int ry = (y & s) > 0;
+		key += s * s * ((3 * rx) ^ ry);
+
+		//Rotate the quadrant so the curve stays continuous
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+
+	return key;
+}
+
+TileScheduler::TileScheduler()
+{
+	m_stats.tileCount = 0;
+	m_stats.stolenCount = 0;
+	m_stats.threadCount = 0;
+	m_stats.renderTime = 0.0;
+}
+
+TileScheduler::~TileScheduler()
+{
+	DestroyQueues();
+}
+
+void TileScheduler::Setup(int width, int height, int tileSize, TileOrder order)
+{
+	int tiles_x = (width + tileSize - 1) / tileSize;
+	int tiles_y = (height + tileSize - 1) / tileSize;
+
+	//The Hilbert curve is defined over a square power of two grid, tiles outside the image are skipped
+	unsigned int grid = 1;
+	while (grid < (unsigned int)tiles_x || grid < (unsigned int)tiles_y)
+		grid *= 2;
+
+	std::vector<std::pair<unsigned int, Tile> > keyed_tiles;
+
+	for (int ty = 0; ty < tiles_y; ty++)
+	{
+		for (int tx = 0; tx < tiles_x; tx++)
+		{
+			Tile tile;
+			tile.x0 = tx * tileSize;
+			tile.y0 = ty * tileSize;
+			tile.x1 = std::min(tile.x0 + tileSize, width);
+			tile.y1 = std::min(tile.y0 + tileSize, height);
+
+			unsigned int key;
+
+			switch (order)
+			{
+				case TILE_ORDER_MORTON:
+					key = MortonKey(tx, ty);
+					break;
+				case TILE_ORDER_HILBERT:
+					key = HilbertKey(grid, tx, ty);
+					break;
+				default:
+					key = ty * tiles_x + tx;
+					break;
+			}
+
+			keyed_tiles.push_back(std::make_pair(key, tile));
+		}
+	}
+
+	std::sort(keyed_tiles.begin(), keyed_tiles.end(),
+		[](const std::pair<unsigned int, Tile>& a, const std::pair<unsigned int, Tile>& b) { return a.first < b.first; });
+
+	m_tiles.clear();
+
+	for (size_t i = 0; i < keyed_tiles.size(); i++)
+		m_tiles.push_back(keyed_tiles[i].second);
+
+	m_stats.tileCount = (int)m_tiles.size();
+}
+
+void TileScheduler::InitQueues(int threadCount)
+{
+	int tile_count = (int)m_tiles.size();
+
+	m_queues.resize(threadCount);
+
+	//Give every thread a contiguous run of the curve
+	for (int i = 0; i < threadCount; i++)
+	{
+		omp_init_lock(&m_queues[i].lock);
+		m_queues[i].head = (int)((long long)tile_count * i / threadCount);
+		m_queues[i].tail = (int)((long long)tile_count * (i + 1) / threadCount);
+	}
+}
+
+void TileScheduler::DestroyQueues()
+{
+	for (size_t i = 0; i < m_queues.size(); i++)
+		omp_destroy_lock(&m_queues[i].lock);
+
+	m_queues.clear();
+}
+
+int TileScheduler::PopTile(int thread)
+{
+	WorkQueue& queue = m_queues[thread];
+	int tile = -1;
+
+	omp_set_lock(&queue.lock);
+	if (queue.head < queue.tail)
+		tile = queue.head++;
+	omp_unset_lock(&queue.lock);
+
+	return tile;
+}
+
+int TileScheduler::StealTile(int thread)
+{
+	int thread_count = (int)m_queues.size();
+
+	//Visit the other queues starting from the next thread, take the last tile of the first non-empty one
+	for (int i = 1; i < thread_count; i++)
+	{
+		WorkQueue& queue = m_queues[(thread + i) % thread_count];
+		int tile = -1;
+
+		omp_set_lock(&queue.lock);
+		if (queue.head < queue.tail)
+			tile = --queue.tail;
+		omp_unset_lock(&queue.lock);
+
+		if (tile >= 0) return tile;
+	}
+
+	return -1;
+}
+
+const char* TileScheduler::GetOrderName(TileOrder order)
+{
+	switch (order)
+	{
+		case TILE_ORDER_MORTON:
+			return "Morton";
+		case TILE_ORDER_HILBERT:
+			return "Hilbert";
+		default:
+			return "scanline";
+	}
+}
@@ -0,0 +1,116 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <omp.h>
+#include <vector>
+
+//Order in which the tiles of the image are laid out along the work queues
+enum TileOrder
+{
+	TILE_ORDER_SCANLINE = 0,	//row by row
+	TILE_ORDER_MORTON,			//Z-order curve
+	TILE_ORDER_HILBERT			//Hilbert curve, neighbouring tiles are always adjacent in the image
+};
+
+//A rectangle of pixels [x0, x1) x [y0, y1)
+struct Tile
+{
+	int x0, y0;
+	int x1, y1;
+};
+
+//Splits an image into square tiles and renders them on all OpenMP threads.
+//The tiles are ordered along a space filling curve and handed out as contiguous runs,
+//one run per thread, so a thread keeps working on neighbouring pixels. A thread that
+//runs out of tiles steals from the far end of another thread's run.
+class TileScheduler
+{
+	public:
+		struct Stats
+		{
+			int				tileCount;		//number of tiles in the image
+			int				stolenCount;	//number of tiles rendered by a thread other than their owner
+			int				threadCount;	//number of threads used for the last run
+			double			renderTime;		//wall clock time of the last run in milliseconds
+		};
+
+	private:
+		//Double ended queue over a contiguous run of m_tiles, the owner pops at head and thieves at tail
+		struct WorkQueue
+		{
+			omp_lock_t		lock;
+			int				head;
+			int				tail;
+		};
+
+		std::vector<Tile>		m_tiles;		//all tiles of the image in curve order
+		std::vector<WorkQueue>	m_queues;		//one queue per thread during Run
+		Stats					m_stats;
+
+		void				InitQueues(int threadCount);
+		void				DestroyQueues();
+
+		//Returns the next tile of a thread's own queue, or -1 if the queue is empty
+		int					PopTile(int thread);
+
+		//Returns a tile taken from another thread's queue, or -1 if every queue is empty
+		int					StealTile(int thread);
+
+	public:
+		TileScheduler();
+		~TileScheduler();
+
+		//Split a width*height image into tiles of tileSize*tileSize pixels laid out in the given order
+		void				Setup(int width, int height, int tileSize, TileOrder order);
+
+		//Call renderTile(const Tile&) once for every tile, in parallel
+		template<typename TileFn>
+		void				Run(TileFn renderTile)
+		{
+			double start_time = omp_get_wtime();
+			int stolen = 0;
+
+#pragma omp parallel reduction(+:stolen)
+			{
+#pragma omp single
+				InitQueues(omp_get_num_threads());
+
+				int thread = omp_get_thread_num();
+
+				while (true)
+				{
+					int tile = PopTile(thread);
+
+					if (tile < 0)
+					{
+						tile = StealTile(thread);
+						if (tile < 0) break;
+						stolen++;
+					}
+
+					renderTile(m_tiles[tile]);
+				}
+			}
+
+			m_stats.stolenCount = stolen;
+			m_stats.threadCount = (int)m_queues.size();
+			m_stats.renderTime = (omp_get_wtime() - start_time) * 1000.0;
+
+			DestroyQueues();
+		}
+
+		inline const Stats&	GetStats() const
+		{
+			return m_stats;
+		}
+
+		static const char*	GetOrderName(TileOrder order);
+};
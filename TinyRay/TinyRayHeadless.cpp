@@ -0,0 +1,781 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+
+//Command line entry point of TinyRay without a window or OpenGL.
+//Renders the default scene a number of times and reports the time and ray counts of every frame.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <algorithm>
+#include <vector>
+
+#include "Scene.h"
+#include "RayTracer.h"
+#include "Mesh.h"
+#include "ObjLoader.h"
+#include "Instance.h"
+#include "Triangle.h"
+#include "SceneCache.h"
+#include "TextureCache.h"
+
+void PrintUsage()
+{
+	printf("Usage: tinyray_headless [options]\n");
+	printf("  -w <width>       image width in pixels (default 640)\n");
+	printf("  -h <height>      image height in pixels (default 480)\n");
+	printf("  -f <flags>       trace flags, either F1 - F6 as in the viewer or a bit mask of\n");
+	printf("                   1 ambient, 2 diffuse and specular, 4 shadow, 8 reflection, 16 refraction (default F6)\n");
+	printf("  -F <flags>       trace flags of every frame but the first, the camera does not move so these frames\n");
+	printf("                   shade the primary hits cached by the first one\n");
+	printf("  -l <level>       trace level, i.e. the maximum recursion depth (default 5)\n");
+	printf("  -r <repeats>     number of frames to render (default 1)\n");
+	printf("  -p               trace primary rays in packets of 2x2 pixels\n");
+	printf("  -g               render progressively from coarse to fine and report the time to the first image\n");
+	printf("  -a <threshold>   adaptive sampling, add subpixel samples to pixels whose colour differs from a\n");
+	printf("                   neighbour, or whose samples vary, by more than the threshold, e.g. 0.05\n");
+	printf("  -R               reuse the shading of the previous frame by reprojecting it after a camera move\n");
+	printf("  -P <distance>    move the camera to the right by this distance before every frame but the first\n");
+	printf("  -W               trace single sample frames breadth first, one stage of one generation of rays at a time\n");
+	printf("  -S               with -W, bin the reflection and refraction rays by direction and origin before\n");
+	printf("                   intersecting them, with -p too they are intersected in packets of 4\n");
+	printf("  -n               do not cache the last occluder of each light for shadow rays\n");
+	printf("  -t <size>        render in tiles of size x size pixels, 0 renders by rows (default 0)\n");
+	printf("  -C               with -t, cull the objects outside the frustum of each tile before tracing it\n");
+	printf("  -m <order>       tile order, scanline, morton or hilbert (default hilbert)\n");
+	printf("  -M <segments>    add a sphere tessellated into a mesh of 2 x segments x segments triangles to the scene\n");
+	printf("  -O <file.obj>    add the triangles of a Wavefront OBJ file to the scene, may be given more than once\n");
+	printf("  -I <count>       place count instances of the meshes of -M and -O, or of a sphere mesh if there are\n");
+	printf("                   none, on a grid over the floor instead of adding the meshes themselves\n");
+	printf("  -k <file.tsc>    save the scene with its acceleration structures to a binary scene cache\n");
+	printf("  -K <file.tsc>    load the scene from a scene cache saved by -k instead of setting it up,\n");
+	printf("                   -M, -O and -I are ignored\n");
+	printf("  -T <file.tga>    map an uncompressed TGA texture onto the planes, spheres and triangles of the scene,\n");
+	printf("                   may be given more than once, the objects then take the textures in turn\n");
+	printf("  -x <filter>      texture filter, nearest, bilinear or trilinear (default trilinear)\n");
+	printf("  -X               store the texture in rows instead of 8x8 tiles\n");
+	printf("  -B <MB>          share the textures through the texture cache, which loads them in 64x64 tiles\n");
+	printf("                   on first use and keeps at most this many megabytes of tiles\n");
+	printf("  -o <file.ppm>    write the last frame to a binary PPM image\n");
+	printf("  -H <file.ppm>    write the number of samples per pixel of the last frame as a heatmap,\n");
+	printf("                   blue is one sample and red the most adaptive sampling can take\n");
+}
+
+//Parse the trace flags given either as the viewer's F1 - F6 keys or as a bit mask
+static bool ParseTraceFlags(const char* arg, RayTracer::TraceFlags& flags)
+{
+	static const int presets[] =
+	{
+		RayTracer::TRACE_AMBIENT,
+		RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC,
+		RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC | RayTracer::TRACE_SHADOW,
+		RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC | RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW,
+		RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC | RayTracer::TRACE_REFRACTION,
+		RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC | RayTracer::TRACE_REFRACTION
+			| RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW
+	};
+
+	if (arg[0] == 'F' || arg[0] == 'f')
+	{
+		int key = atoi(arg + 1);
+		if (key < 1 || key > 6) return false;
+		flags = (RayTracer::TraceFlags)presets[key - 1];
+		return true;
+	}
+
+	int mask = atoi(arg);
+	if (mask <= 0 || mask > 31) return false;
+	flags = (RayTracer::TraceFlags)mask;
+	return true;
+}
+
+static bool ParseTileOrder(const char* arg, TileOrder& order)
+{
+	if (strcmp(arg, "scanline") == 0) order = TILE_ORDER_SCANLINE;
+	else if (strcmp(arg, "morton") == 0) order = TILE_ORDER_MORTON;
+	else if (strcmp(arg, "hilbert") == 0) order = TILE_ORDER_HILBERT;
+	else return false;
+
+	return true;
+}
+
+//Parse a texture filter given as nearest, bilinear or trilinear
+static bool ParseTextureFilter(const char* arg, Texture::Filter& filter)
+{
+	if (strcmp(arg, "nearest") == 0) filter = Texture::FILTER_NEAREST;
+	else if (strcmp(arg, "bilinear") == 0) filter = Texture::FILTER_BILINEAR;
+	else if (strcmp(arg, "trilinear") == 0) filter = Texture::FILTER_TRILINEAR;
+	else return false;
+
+	return true;
+}
+
+//Write an image stored bottom up, like the framebuffer, as a binary PPM, the colours are clamped to [0, 1]
+static bool WritePPM(const char* filename, const Colour* buffer, int width, int height)
+{
+	FILE* pfile = fopen(filename, "wb");
+
+	if (!pfile)
+	{
+		printf("Error opening image file: %s\n", filename);
+		return false;
+	}
+
+	std::vector<unsigned char> row(width * 3);
+
+	fprintf(pfile, "P6\n%d %d\n255\n", width, height);
+
+	for (int y = height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const Colour& colour = buffer[y * width + x];
+
+			for (int c = 0; c < 3; c++)
+			{
+				Scalar value = std::min(std::max(colour[c], (Scalar)0), (Scalar)1);
+				row[x * 3 + c] = (unsigned char)(value * 255.0f + 0.5f);
+			}
+		}
+
+		fwrite(&row[0], 1, row.size(), pfile);
+	}
+
+	fclose(pfile);
+
+	return true;
+}
+
+//Create a sphere tessellated into a mesh with the given number of segments around and along its axis
+//Prints the memory used by the mesh and what the same triangles would take as Triangle objects
+static Mesh* CreateTestMesh(Scene& scene, int segments)
+{
+	static const Scalar pi = (Scalar)3.14159265358979;
+	const Vector3 centre(0.0, 7.0, -8.0);
+	const Scalar radius = 2.5;
+
+	std::vector<Scalar> positions, normals, texcoords;
+	std::vector<unsigned int> indices;
+
+	for (int j = 0; j <= segments; j++)
+	{
+		Scalar theta = pi * j / segments;
+
+		for (int i = 0; i <= segments; i++)
+		{
+			Scalar phi = 2 * pi * i / segments;
+			Vector3 normal(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+
+			for (int k = 0; k < 3; k++)
+			{
+				positions.push_back(centre[k] + normal[k] * radius);
+				normals.push_back(normal[k]);
+			}
+			texcoords.push_back((Scalar)i / segments);
+			texcoords.push_back((Scalar)j / segments);
+		}
+	}
+
+	for (int j = 0; j < segments; j++)
+	{
+		for (int i = 0; i < segments; i++)
+		{
+			unsigned int v = j * (segments + 1) + i;
+			unsigned int quad[6] = { v, v + 1, v + segments + 1, v + 1, v + segments + 2, v + segments + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	Mesh* mesh = scene.Create<Mesh>();
+	mesh->SetVertices(positions, normals, texcoords);
+	mesh->SetTriangles(indices);
+	mesh->Build();
+
+	Material* material = scene.Create<Material>();
+	material->SetAmbientColour(0.0, 0.0, 0.0);
+	material->SetDiffuseColour(0.9, 0.7, 0.1);
+	material->SetSpecularColour(1.0, 1.0, 1.0);
+	material->SetSpecPower(20);
+	mesh->SetMaterial(material);
+
+	//A Triangle object is referenced from the scene and the BVH and its vertices, edges, normals, material and
+	//order are copied into the primitive store, the scene BVH over the triangles is as large as the mesh BVH
+	double triangle_count = mesh->GetTriangleCount();
+	double bvh_bytes = mesh->GetBVH().GetMemoryUsage() / triangle_count;
+	double mesh_bytes = mesh->GetMemoryUsage() / triangle_count;
+	double triangle_bytes = sizeof(Triangle) + sizeof(Primitive*) + sizeof(PrimitiveStore::PrimRef)
+		+ 24 * sizeof(Scalar) + sizeof(Material*) + sizeof(int);
+
+	printf("Mesh: %d triangles, %d vertices, %.1f bytes per triangle (%.1f in the BVH), Triangle objects take %.1f (%.1fx)\n",
+		mesh->GetTriangleCount(), mesh->GetVertexCount(), mesh_bytes, bvh_bytes, triangle_bytes + bvh_bytes,
+		(triangle_bytes + bvh_bytes) / mesh_bytes);
+	printf("  without the BVH: %.1f bytes per triangle, Triangle objects take %.1f (%.1fx)\n",
+		mesh_bytes - bvh_bytes, triangle_bytes, triangle_bytes / (mesh_bytes - bvh_bytes));
+
+	return mesh;
+}
+
+//Load an OBJ file into a mesh, returns null if it cannot be loaded
+static Mesh* LoadObjMesh(Scene& scene, const char* filename)
+{
+	ObjLoader::LoadStats stats;
+	Mesh* mesh = scene.Create<Mesh>();
+
+	if (!ObjLoader::Load(filename, *mesh, &stats)) return nullptr;
+
+	ObjLoader::PrintLoadStats(filename, stats);
+
+	Material* material = scene.Create<Material>();
+	material->SetAmbientColour(0.0, 0.0, 0.0);
+	material->SetDiffuseColour(0.8, 0.8, 0.8);
+	material->SetSpecularColour(1.0, 1.0, 1.0);
+	material->SetSpecPower(20);
+	mesh->SetMaterial(material);
+
+	return mesh;
+}
+
+//Load a TGA texture into the scene, returns null if it cannot be loaded
+static Texture* LoadTexture(Scene& scene, const char* filename, Texture::Filter filter, Texture::Layout layout)
+{
+	Texture* texture = scene.Create<Texture>();
+
+	if (!texture->LoadTGA(filename, layout)) return nullptr;
+
+	texture->SetFilter(filter);
+
+	printf("Texture %s: %dx%d, %d mip levels, %.2f MB %s\n", filename, texture->GetWidth(), texture->GetHeight(),
+		texture->GetLevelCount(), texture->GetMemoryUsage() / 1048576.0, layout == Texture::LAYOUT_TILED ? "in 8x8 tiles" : "in rows");
+
+	return texture;
+}
+
+//Map the TGA textures onto the planes, spheres and triangles of the scene, taking them in turn
+//Without the texture cache every file is loaded whole by each -T naming it, with the cache every material asks the
+//cache for its texture and the materials of the same file share it. Returns false if a texture cannot be loaded.
+static bool AddTextures(Scene& scene, const std::vector<const char*>& filenames, Texture::Filter filter, Texture::Layout layout, bool cached)
+{
+	std::vector<Texture*> textures;
+
+	for (size_t i = 0; i < filenames.size() && !cached; i++)
+	{
+		textures.push_back(LoadTexture(scene, filenames[i], filter, layout));
+		if (!textures.back()) return false;
+	}
+
+	const std::vector<Primitive*>& objects = scene.GetObjects();
+	size_t next = 0;
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		int type = objects[i]->m_primtype;
+
+		if (!objects[i]->GetMaterial() || (type != Primitive::PRIMTYPE_Plane && type != Primitive::PRIMTYPE_Sphere && type != Primitive::PRIMTYPE_Triangle))
+			continue;
+
+		Texture* texture = nullptr;
+
+		if (cached)
+		{
+			texture = TextureCache::GetInstance().Acquire(filenames[next % filenames.size()]);
+			if (!texture) return false;
+			texture->SetFilter(filter);
+		}
+		else
+		{
+			texture = textures[next % textures.size()];
+		}
+
+		objects[i]->GetMaterial()->SetDiffuseTexture(texture);
+		next++;
+	}
+
+	if (cached)
+	{
+		TextureCache::Stats stats = TextureCache::GetInstance().GetStats();
+		printf("Texture cache: %d requests shared %d file(s), %.2f MB budget\n", stats.requests, stats.files, stats.budget / 1048576.0);
+	}
+
+	return true;
+}
+
+//Place count instances of the meshes on a grid over the floor,
+//each scaled to fit its cell and turned by a random angle about the vertical axis
+//Prints the memory used by the assets and the instances and what copies of the meshes would take
+static void AddInstances(Scene& scene, const std::vector<Mesh*>& meshes, int count)
+{
+	static const Scalar pi = (Scalar)3.14159265358979;
+	const Scalar grid_min[2] = { -18.0, -38.0 };
+	const Scalar grid_size = 36.0;
+
+	int columns = (int)ceil(sqrt((double)count));
+	Scalar cell = grid_size / columns;
+	size_t asset_bytes = 0;
+	double copy_bytes = 0.0;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+		asset_bytes += meshes[i]->GetMemoryUsage();
+
+	srand(1);
+
+	for (int i = 0; i < count; i++)
+	{
+		Mesh* mesh = meshes[i % meshes.size()];
+		AABB bounds;
+		if (!mesh->GetBounds(bounds)) continue;
+
+		Vector3 extent = bounds.GetMax() - bounds.GetMin();
+		Scalar size = std::max(extent[0], std::max(extent[1], extent[2]));
+		Scalar scale = size > 0 ? cell * (Scalar)0.8 / size : 1;
+		Vector3 base((bounds.GetMin()[0] + bounds.GetMax()[0]) / 2, bounds.GetMin()[1], (bounds.GetMin()[2] + bounds.GetMax()[2]) / 2);
+		Vector3 position(grid_min[0] + cell * (i % columns + (Scalar)0.5), 0.0, grid_min[1] + cell * (i / columns + (Scalar)0.5));
+		Scalar angle = 2 * pi * rand() / RAND_MAX;
+
+		Transform transform = Transform::Translation(position) * Transform::Scaling(Vector3(scale, scale, scale))
+			* Transform::Rotation(Vector3(0.0, 1.0, 0.0), angle) * Transform::Translation(base * -1);
+
+		scene.AddObject(scene.Create<Instance>(mesh, transform));
+		copy_bytes += mesh->GetMemoryUsage();
+	}
+
+	//Besides the instance itself, the scene keeps a pointer, a reference, a material and an order for it
+	//and the scene BVH has about two nodes per object
+	size_t instance_bytes = sizeof(Instance) + sizeof(Primitive*) + sizeof(Instance*) + sizeof(PrimitiveStore::PrimRef)
+		+ sizeof(Material*) + sizeof(int) + 2 * sizeof(BVH::Node);
+	double total_bytes = asset_bytes + (double)instance_bytes * count;
+
+	printf("Instances: %d instances of %d assets, %.2f MB (%.2f MB of assets, %d bytes per instance), copies would take %.2f MB (%.1fx)\n",
+		count, (int)meshes.size(), total_bytes / 1048576.0, asset_bytes / 1048576.0, (int)instance_bytes,
+		copy_bytes / 1048576.0, copy_bytes / total_bytes);
+}
+
+//Print how the samples of an accumulated frame are spread over the pixels
+static void PrintSampleStats(Framebuffer* framebuffer)
+{
+	int width = framebuffer->GetWidth();
+	int height = framebuffer->GetHeight();
+	std::vector<int> histogram(RayTracer::GetMaxSamples() + 1, 0);
+	long long total = 0;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int samples = std::min(framebuffer->GetSampleCount(x, y), RayTracer::GetMaxSamples());
+			histogram[samples]++;
+			total += samples;
+		}
+	}
+
+	printf("  samples per pixel: %.3f on average, pixels with", (double)total / (width * height));
+	for (size_t samples = 1; samples < histogram.size(); samples++)
+	{
+		if (histogram[samples] > 0)
+			printf(" %d: %d", (int)samples, histogram[samples]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	int width = 640;
+	int height = 480;
+	int tracelevel = 5;
+	int repeats = 1;
+	int tilesize = 0;
+	bool packets = false;
+	bool shadowcache = true;
+	bool progressive = false;
+	bool wavefront = false;
+	bool raysorting = false;
+	bool culling = false;
+	TileOrder tileorder = TILE_ORDER_HILBERT;
+	RayTracer::TraceFlags traceflags = (RayTracer::TraceFlags)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
+		| RayTracer::TRACE_REFRACTION | RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW);
+	RayTracer::TraceFlags laterflags = traceflags;
+	bool switchflags = false;
+	const char* output = nullptr;
+	const char* heatmap = nullptr;
+	bool adaptive = false;
+	float threshold = 0.0f;
+	bool reprojection = false;
+	float pan = 0.0f;
+	int meshsegments = 0;
+	std::vector<const char*> objfiles;
+	int instances = 0;
+	const char* savecache = nullptr;
+	const char* loadcache = nullptr;
+	std::vector<const char*> texturefiles;
+	bool texturecache = false;
+	Texture::Filter texturefilter = Texture::FILTER_TRILINEAR;
+	Texture::Layout texturelayout = Texture::LAYOUT_TILED;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+
+		if (strcmp(arg, "-p") == 0)
+		{
+			packets = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-g") == 0)
+		{
+			progressive = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-W") == 0)
+		{
+			wavefront = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-S") == 0)
+		{
+			raysorting = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-C") == 0)
+		{
+			culling = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-R") == 0)
+		{
+			reprojection = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-X") == 0)
+		{
+			texturelayout = Texture::LAYOUT_LINEAR;
+			continue;
+		}
+
+		if (strcmp(arg, "-n") == 0)
+		{
+			shadowcache = false;
+			continue;
+		}
+
+		if (strcmp(arg, "--help") == 0)
+		{
+			PrintUsage();
+			return 0;
+		}
+
+		if (!value)
+		{
+			valid = false;
+		}
+		else if (strcmp(arg, "-w") == 0)
+		{
+			width = atoi(value);
+			valid = width > 0;
+		}
+		else if (strcmp(arg, "-h") == 0)
+		{
+			height = atoi(value);
+			valid = height > 0;
+		}
+		else if (strcmp(arg, "-f") == 0)
+		{
+			valid = ParseTraceFlags(value, traceflags);
+		}
+		else if (strcmp(arg, "-F") == 0)
+		{
+			valid = ParseTraceFlags(value, laterflags);
+			switchflags = true;
+		}
+		else if (strcmp(arg, "-l") == 0)
+		{
+			tracelevel = atoi(value);
+			valid = tracelevel >= 0;
+		}
+		else if (strcmp(arg, "-r") == 0)
+		{
+			repeats = atoi(value);
+			valid = repeats > 0;
+		}
+		else if (strcmp(arg, "-t") == 0)
+		{
+			tilesize = atoi(value);
+			valid = tilesize >= 0;
+		}
+		else if (strcmp(arg, "-m") == 0)
+		{
+			valid = ParseTileOrder(value, tileorder);
+		}
+		else if (strcmp(arg, "-a") == 0)
+		{
+			adaptive = true;
+			threshold = (float)atof(value);
+			valid = threshold > 0.0f;
+		}
+		else if (strcmp(arg, "-P") == 0)
+		{
+			pan = (float)atof(value);
+		}
+		else if (strcmp(arg, "-M") == 0)
+		{
+			meshsegments = atoi(value);
+			valid = meshsegments >= 3;
+		}
+		else if (strcmp(arg, "-O") == 0)
+		{
+			objfiles.push_back(value);
+		}
+		else if (strcmp(arg, "-I") == 0)
+		{
+			instances = atoi(value);
+			valid = instances > 0;
+		}
+		else if (strcmp(arg, "-k") == 0)
+		{
+			savecache = value;
+		}
+		else if (strcmp(arg, "-K") == 0)
+		{
+			loadcache = value;
+		}
+		else if (strcmp(arg, "-T") == 0)
+		{
+			texturefiles.push_back(value);
+		}
+		else if (strcmp(arg, "-B") == 0)
+		{
+			double budget = atof(value);
+			texturecache = true;
+			TextureCache::GetInstance().SetBudget((size_t)(budget * 1048576.0));
+			valid = budget > 0.0;
+		}
+		else if (strcmp(arg, "-x") == 0)
+		{
+			valid = ParseTextureFilter(value, texturefilter);
+		}
+		else if (strcmp(arg, "-o") == 0)
+		{
+			output = value;
+		}
+		else if (strcmp(arg, "-H") == 0)
+		{
+			heatmap = value;
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			printf("Invalid argument: %s %s\n", arg, value ? value : "");
+			PrintUsage();
+			return 1;
+		}
+
+		i++;
+	}
+
+	double setup_start = omp_get_wtime();
+
+	Scene scene;
+
+	if (loadcache)
+	{
+		SceneCache::CacheStats stats;
+
+		if (!SceneCache::Load(scene, loadcache, &stats)) return 1;
+
+		SceneCache::PrintStats(loadcache, stats);
+	}
+	else
+	{
+		std::vector<Mesh*> meshes;
+
+		if (meshsegments > 0 || (instances > 0 && objfiles.empty()))
+			meshes.push_back(CreateTestMesh(scene, meshsegments > 0 ? meshsegments : 32));
+
+		for (size_t i = 0; i < objfiles.size(); i++)
+		{
+			Mesh* mesh = LoadObjMesh(scene, objfiles[i]);
+			if (!mesh) return 1;
+			meshes.push_back(mesh);
+		}
+
+		if (instances > 0)
+		{
+			AddInstances(scene, meshes, instances);
+		}
+		else
+		{
+			for (size_t i = 0; i < meshes.size(); i++)
+				scene.AddObject(meshes[i]);
+		}
+
+		if (!meshes.empty())
+			scene.BuildAccelerationStructure();
+	}
+
+	if (!texturefiles.empty() && !AddTextures(scene, texturefiles, texturefilter, texturelayout, texturecache)) return 1;
+
+	//The width of the scene follows the aspect ratio of the image, including for a scene from a cache
+	scene.SetSceneWidth((float)width / (float)height);
+
+	printf("Scene set up in %.2f ms\n", (omp_get_wtime() - setup_start) * 1000.0);
+
+	if (savecache)
+	{
+		SceneCache::CacheStats stats;
+
+		if (!SceneCache::Save(scene, savecache, &stats)) return 1;
+
+		SceneCache::PrintStats(savecache, stats);
+	}
+
+	printf("Scene arena: %d objects, %.1f KB used of %.1f KB\n", scene.GetArena().GetObjectCount(),
+		scene.GetArena().GetBytesUsed() / 1024.0, scene.GetArena().GetBytesReserved() / 1024.0);
+
+	RayTracer raytracer(width, height);
+	raytracer.m_traceflag = traceflags;
+	raytracer.SetTraceLevel(tracelevel);
+	raytracer.SetPacketTracing(packets);
+	raytracer.SetTileScheduling(tilesize, tileorder);
+	raytracer.SetShadowCaching(shadowcache);
+	raytracer.SetProgressive(progressive);
+	raytracer.SetAdaptiveSampling(adaptive, threshold);
+	raytracer.SetReprojection(reprojection);
+	raytracer.SetWavefront(wavefront);
+	raytracer.SetRaySorting(raysorting);
+	raytracer.SetFrustumCulling(culling);
+
+	//Repeated frames of an unchanged view would otherwise all reuse the primary hits of the first one
+	raytracer.SetReshading(switchflags);
+
+	printf("Rendering %dx%d, trace flags 0x%x, trace level %d, %d frame(s), %s precision\n", width, height, (int)traceflags, tracelevel, repeats, SCALAR_NAME);
+
+	std::vector<double> frame_times;
+	RayTracer::RayCounts counts = {};
+
+	for (int frame = 0; frame < repeats; frame++)
+	{
+		if (frame > 0 && pan != 0.0f)
+		{
+			//Slide the camera sideways, keeping the direction it looks in
+			Camera* camera = scene.GetSceneCamera();
+			Vector3 position = camera->GetPosition() + camera->GetRightVector() * pan;
+			Vector3 lookat = position + camera->GetViewVector();
+			camera->SetPositionAndLookAt(position, lookat);
+		}
+
+		if (frame > 0 && switchflags)
+			raytracer.m_traceflag = laterflags;
+
+		if (texturecache)
+			TextureCache::GetInstance().ResetStats();
+
+		raytracer.ResetRenderCount();
+		raytracer.DoRayTrace(&scene);
+
+		if (progressive)
+			printf("First image after %.2f ms\n", raytracer.GetRenderTime());
+
+		while (!raytracer.IsFrameComplete())
+			raytracer.DoRayTrace(&scene);
+
+		double time = raytracer.GetRenderTime();
+		counts = raytracer.GetRayCounts();
+		long long total = counts.primary + counts.shadow + counts.reflection + counts.refraction;
+
+		printf("Frame %d: %.2f ms, %.3f Mrays/s (primary %lld, shadow %lld, reflection %lld, refraction %lld)\n",
+			frame + 1, time, total / (time * 1000.0), counts.primary, counts.shadow, counts.reflection, counts.refraction);
+
+		if (shadowcache && counts.shadow > 0)
+		{
+			RayTracer::ShadowCacheStats cache = raytracer.GetShadowCacheStats();
+			printf("  shadow occluder cache: %lld hits, %lld misses, %lld full searches (%.1f%% of shadow rays)\n",
+				cache.hits, cache.misses, cache.fallbacks, 100.0 * cache.fallbacks / counts.shadow);
+		}
+
+		RayTracer::CullingStats culling_stats = raytracer.GetCullingStats();
+		if (culling_stats.tiles > 0)
+		{
+			printf("  frustum culling: %.2f of %d objects kept per tile on average\n",
+				(double)culling_stats.objects / culling_stats.tiles, culling_stats.sceneObjects);
+		}
+
+		if (reprojection)
+		{
+			const RayTracer::ReprojectionStats& stats = raytracer.GetReprojectionStats();
+			printf("  reprojection: %d pixels reused, %d retraced\n", stats.reused, stats.retraced);
+		}
+
+		const RayTracer::WavefrontStats& wavefront_stats = raytracer.GetWavefrontStats();
+		if (wavefront_stats.generations > 0)
+		{
+			printf("  wavefront: %d generations, %lld rays,", wavefront_stats.generations, wavefront_stats.rays);
+			for (int stage = 0; stage < RayTracer::WAVEFRONT_STAGE_COUNT; stage++)
+				printf(" %s %.2f ms", RayTracer::GetWavefrontStageName(stage), wavefront_stats.stageTime[stage]);
+			printf("\n");
+
+			if (wavefront_stats.secondaryRays > 0)
+				printf("  secondary rays: %lld, %.3f Mrays/s intersected, direction coherence %.3f\n",
+					wavefront_stats.secondaryRays, wavefront_stats.secondaryRays / (wavefront_stats.secondaryIntersectTime * 1000.0),
+					wavefront_stats.coherence);
+		}
+
+		if (texturecache && !texturefiles.empty())
+			TextureCache::PrintStats(TextureCache::GetInstance().GetStats());
+
+		if (adaptive)
+			PrintSampleStats(raytracer.GetFramebuffer());
+
+		frame_times.push_back(time);
+	}
+
+	//The scene does not change between frames, so every frame traces the same rays
+	std::vector<double> sorted_times = frame_times;
+	std::sort(sorted_times.begin(), sorted_times.end());
+
+	double mean = 0.0;
+	for (size_t i = 0; i < frame_times.size(); i++)
+		mean += frame_times[i];
+	mean /= frame_times.size();
+
+	double median = sorted_times[sorted_times.size() / 2];
+	long long total = counts.primary + counts.shadow + counts.reflection + counts.refraction;
+
+	printf("Summary: min %.2f ms, median %.2f ms, mean %.2f ms, max %.2f ms\n",
+		sorted_times.front(), median, mean, sorted_times.back());
+	printf("Rays per frame: %lld, %.3f Mrays/s at the median frame time\n", total, total / (median * 1000.0));
+
+	Framebuffer* framebuffer = raytracer.GetFramebuffer();
+
+	if (output && !WritePPM(output, framebuffer->GetBuffer(), width, height))
+		return 1;
+
+	if (heatmap)
+	{
+		std::vector<Colour> heat(width * height);
+		framebuffer->WriteSampleHeatmap(&heat[0], RayTracer::GetMaxSamples());
+
+		if (!WritePPM(heatmap, &heat[0], width, height))
+			return 1;
+	}
+
+	return 0;
+}
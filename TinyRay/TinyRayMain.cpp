@@ -35,6 +35,15 @@ void PrintUsage()
 	printf("F4: Full lighting  reflection\n");
 	printf("F5: Full lighting  refraction\n");
 	printf("F6: Ray trace everything\n");
+	printf("P: Toggle packet tracing of primary rays\n");
+	printf("Arrow keys: Move the camera\n");
+	printf("R: Toggle reprojection of the last frame after a camera move\n");
+	printf("A: Toggle adaptive supersampling of edges\n");
+	printf("G: Toggle progressive rendering, coarse to fine\n");
+	printf("W: Toggle wavefront rendering, breadth first by ray generation\n");
+	printf("S: Toggle binning of the wavefront's secondary rays by direction and origin\n");
+	printf("C: Toggle frustum culling of the objects outside each tile\n");
+	printf("T: Cycle rows, 16x16 and 32x32 Hilbert, 16x16 and 32x32 Morton tiles\n");
 }
 
 void ErrorExit(LPCSTR lpszFunction)
@@ -0,0 +1,161 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include "Transform.h"
+
+Transform::Transform()
+{
+	for (int row = 0; row < 3; row++)
+		for (int column = 0; column < 4; column++)
+			m_rows[row][column] = row == column ? (Scalar)1 : (Scalar)0;
+}
+
+Transform::~Transform()
+{
+}
+
+Transform Transform::Translation(const Vector3& offset)
+{
+	Transform transform;
+
+	for (int row = 0; row < 3; row++)
+		transform.m_rows[row][3] = offset[row];
+
+	return transform;
+}
+
+Transform Transform::Scaling(const Vector3& scale)
+{
+	Transform transform;
+
+	for (int row = 0; row < 3; row++)
+		transform.m_rows[row][row] = scale[row];
+
+	return transform;
+}
+
+Transform Transform::Rotation(const Vector3& axis, Scalar angle)
+{
+	Transform transform;
+	Vector3 u = axis;
+	u.Normalise();
+
+	//Rodrigues' rotation formula
+	Scalar c = cos(angle);
+	Scalar s = sin(angle);
+	Scalar t = 1 - c;
+
+	transform.m_rows[0][0] = t*u[0]*u[0] + c;
+	transform.m_rows[0][1] = t*u[0]*u[1] - s*u[2];
+	transform.m_rows[0][2] = t*u[0]*u[2] + s*u[1];
+	transform.m_rows[1][0] = t*u[0]*u[1] + s*u[2];
+	transform.m_rows[1][1] = t*u[1]*u[1] + c;
+	transform.m_rows[1][2] = t*u[1]*u[2] - s*u[0];
+	transform.m_rows[2][0] = t*u[0]*u[2] - s*u[1];
+	transform.m_rows[2][1] = t*u[1]*u[2] + s*u[0];
+	transform.m_rows[2][2] = t*u[2]*u[2] + c;
+
+	return transform;
+}
+
+Transform Transform::operator * (const Transform& rhs) const
+{
+	Transform result;
+
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			Scalar sum = column == 3 ? m_rows[row][3] : (Scalar)0;
+
+			for (int k = 0; k < 3; k++)
+				sum += m_rows[row][k] * rhs.m_rows[k][column];
+
+			result.m_rows[row][column] = sum;
+		}
+	}
+
+	return result;
+}
+
+Transform Transform::Inverse() const
+{
+	Transform inverse;
+	const Scalar (*m)[4] = m_rows;
+
+	//Inverse of the linear part from its cofactors
+	Scalar c00 = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+	Scalar c01 = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+	Scalar c02 = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+	Scalar det = m[0][0]*c00 + m[0][1]*c01 + m[0][2]*c02;
+
+	if (fabs(det) < SCALAR_EPSILON) return inverse;
+
+	Scalar inv_det = 1 / det;
+
+	inverse.m_rows[0][0] = c00 * inv_det;
+	inverse.m_rows[0][1] = (m[0][2]*m[2][1] - m[0][1]*m[2][2]) * inv_det;
+	inverse.m_rows[0][2] = (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+	inverse.m_rows[1][0] = c01 * inv_det;
+	inverse.m_rows[1][1] = (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+	inverse.m_rows[1][2] = (m[0][2]*m[1][0] - m[0][0]*m[1][2]) * inv_det;
+	inverse.m_rows[2][0] = c02 * inv_det;
+	inverse.m_rows[2][1] = (m[0][1]*m[2][0] - m[0][0]*m[2][1]) * inv_det;
+	inverse.m_rows[2][2] = (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+	//The translation of the inverse undoes the translation after the inverse linear part
+	for (int row = 0; row < 3; row++)
+	{
+		inverse.m_rows[row][3] = -(inverse.m_rows[row][0]*m[0][3] + inverse.m_rows[row][1]*m[1][3] + inverse.m_rows[row][2]*m[2][3]);
+	}
+
+	return inverse;
+}
+
+Vector3 Transform::TransformPoint(const Vector3& point) const
+{
+	return Vector3(
+		m_rows[0][0]*point[0] + m_rows[0][1]*point[1] + m_rows[0][2]*point[2] + m_rows[0][3],
+		m_rows[1][0]*point[0] + m_rows[1][1]*point[1] + m_rows[1][2]*point[2] + m_rows[1][3],
+		m_rows[2][0]*point[0] + m_rows[2][1]*point[1] + m_rows[2][2]*point[2] + m_rows[2][3]);
+}
+
+Vector3 Transform::TransformVector(const Vector3& vector) const
+{
+	return Vector3(
+		m_rows[0][0]*vector[0] + m_rows[0][1]*vector[1] + m_rows[0][2]*vector[2],
+		m_rows[1][0]*vector[0] + m_rows[1][1]*vector[1] + m_rows[1][2]*vector[2],
+		m_rows[2][0]*vector[0] + m_rows[2][1]*vector[1] + m_rows[2][2]*vector[2]);
+}
+
+Vector3 Transform::TransformNormal(const Vector3& normal) const
+{
+	return Vector3(
+		m_rows[0][0]*normal[0] + m_rows[1][0]*normal[1] + m_rows[2][0]*normal[2],
+		m_rows[0][1]*normal[0] + m_rows[1][1]*normal[1] + m_rows[2][1]*normal[2],
+		m_rows[0][2]*normal[0] + m_rows[1][2]*normal[1] + m_rows[2][2]*normal[2]);
+}
+
+AABB Transform::TransformBounds(const AABB& bounds) const
+{
+	AABB result;
+	result.SetEmpty();
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		Vector3 point(
+			corner & 1 ? bounds.GetMax()[0] : bounds.GetMin()[0],
+			corner & 2 ? bounds.GetMax()[1] : bounds.GetMin()[1],
+			corner & 4 ? bounds.GetMax()[2] : bounds.GetMin()[2]);
+		result.Extend(TransformPoint(point));
+	}
+
+	return result;
+}
@@ -0,0 +1,58 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Vector3.h"
+#include "AABB.h"
+
+//An affine transform, a linear part followed by a translation.
+//It is stored as the three rows of a 3x4 matrix whose last column is the translation.
+class Transform
+{
+	private:
+		Scalar				m_rows[3][4];
+
+	public:
+		//Creates the identity transform
+		Transform();
+		~Transform();
+
+		static Transform	Translation(const Vector3& offset);
+		static Transform	Scaling(const Vector3& scale);
+
+		//Rotation by angle radians about the given axis, counterclockwise looking down the axis
+		static Transform	Rotation(const Vector3& axis, Scalar angle);
+
+		//Returns the transform that applies rhs first and then this transform
+		Transform			operator * (const Transform& rhs) const;
+
+		//Returns the inverse transform, or the identity if the transform is singular
+		Transform			Inverse() const;
+
+		inline Scalar		Get(int row, int column) const
+		{
+			return m_rows[row][column];
+		}
+
+		inline void			Set(int row, int column, Scalar value)
+		{
+			m_rows[row][column] = value;
+		}
+
+		Vector3				TransformPoint(const Vector3& point) const;
+		Vector3				TransformVector(const Vector3& vector) const;
+
+		//Transform a normal by the transpose of the linear part
+		//Called on the inverse of a transform, this gives the normal of the transformed surface
+		Vector3				TransformNormal(const Vector3& normal) const;
+
+		//Returns the bounds of the transformed corners of a box
+		AABB				TransformBounds(const AABB& bounds) const;
+};
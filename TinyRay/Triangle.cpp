@@ -1,4 +1,7 @@
+#include <math.h>
 #include "Triangle.h"
+#include "AABB.h"
+#include "RayPacket.h"
 
 Triangle::Triangle()
 {
@@ -43,38 +46,108 @@ void Triangle::SetTexCoords(Vector3& t0, Vector3& t1, Vector3& t2)
 }
 
 Vector3 Triangle::GetBarycentricCoords(Vector3& point)
+{
+	return ComputeBarycentricCoords(m_vertices[0].m_position, m_vertices[1].m_position, m_vertices[2].m_position, point);
+}
+
+Vector3 Triangle::ComputeBarycentricCoords(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& point)
 {
 	Vector3 barycoord;
 
+	Vector3 e1 = p1 - p0;
+	Vector3 e2 = p2 - p0;
+	Vector3 v = point - p0;
+
+	Scalar d11 = e1.DotProduct(e1);
+	Scalar d12 = e1.DotProduct(e2);
+	Scalar d22 = e2.DotProduct(e2);
+	Scalar dv1 = v.DotProduct(e1);
+	Scalar dv2 = v.DotProduct(e2);
+	Scalar denom = d11*d22 - d12*d12;
+
+	//Degenerate triangle
+	if (fabs(denom) < SCALAR_EPSILON) return barycoord;
+
+	Scalar b1 = (d22*dv1 - d12*dv2) / denom;
+	Scalar b2 = (d11*dv2 - d12*dv1) / denom;
+
+	barycoord.SetVector(1 - b1 - b2, b1, b2);
+
 	return barycoord;
 }
 
+Scalar Triangle::ComputeTriangleTexCoords(const Vector3* positions, const Scalar* vertexTexcoords, const Vector3& point, Scalar texcoords[2])
+{
+	Vector3 bc_coords = ComputeBarycentricCoords(positions[0], positions[1], positions[2], point);
+
+	texcoords[0] = bc_coords[0] * vertexTexcoords[0] + bc_coords[1] * vertexTexcoords[2] + bc_coords[2] * vertexTexcoords[4];
+	texcoords[1] = bc_coords[0] * vertexTexcoords[1] + bc_coords[1] * vertexTexcoords[3] + bc_coords[2] * vertexTexcoords[5];
+
+	//Ratio of the area of the triangle to the area it covers in texture space
+	Scalar world_area = (positions[1] - positions[0]).CrossProduct(positions[2] - positions[0]).Norm();
+	Scalar du1 = vertexTexcoords[2] - vertexTexcoords[0];
+	Scalar dv1 = vertexTexcoords[3] - vertexTexcoords[1];
+	Scalar du2 = vertexTexcoords[4] - vertexTexcoords[0];
+	Scalar dv2 = vertexTexcoords[5] - vertexTexcoords[1];
+	Scalar texture_area = fabs(du1 * dv2 - du2 * dv1);
+
+	return texture_area > 0 ? sqrt(world_area / texture_area) : 1;
+}
+
 RayHitResult Triangle::IntersectByRay(Ray& ray)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
-	double t = FARFAR_AWAY;
 
-	Vector3 e1, e2;  //Edge1, Edge2
-	Vector3 P, Q, T;
-	float det, inv_det, u, v;
+	//Find vectors for two edges sharing m_vertices[0]
+	Vector3 e1 = m_vertices[1].m_position - m_vertices[0].m_position;
+	Vector3 e2 = m_vertices[2].m_position - m_vertices[0].m_position;
+
+	Scalar t = IntersectTriangle(m_vertices[0].m_position, e1, e2, ray);
+
+	if (t >= FARFAR_AWAY) return result;
+
+	Vector3 positions[3] = { m_vertices[0].m_position, m_vertices[1].m_position, m_vertices[2].m_position };
+	Vector3 normals[3] = { m_vertices[0].m_normal, m_vertices[1].m_normal, m_vertices[2].m_normal };
+
+	result.t = t;
+	result.primtype = m_primtype;
+	result.index = GetIndex();
 
+	CompleteTriangleHit(positions, normals, ray, result);
+
+	return result;
+}
+
+__m128 Triangle::IntersectByPacket(const RayPacket& packet)
+{
 	//Find vectors for two edges sharing m_vertices[0]
-	e1 = m_vertices[1].m_position - m_vertices[0].m_position;
-	e2 = m_vertices[2].m_position - m_vertices[0].m_position;
+	Vector3 e1 = m_vertices[1].m_position - m_vertices[0].m_position;
+	Vector3 e2 = m_vertices[2].m_position - m_vertices[0].m_position;
+
+	return IntersectTrianglePacket(m_vertices[0].m_position, e1, e2, packet);
+}
+
+Scalar Triangle::IntersectTriangle(const Vector3& v0, const Vector3& e1, const Vector3& e2, Ray& ray)
+{
+	Scalar t = FARFAR_AWAY;
+
+	Vector3 P, Q, T;
+	Scalar det, inv_det, u, v;
+
 	//Begin calculating determinant - also used to calculate u parameter
 	P = ray.GetRay().CrossProduct(e2);
 	//if determinant is near zero, ray lies in plane of triangle
 	det = e1.DotProduct(P);
 	//NOT CULLING
-	inv_det = 1.f / det;
+	inv_det = 1 / det;
 
 	//calculate distance from m_vertices[0] to ray origin
-	T = ray.GetRayStart() - m_vertices[0].m_position;
+	T = ray.GetRayStart() - v0;
 
 	//Calculate u parameter and test bound
 	u = T.DotProduct(P) * inv_det;
 	//The intersection lies outside of the triangle
-	if (u < 0.f || u > 1.f) return result;
+	if (u < 0 || u > 1) return FARFAR_AWAY;
 
 	//Prepare to test v parameter
 	Q = T.CrossProduct(e1);
@@ -82,36 +155,77 @@ RayHitResult Triangle::IntersectByRay(Ray& ray)
 	//Calculate V parameter and test bound
 	v = ray.GetRay().DotProduct(Q) * inv_det;
 	//The intersection lies outside of the triangle
-	if (v < 0.f || u + v  > 1.f) return result;
+	if (v < 0 || u + v  > 1) return FARFAR_AWAY;
 
 	t = e2.DotProduct(Q) * inv_det;
+
+	//ray intersection
+	return t > 0 ? t : FARFAR_AWAY;
+}
+
+void Triangle::CompleteTriangleHit(const Vector3* positions, const Vector3* normals, Ray& ray, RayHitResult& result)
+{
+	result.point = ray.GetRayStart() + ray.GetRay()*result.t;
+
+	Vector3 normal;
+	Vector3 bc_coords = ComputeBarycentricCoords(positions[0], positions[1], positions[2], result.point);
+
+	normal =
+		normals[0]*bc_coords[0] +
+		normals[1]*bc_coords[1] +
+		normals[2]*bc_coords[2];
 	
-	if (t > 0) { //ray intersection
+	normal.Normalise();
+
+	result.normal = normal;
+}
 
-		result.t = t;
-		
-		result.point = ray.GetRayStart() + ray.GetRay()*t;
+__m128 Triangle::IntersectTrianglePacket(const Vector3& v0, const Vector3& edge1, const Vector3& edge2, const RayPacket& packet)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
 
-		Vector3 texcoords;
-		Vector3 normal;
-		Vector3 bc_coords = GetBarycentricCoords(result.point);
+	__m128 e1x = _mm_set1_ps(edge1[0]), e1y = _mm_set1_ps(edge1[1]), e1z = _mm_set1_ps(edge1[2]);
+	__m128 e2x = _mm_set1_ps(edge2[0]), e2y = _mm_set1_ps(edge2[1]), e2z = _mm_set1_ps(edge2[2]);
 
-		texcoords =
-			m_vertices[0].m_texcoords*bc_coords[0] +
-			m_vertices[1].m_texcoords*bc_coords[1] +
-			m_vertices[2].m_texcoords*bc_coords[2];
+	//P = ray x e2
+	__m128 px = _mm_sub_ps(_mm_mul_ps(packet.dy, e2z), _mm_mul_ps(packet.dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(packet.dz, e2x), _mm_mul_ps(packet.dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(packet.dx, e2y), _mm_mul_ps(packet.dy, e2x));
 
-		normal =
-			m_vertices[0].m_normal*bc_coords[0] +
-			m_vertices[1].m_normal*bc_coords[1] +
-			m_vertices[2].m_normal*bc_coords[2];
-		
-		normal.Normalise();
+	//NOT CULLING
+	__m128 inv_det = _mm_div_ps(one, PacketDot(e1x, e1y, e1z, px, py, pz));
 
-		result.normal = normal;
- 		result.data = this;
-		return result;
-	}
+	//T = ray origin - v0
+	__m128 tx = _mm_sub_ps(packet.ox, _mm_set1_ps(v0[0]));
+	__m128 ty = _mm_sub_ps(packet.oy, _mm_set1_ps(v0[1]));
+	__m128 tz = _mm_sub_ps(packet.oz, _mm_set1_ps(v0[2]));
 
-	return result;
+	__m128 u = _mm_mul_ps(PacketDot(tx, ty, tz, px, py, pz), inv_det);
+
+	//Q = T x e1
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+	__m128 v = _mm_mul_ps(PacketDot(packet.dx, packet.dy, packet.dz, qx, qy, qz), inv_det);
+	__m128 t = _mm_mul_ps(PacketDot(e2x, e2y, e2z, qx, qy, qz), inv_det);
+
+	//The same bounds tests as IntersectTriangle
+	__m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+
+	return PacketSelect(hit, t, _mm_set1_ps(FARFAR_AWAY));
+}
+
+bool Triangle::GetBounds(AABB& bounds)
+{
+	bounds.SetEmpty();
+
+	for (int i = 0; i < 3; i++)
+		bounds.Extend(m_vertices[i].m_position);
+
+	return true;
 }
@@ -40,5 +40,22 @@ class Triangle : public Primitive
 		Vector3 GetBarycentricCoords(Vector3& point);
 
 		RayHitResult IntersectByRay(Ray& ray);
+		__m128 IntersectByPacket(const RayPacket& packet);
+		bool GetBounds(AABB& bounds);
+
+		//Intersection kernels shared by Triangle, Box and the SoA storage of PrimitiveStore
+		//v0 is the first vertex, e1 and e2 the edges from v0 to the second and third vertex
+		//IntersectTriangle returns the hit distance, or FARFAR_AWAY if the ray misses
+		//CompleteTriangleHit fills in the point and interpolated normal of a hit at distance result.t
+		static Scalar IntersectTriangle(const Vector3& v0, const Vector3& e1, const Vector3& e2, Ray& ray);
+		static __m128 IntersectTrianglePacket(const Vector3& v0, const Vector3& e1, const Vector3& e2, const RayPacket& packet);
+		static void CompleteTriangleHit(const Vector3* positions, const Vector3* normals, Ray& ray, RayHitResult& result);
+
+		//Texture coordinates of a point on a triangle interpolated from those of its vertices,
+		//vertexTexcoords holds u and v of each vertex in turn
+		//Returns the world space length of one unit of texture coordinates on the triangle
+		static Scalar ComputeTriangleTexCoords(const Vector3* positions, const Scalar* vertexTexcoords, const Vector3& point, Scalar texcoords[2]);
+
+		static Vector3 ComputeBarycentricCoords(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& point);
 };
 
@@ -7,9 +7,38 @@
 * to use and extend the functionality. The code provided here is functional
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
-#include <math.h>
+#include <cmath>
 #include "Vector3.h"
 
+//Pick the fastest horizontal sum the target supports
+#if !defined(VECTOR3_SCALAR)
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define VECTOR3_USE_DPPS
+#elif defined(__SSE3__)
+#define VECTOR3_USE_HADD
+#endif
+#endif
+
+#ifndef VECTOR3_SCALAR
+
+//Dot product of the x, y and z lanes of a and b, the result is in the lowest lane.
+//All three versions add (x + y) + z in the same order as the scalar code.
+static inline __m128 Dot3(__m128 a, __m128 b)
+{
+#if defined(VECTOR3_USE_DPPS)
+	return _mm_dp_ps(a, b, 0x71);
+#elif defined(VECTOR3_USE_HADD)
+	__m128 r = _mm_mul_ps(a, b);
+	r = _mm_and_ps(r, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+	r = _mm_hadd_ps(r, r);
+	return _mm_hadd_ps(r, r);
+#else
+	__m128 r = _mm_mul_ps(a, b);
+	__m128 sum = _mm_add_ss(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_add_ss(sum, _mm_movehl_ps(r, r));
+#endif
+}
+
 Vector3::Vector3()
 {
 	SetVector(0.0f, 0.0f, 0.0f);
@@ -20,7 +49,7 @@ Vector3::Vector3(const Vector3& rhs)
 	mVector = rhs.mVector;
 }
 
-Vector3::Vector3(float x, float y, float z)
+Vector3::Vector3(Scalar x, Scalar y, Scalar z)
 {
 	SetVector(x, y, z);
 }
@@ -30,14 +59,10 @@ Vector3::Vector3(__m128 &vector)
 	mVector = vector;
 }
 
-float Vector3::operator [] (const int i) const
+Scalar& Vector3::operator [] (const int i)
 {
-	return mVector.m128_f32[i];
-}
-
-float& Vector3::operator [] (const int i)
-{
-	return mVector.m128_f32[i];
+	//A writable reference has to point into memory
+	return reinterpret_cast<float*>(&mVector)[i];
 }
 
 Vector3 Vector3::operator + (const Vector3& rhs) const
@@ -68,39 +93,35 @@ Vector3 Vector3::operator * (const Vector3& rhs) const
 	return Vector3(r);
 }
 
-Vector3 Vector3::operator * (float scale) const
+Vector3 Vector3::operator * (Scalar scale) const
 {
-	return Vector3(mVector.m128_f32[0] * scale, mVector.m128_f32[1] * scale, mVector.m128_f32[2] * scale);
+	__m128 r = _mm_mul_ps(mVector, _mm_set1_ps(scale));
+
+	return Vector3(r);
 }
 
-float Vector3::Norm() const
+Scalar Vector3::Norm() const
 {
-	__m128 r = _mm_mul_ps(mVector, mVector);
-
-	return sqrt(r.m128_f32[0] + r.m128_f32[1] + r.m128_f32[2]);
+	return _mm_cvtss_f32(_mm_sqrt_ss(Dot3(mVector, mVector)));
 }
 
-float Vector3::Norm_Sqr() const
+Scalar Vector3::Norm_Sqr() const
 {
-	__m128 r = _mm_mul_ps(mVector, mVector);
-
-	return r.m128_f32[0] + r.m128_f32[1] + r.m128_f32[2];
+	return _mm_cvtss_f32(Dot3(mVector, mVector));
 }
 
-float Vector3::DotProduct(const Vector3& rhs) const
+Scalar Vector3::DotProduct(const Vector3& rhs) const
 {
-	__m128 r = _mm_mul_ps(mVector, rhs.mVector);
-
-	return r.m128_f32[0] + r.m128_f32[1] + r.m128_f32[2];
+	return _mm_cvtss_f32(Dot3(mVector, rhs.mVector));
 }
 
 Vector3 Vector3::Normalise()
 {
-	float length = this->Norm_Sqr();
+	__m128 length = Dot3(mVector, mVector);
 
-	if (length > 1.0e-8f)
+	if (_mm_cvtss_f32(length) > 1.0e-8f)
 	{
-		__m128 l = _mm_set1_ps(length);
+		__m128 l = _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0));
 		l = _mm_rsqrt_ps(l);
 		mVector = _mm_mul_ps(mVector, l);
 	}
@@ -110,47 +131,160 @@ Vector3 Vector3::Normalise()
 
 Vector3 Vector3::CrossProduct(const Vector3& rhs) const
 {
-	__m128 a = _mm_shuffle_ps(mVector, rhs.mVector, _MM_SHUFFLE(0, 2, 2, 1));
-	__m128 b = _mm_shuffle_ps(rhs.mVector, mVector, _MM_SHUFFLE(2, 0, 1, 2));
-	__m128 c = _mm_mul_ps(a, b);
+	//(a * b.yzx - a.yzx * b).yzx
+	__m128 a_yzx = _mm_shuffle_ps(mVector, mVector, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(rhs.mVector, rhs.mVector, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(mVector, b_yzx), _mm_mul_ps(a_yzx, rhs.mVector));
+	c = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
 	
-	return Vector3(c.m128_f32[0] - c.m128_f32[1], c.m128_f32[3] - c.m128_f32[2], mVector.m128_f32[0]*rhs.mVector.m128_f32[1] - mVector.m128_f32[1]*rhs.mVector.m128_f32[0]);
+	return Vector3(c);
+}
+
+void Vector3::SetZero()
+{
+	mVector = _mm_setzero_ps();
 }
 
+const char* Vector3::GetBackendName()
+{
+#if defined(VECTOR3_USE_DPPS)
+	return "SSE4.1 (dpps)";
+#elif defined(VECTOR3_USE_HADD)
+	return "SSE3 (haddps)";
+#else
+	return "SSE2 (shuffles)";
+#endif
+}
+
+#else
+
+//Scalar fallback, used by double precision builds and to measure the SIMD version against plain code
+
+Vector3::Vector3()
+{
+	SetVector(0.0f, 0.0f, 0.0f);
+}
+
+Vector3::Vector3(const Vector3& rhs)
+{
+	SetVector(rhs.mVector[0], rhs.mVector[1], rhs.mVector[2]);
+}
+
+Vector3::Vector3(Scalar x, Scalar y, Scalar z)
+{
+	SetVector(x, y, z);
+}
+
+Scalar& Vector3::operator [] (const int i)
+{
+	return mVector[i];
+}
+
+Vector3 Vector3::operator + (const Vector3& rhs) const
+{
+	return Vector3(mVector[0] + rhs.mVector[0], mVector[1] + rhs.mVector[1], mVector[2] + rhs.mVector[2]);
+}
+
+Vector3 Vector3::operator - (const Vector3& rhs) const
+{
+	return Vector3(mVector[0] - rhs.mVector[0], mVector[1] - rhs.mVector[1], mVector[2] - rhs.mVector[2]);
+}
+
+Vector3 Vector3::operator = (const Vector3& rhs)
+{
+	SetVector(rhs.mVector[0], rhs.mVector[1], rhs.mVector[2]);
+
+	return *this;
+}
+
+Vector3 Vector3::operator * (const Vector3& rhs) const
+{
+	return Vector3(mVector[0] * rhs.mVector[0], mVector[1] * rhs.mVector[1], mVector[2] * rhs.mVector[2]);
+}
+
+Vector3 Vector3::operator * (Scalar scale) const
+{
+	return Vector3(mVector[0] * scale, mVector[1] * scale, mVector[2] * scale);
+}
+
+Scalar Vector3::Norm() const
+{
+	return std::sqrt(Norm_Sqr());
+}
+
+Scalar Vector3::Norm_Sqr() const
+{
+	return DotProduct(*this);
+}
+
+Scalar Vector3::DotProduct(const Vector3& rhs) const
+{
+	return mVector[0] * rhs.mVector[0] + mVector[1] * rhs.mVector[1] + mVector[2] * rhs.mVector[2];
+}
+
+Vector3 Vector3::Normalise()
+{
+	Scalar length = this->Norm_Sqr();
+
+	if (length > (Scalar)1.0e-8)
+	{
+		Scalar l = 1 / std::sqrt(length);
+		mVector[0] *= l;
+		mVector[1] *= l;
+		mVector[2] *= l;
+	}
+
+	return *this;
+}
+
+Vector3 Vector3::CrossProduct(const Vector3& rhs) const
+{
+	return Vector3(mVector[1] * rhs.mVector[2] - mVector[2] * rhs.mVector[1],
+		mVector[2] * rhs.mVector[0] - mVector[0] * rhs.mVector[2],
+		mVector[0] * rhs.mVector[1] - mVector[1] * rhs.mVector[0]);
+}
+
+void Vector3::SetZero()
+{
+	SetVector(0.0f, 0.0f, 0.0f);
+}
+
+const char* Vector3::GetBackendName()
+{
+	return "scalar";
+}
+
+#endif
+
 Vector3 Vector3::Reflect(const Vector3 & n) const
 {
 	Vector3 result;
 	
-	float IndotN = -2.0f*this->DotProduct(n);
+	Scalar IndotN = -2*this->DotProduct(n);
 
 	result = *this + n*IndotN;
 
 	return result;
 }
 
-Vector3 Vector3::Refract(const Vector3 & n, float r_index) const
+Vector3 Vector3::Refract(const Vector3 & n, Scalar r_index) const
 {
 	Vector3 result;
 	result.SetZero();
-	float IndotN = this->DotProduct(n);
+	Scalar IndotN = this->DotProduct(n);
 
-	if (IndotN > 0.0f)
+	if (IndotN > 0)
 	{
-		Vector3 nn = n*(-1.0f);
+		Vector3 nn = n*(-1);
 		IndotN = -this->DotProduct(nn);
 	}
 	else
 		IndotN = -IndotN;
 
-	float k = 1.0f - r_index*r_index*(1.0f - IndotN*IndotN);
+	Scalar k = 1 - r_index*r_index*(1 - IndotN*IndotN);
 
-	if (k >= 0.0f)
-		result = (*this)*r_index + n*(r_index*IndotN - sqrt(k));
+	if (k >= 0)
+		result = (*this)*r_index + n*(r_index*IndotN - std::sqrt(k));
 
 	return result;
 }
-
-void Vector3::SetZero()
-{
-	mVector = _mm_setzero_ps();
-}
@@ -11,49 +11,87 @@
 
 
 //This is an optmised Vector3 class implemented using the SSE 128 intrinsics.
+//Define VECTOR3_SCALAR to build the scalar fallback instead, e.g. for benchmarking.
+//The components are of type Scalar, double precision builds always use the scalar fallback.
 
 #include <immintrin.h>
+#include "Scalar.h"
 
 typedef __m128 Vec4;
 
 class Vector3
 {
 private:
+#ifdef VECTOR3_SCALAR
+	Scalar	mVector[4];
+#else
 	Vec4	mVector;
+#endif
 
 public:
 	Vector3();
 	
 	Vector3(const Vector3& rhs);
 
-	Vector3(float x, float y, float z);
+	Vector3(Scalar x, Scalar y, Scalar z);
 
+#ifndef VECTOR3_SCALAR
 	Vector3(__m128 &vector);
+#endif
 	
 	~Vector3() {;}
 
-	float operator [] (const int i) const;
-	float& operator [] (const int i);
+	inline Scalar operator [] (const int i) const
+	{
+#ifdef VECTOR3_SCALAR
+		return mVector[i];
+#else
+		//Move the requested lane to the bottom instead of going through memory,
+		//the switch folds away for the constant indices used almost everywhere
+		switch (i)
+		{
+			case 0:
+				return _mm_cvtss_f32(mVector);
+			case 1:
+				return _mm_cvtss_f32(_mm_shuffle_ps(mVector, mVector, _MM_SHUFFLE(1, 1, 1, 1)));
+			case 2:
+				return _mm_cvtss_f32(_mm_movehl_ps(mVector, mVector));
+			default:
+				return _mm_cvtss_f32(_mm_shuffle_ps(mVector, mVector, _MM_SHUFFLE(3, 3, 3, 3)));
+		}
+#endif
+	}
+
+	Scalar& operator [] (const int i);
 	Vector3 operator + (const Vector3& rhs) const;	//overloaded operator for computing vector addition
 	Vector3 operator - (const Vector3& rhs) const;	//overloaded operator for computing vector subtraction
 	Vector3 operator * (const Vector3& rhs) const;	//overloaded operator for computing element-wise multiplication e.g. (x1*x2, y1*y2, z1*z2)
-	Vector3 operator * (float scale) const; //overloaded operator for computing vector multiplied by a scalar
+	Vector3 operator * (Scalar scale) const; //overloaded operator for computing vector multiplied by a scalar
 	Vector3 operator = (const Vector3& rhs); //overloaded assignment operator.
 
-	float Norm()	const;
-	float Norm_Sqr() const;
+	Scalar Norm()	const;
+	Scalar Norm_Sqr() const;
 	Vector3 Normalise();
 
-	float DotProduct(const Vector3& rhs) const;		//method for computing dot product between this and rhs
+	Scalar DotProduct(const Vector3& rhs) const;		//method for computing dot product between this and rhs
 	Vector3 CrossProduct(const Vector3& rhs) const; //method for computing cross product between this and rhs
 	
 	Vector3 Reflect(const Vector3& n) const; //Reflect this vector about the given normal n
-	Vector3 Refract(const Vector3& n, float r_index) const; //Compute the refraction of this vector about the given normal n and refraction index
+	Vector3 Refract(const Vector3& n, Scalar r_index) const; //Compute the refraction of this vector about the given normal n and refraction index
 
 	void SetZero();
+
+	static const char* GetBackendName();	//name of the instruction set used by this build of Vector3
 	
-	inline void SetVector(float x, float y, float z)
+	inline void SetVector(Scalar x, Scalar y, Scalar z)
 	{ 
+#ifdef VECTOR3_SCALAR
+		mVector[0] = x;
+		mVector[1] = y;
+		mVector[2] = z;
+		mVector[3] = 0.0f;
+#else
 		mVector = _mm_set_ps(0.0f, z, y, x);
+#endif
 	}
 };
@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2018  Minsi Chen
+* E-mail: m.chen@hud.ac.uk
+*
+* The source is written for the CSwGP related modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+
+//Microbenchmark of the Vector3 operations used by the ray tracer.
+//CMake builds it twice, vector3_bench with the SIMD Vector3 and vector3_bench_scalar
+//with VECTOR3_SCALAR defined, so the two can be compared on the same machine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <vector>
+
+#include "Vector3.h"
+
+static const int s_vectorCount = 4096;		//small enough to stay in the L1/L2 cache
+static const int s_repeats = 2000;
+
+static std::vector<Vector3> s_a;
+static std::vector<Vector3> s_b;
+static float s_sink = 0.0f;					//consumes every result so nothing is optimised away
+
+//Time op(a, b) over all vector pairs and print the time per call
+template<typename Op>
+static void Measure(const char* name, Op op)
+{
+	float sum = 0.0f;
+	double start_time = omp_get_wtime();
+
+	for (int r = 0; r < s_repeats; r++)
+		for (int i = 0; i < s_vectorCount; i++)
+			sum += op(s_a[i], s_b[i]);
+
+	double time = omp_get_wtime() - start_time;
+	s_sink += sum;
+
+	printf("  %-14s %8.3f ns/op\n", name, time * 1e9 / ((double)s_repeats * s_vectorCount));
+}
+
+int main()
+{
+	srand(1);
+
+	for (int i = 0; i < s_vectorCount; i++)
+	{
+		s_a.push_back(Vector3(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f));
+		s_b.push_back(Vector3(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f));
+	}
+
+	printf("Vector3 backend: %s\n", Vector3::GetBackendName());
+
+	Measure("operator[]", [](const Vector3& a, const Vector3& b) { return a[0] + a[1] + a[2] + b[1]; });
+	Measure("operator+", [](const Vector3& a, const Vector3& b) { return (a + b)[1]; });
+	Measure("operator*(f)", [](const Vector3& a, const Vector3& b) { return (a * b[0])[2]; });
+	Measure("DotProduct", [](const Vector3& a, const Vector3& b) { return a.DotProduct(b); });
+	Measure("Norm", [](const Vector3& a, const Vector3&) { return a.Norm(); });
+	Measure("CrossProduct", [](const Vector3& a, const Vector3& b) { return a.CrossProduct(b)[0]; });
+	Measure("Normalise", [](const Vector3& a, const Vector3&) { Vector3 n = a; return n.Normalise()[1]; });
+	Measure("Reflect", [](const Vector3& a, const Vector3& b) { return a.Reflect(b)[2]; });
+
+	printf("checksum %f\n", s_sink);
+
+	return 0;
+}